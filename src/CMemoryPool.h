@@ -2,19 +2,89 @@
 #define MEMORYPOOL_CMEMORYPOOL_H
 
 #include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include <stdexcept>
+#include <vector>
 
 namespace MemoryPoolImplementationDetails {
     #include "memory_pool.h"
 }
 
 template<typename T> class MemoryPool;
+template<typename T> class Root;
 
+/*
+ * Whether a MemoryPool may be used to allocate MemoryNodes from multiple
+ * threads at the same time. Garbage collection still requires that no other
+ * thread uses the pool.
+ */
+enum class MemoryPoolThreading { SingleThreaded, ThreadSafe };
+
+/*
+ * The order in which MemoryPool<T>::gc_copy lays out the surviving MemoryNodes.
+ */
+enum class MemoryPoolTraversal { BreadthFirst, DepthFirst };
+
+/*
+ * How the garbage collections of a MemoryPool<T> find the reachable
+ * MemoryNodes, see MemoryPoolTracer in memory_pool.h.
+ */
+enum class MemoryPoolTracer { PointerReversal, MarkStack };
+
+/*
+ * The statistics of a MemoryPool<T>, see MemoryPoolStats in memory_pool.h.
+ */
+using MemoryPoolStats = MemoryPoolImplementationDetails::MemoryPoolStats;
+
+/*
+ * An allocation site of a sampling MemoryPool<T>, see MemoryPoolAllocationSite
+ * in memory_pool.h.
+ */
+using MemoryPoolAllocationSite = MemoryPoolImplementationDetails::MemoryPoolAllocationSite;
+
+/*
+ * A MemoryNode<T> refers to its MemoryNode through a handle of the pool, so it
+ * stays valid when the MemoryNode is moved by a compaction. It must not
+ * outlive its MemoryPool.
+ *
+ * A MemoryNode<T> is empty if it has been moved from, if it stands for an
+ * unset neighbour or if its MemoryNode has been collected. Only copying,
+ * assigning, empty and passing it to set_neighbour are allowed on an empty
+ * MemoryNode<T>, everything else throws std::logic_error.
+ */
 template<typename T>
 class MemoryNode final {
 public:
-    [[nodiscard]] std::uint16_t get_neighbour_count() const noexcept {
-           return MemoryPoolImplementationDetails::memoryNode_get_neighbour_count(&node);
+    MemoryNode(const MemoryNode& other) : pool{other.pool}, handle{nullptr} {
+        if(!other.empty()) {
+            handle = MemoryPoolImplementationDetails::memoryPool_new_handle(pool, *other.handle);
+            if(handle == nullptr)
+                throw std::bad_alloc();
+        }
+    }
+
+    MemoryNode(MemoryNode&& other) noexcept : pool{other.pool}, handle{std::exchange(other.handle, nullptr)} {}
+
+    MemoryNode& operator=(MemoryNode other) noexcept {
+        std::swap(pool, other.pool);
+        std::swap(handle, other.handle);
+        return *this;
+    }
+
+    ~MemoryNode() noexcept {
+        if(handle != nullptr)
+            MemoryPoolImplementationDetails::memoryPool_free_handle(pool, handle);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+           return handle == nullptr || *handle == nullptr;
+    }
+
+    [[nodiscard]] std::uint16_t get_neighbour_count() const {
+           return MemoryPoolImplementationDetails::memoryNode_get_neighbour_count(&get_node());
    };
 
     [[nodiscard]] MemoryNode get_neighbour(std::uint16_t index) const {
@@ -22,40 +92,62 @@ public:
            if(index >= count)
                throw std::range_error("Index out of range");
 
-           const auto impl = MemoryPoolImplementationDetails::memoryNode_getNeighbour(&node, index);
-           return MemoryNode{impl};
+           const auto impl = MemoryPoolImplementationDetails::memoryNode_getNeighbour(&get_node(), index);
+           if(impl == nullptr)
+               return MemoryNode{*pool};
+
+           return MemoryNode{*pool, *impl};
     }
 
     void set_neighbour(const MemoryNode& neighbour, std::uint16_t index) {
            const auto count = this->get_neighbour_count();
            if(index >= count) throw std::range_error("Index out of range");
-           MemoryPoolImplementationDetails::memoryNode_setNeighbour(&node, &neighbour.node, index);
+           const auto impl = neighbour.empty() ? nullptr : &neighbour.get_node();
+           MemoryPoolImplementationDetails::memoryNode_setNeighbour(&get_node(), impl, index);
     }
 
-    [[nodiscard]] T& get_data() const noexcept {
-          return *static_cast<T*>(MemoryPoolImplementationDetails::memoryNode_get_data(&node));
+    [[nodiscard]] T& get_data() const {
+          return *getObjectLocation(get_node());
     }
 
 private:
     friend class MemoryPool<T>;
+    friend class Root<T>;
 
-    explicit MemoryNode(MemoryPoolImplementationDetails::MemoryNode& memoryNode) : node {memoryNode} {}
+    explicit MemoryNode(MemoryPoolImplementationDetails::MemoryPool& memoryPool) noexcept : pool{&memoryPool}, handle{nullptr} {}
 
-    MemoryNode(MemoryPoolImplementationDetails::MemoryNode& memoryNode, T&& initial_value) :node{memoryNode} {
+    MemoryNode(MemoryPoolImplementationDetails::MemoryPool& memoryPool, MemoryPoolImplementationDetails::MemoryNode& memoryNode)
+        : pool{&memoryPool}, handle{MemoryPoolImplementationDetails::memoryPool_new_handle(&memoryPool, &memoryNode)} {
+         if(handle == nullptr)
+             throw std::bad_alloc();
+    }
+
+    MemoryNode(MemoryPoolImplementationDetails::MemoryPool& memoryPool, MemoryPoolImplementationDetails::MemoryNode& memoryNode, T&& initial_value)
+        : MemoryNode{memoryPool, memoryNode} {
          const auto location = getObjectLocation(memoryNode);
          new(location) T(std::forward<T>(initial_value));
     }
 
     template<typename... Args>
-    explicit MemoryNode(MemoryPoolImplementationDetails::MemoryNode& memoryNode, Args&&... args) :node{memoryNode} {
+    explicit MemoryNode(MemoryPoolImplementationDetails::MemoryPool& memoryPool, MemoryPoolImplementationDetails::MemoryNode& memoryNode, Args&&... args)
+        : MemoryNode{memoryPool, memoryNode} {
          const auto location = getObjectLocation(memoryNode);
          new(location) T{std::forward<Args>(args)...};
     }
 
-    [[nodiscard]] MemoryPoolImplementationDetails::MemoryNode&  get_node() const noexcept {
-         return node;
+    [[nodiscard]] MemoryPoolImplementationDetails::MemoryNode&  get_node() const {
+         if(empty())
+             throw std::logic_error("MemoryNode is empty");
+
+         return **handle;
     }
 
+    /*
+     * The data of a MemoryNode is 8 byte aligned, so a value only needs room
+     * to be aligned if its type asks for more.
+     */
+    static constexpr std::size_t alignment_slack = alignof(T) > 8 ? alignof(T) : 0;
+
     template<typename U>
     static size_t offset(const char * const buffer) noexcept {
         const auto alignment = alignof(U);
@@ -66,64 +158,290 @@ private:
 
     static T* getObjectLocation(MemoryPoolImplementationDetails::MemoryNode& node) {
         const auto data = MemoryPoolImplementationDetails::memoryNode_get_data(&node);
+        if constexpr(alignment_slack == 0)
+            return static_cast<T*>(data);
+
         const auto chars = static_cast<char*>(data);
         const auto location = chars + offset<T>(chars);
         return reinterpret_cast<T*>(location);
     }
 
-    MemoryPoolImplementationDetails::MemoryNode& node;
+    MemoryPoolImplementationDetails::MemoryPool* pool;
+    MemoryPoolImplementationDetails::MemoryNode** handle;
+};
+
+/*
+ * A Root<T> keeps its MemoryNode in the root set of the pool for as long as it
+ * lives. Several Root<T>s may refer to the same MemoryNode, which stays a root
+ * until the last of them is destroyed. Like a MemoryNode<T>, it must not
+ * outlive its MemoryPool.
+ */
+template<typename T>
+class Root final {
+public:
+    explicit Root(const MemoryNode<T>& memoryNode) : node{memoryNode} {
+        if(!MemoryPoolImplementationDetails::memoryPool_add_root_node(node.pool, &node.get_node()))
+            throw std::bad_alloc();
+    }
+
+    Root(const Root&) = delete;
+    Root(Root&&) noexcept = default;
+
+    Root& operator=(Root other) noexcept {
+        std::swap(node.pool, other.node.pool);
+        std::swap(node.handle, other.node.handle);
+        return *this;
+    }
+
+    ~Root() noexcept {
+        if(!node.empty())
+            MemoryPoolImplementationDetails::memoryPool_remove_root_node(node.pool, &node.get_node());
+    }
+
+    [[nodiscard]] const MemoryNode<T>& get() const noexcept {
+        return node;
+    }
+
+private:
+    MemoryNode<T> node;
 };
 
 template<typename T>
 class MemoryPool final {
 public:
-    explicit MemoryPool(const std::size_t size) {
-         const auto freeFn = [](void *e) { std::destroy_at<T>(static_cast<T*>(e)); };
-         pool = MemoryPoolImplementationDetails::memory_pool_new(size, freeFn);
-         if(pool.head == nullptr)
+    explicit MemoryPool(const std::size_t size, const MemoryPoolThreading threading = MemoryPoolThreading::SingleThreaded, const MemoryPoolTracer tracer = MemoryPoolTracer::PointerReversal) {
+         // Without a FreeFn the sweep does not call anything for dead values,
+         // and freeing the pool does not need to walk its MemoryNodes.
+         MemoryPoolImplementationDetails::FreeFn freeFn = nullptr;
+         if constexpr(!std::is_trivially_destructible_v<T>)
+             freeFn = [](void *e) { std::destroy_at<T>(static_cast<T*>(e)); };
+
+         const auto engine = tracer == MemoryPoolTracer::PointerReversal
+                 ? MemoryPoolImplementationDetails::MemoryPoolTracer_PointerReversal
+                 : MemoryPoolImplementationDetails::MemoryPoolTracer_MarkStack;
+         pool = std::make_unique<MemoryPoolImplementationDetails::MemoryPool>(MemoryPoolImplementationDetails::memory_pool_new_tracer(size, freeFn, MemoryPoolImplementationDetails::MemoryPoolArena_Malloc, engine));
+         if(pool->head == nullptr)
+             throw std::bad_alloc();
+
+         if(threading == MemoryPoolThreading::ThreadSafe && !MemoryPoolImplementationDetails::memoryPool_enable_thread_safe_alloc(pool.get(), 0)) {
+             MemoryPoolImplementationDetails::memoryPool_free(pool.get());
              throw std::bad_alloc();
+         }
     }
 
    MemoryPool(const MemoryPool<T>&) = delete;
    MemoryPool& operator=(const MemoryPool<T>&) = delete;
    MemoryPool(MemoryPool<T>&&)  noexcept = default;
-   MemoryPool& operator=(MemoryPool<T>&&)  noexcept = default;
+   MemoryPool& operator=(MemoryPool<T>&& other) noexcept {
+           std::swap(pool, other.pool);
+           return *this;
+   }
 
    ~MemoryPool() noexcept {
-           MemoryPoolImplementationDetails::memoryPool_free(&pool);
+           if(pool != nullptr)
+               MemoryPoolImplementationDetails::memoryPool_free(pool.get());
    };
 
    MemoryNode<T> alloc(const std::size_t neighbours, T&& value) {
        auto& node = allocNode(neighbours);
-       return MemoryNode<T> {node, std::forward<T>(value)};
+       return MemoryNode<T> {*pool, node, std::forward<T>(value)};
    }
 
    template<typename... Args>
    MemoryNode<T> alloc_emplace(const std::size_t neighbours, Args&&... args) {
        auto& node = allocNode(neighbours);
-       return MemoryNode<T> {node, std::forward<Args>(args)...};
+       return MemoryNode<T> {*pool, node, std::forward<Args>(args)...};
+   }
+
+   /*
+    * Allocates `count` MemoryNodes in one go, each initialized with a copy of
+    * `args`. The MemoryNodes are placed next to each other in memory.
+    */
+   template<typename... Args>
+   std::vector<MemoryNode<T>> alloc_many(const std::size_t count, const std::size_t neighbours, const Args&... args) {
+       return emplaceNodes(count, neighbours, [&](auto& node) { return MemoryNode<T> {*pool, node, args...}; });
+   }
+
+   /*
+    * Allocates one MemoryNode for each value in the forward range
+    * [first, last). The MemoryNodes are placed next to each other in memory.
+    */
+   template<typename Iterator>
+   std::vector<MemoryNode<T>> alloc_range(const std::size_t neighbours, Iterator first, const Iterator last) {
+       const auto count = static_cast<std::size_t>(std::distance(first, last));
+       return emplaceNodes(count, neighbours, [&](auto& node) { return MemoryNode<T> {*pool, node, *first++}; });
+   }
+
+   /*
+    * Lets the pool grow up to `max_size` bytes instead of throwing
+    * std::bad_alloc once it is full. 0 means no limit.
+    */
+   void enable_growth(const std::size_t max_size = 0) {
+      if(!MemoryPoolImplementationDetails::memoryPool_enable_growth(pool.get(), max_size))
+           throw std::bad_alloc();
+   }
+
+   /*
+    * Runs the destructors of collected values outside of the collection, on
+    * `workers` background threads or, with 0 workers, in run_finalizers. The
+    * destructor of T must then be safe to run on another thread.
+    */
+   void enable_background_finalizers(const std::size_t workers) {
+      if(!MemoryPoolImplementationDetails::memoryPool_enable_background_finalizers(pool.get(), workers))
+           throw std::bad_alloc();
+   }
+
+   bool run_finalizers(const std::size_t budget) noexcept {
+      return MemoryPoolImplementationDetails::memoryPool_run_finalizers(pool.get(), budget);
+   }
+
+   /*
+    * Lets allocations collect the pool when it runs full or enough has been
+    * allocated since the last collection. Every allocation may then destroy
+    * the values that are not reachable from a root.
+    */
+   void enable_auto_gc() {
+      if(!MemoryPoolImplementationDetails::memoryPool_enable_auto_gc(pool.get()))
+           throw std::bad_alloc();
+   }
+
+   /*
+    * Lets the pool count its collections and allocations, see stats.
+    */
+   void enable_stats() {
+      if(!MemoryPoolImplementationDetails::memoryPool_enable_stats(pool.get()))
+           throw std::bad_alloc();
+   }
+
+   /*
+    * Returns the current statistics. Walks all MemoryNodes to describe the
+    * heap, so its fragmentation can be watched before allocations fail.
+    */
+   [[nodiscard]] MemoryPoolStats stats() const noexcept {
+      MemoryPoolStats stats;
+      MemoryPoolImplementationDetails::memoryPool_get_stats(pool.get(), &stats);
+      return stats;
+   }
+
+   /*
+    * Samples about one allocation per `interval` bytes and attributes it to
+    * the current allocation site, see allocation_sites.
+    */
+   void enable_sampling(const std::size_t interval) {
+      if(!MemoryPoolImplementationDetails::memoryPool_enable_sampling(pool.get(), interval))
+           throw std::bad_alloc();
+   }
+
+   /*
+    * Attributes the following allocations to `tag`, which must outlive the
+    * pool, or to their backtraces if it is nullptr.
+    */
+   void set_allocation_site(const char* const tag) noexcept {
+      MemoryPoolImplementationDetails::memoryPool_set_allocation_site(pool.get(), tag);
+   }
+
+   [[nodiscard]] std::vector<MemoryPoolAllocationSite> allocation_sites() const {
+      std::vector<MemoryPoolAllocationSite> sites;
+      MemoryPoolImplementationDetails::memoryPool_report_allocation_sites(pool.get(), [](const MemoryPoolAllocationSite* site, void* context) {
+          static_cast<std::vector<MemoryPoolAllocationSite>*>(context)->push_back(*site);
+          return true;
+      }, &sites);
+      return sites;
    }
 
    void add_root_node(const MemoryNode<T>& node) {
-      const auto success = MemoryPoolImplementationDetails::memoryPool_add_root_node(&pool, &node.get_node());
+      const auto success = MemoryPoolImplementationDetails::memoryPool_add_root_node(pool.get(), &node.get_node());
       if(!success)
            throw std::runtime_error("Failed to add MemoryNode to root set.");
    }
 
+   /*
+    * Undoes one add_root_node of the MemoryNode. Returns false if it is not a
+    * root.
+    */
+   bool remove_root_node(const MemoryNode<T>& node) noexcept {
+      return !node.empty() && MemoryPoolImplementationDetails::memoryPool_remove_root_node(pool.get(), &node.get_node());
+   }
+
    void gc_mark_and_sweep() noexcept {
-      MemoryPoolImplementationDetails::memoryPool_gc_mark_and_sweep(&pool);
+      MemoryPoolImplementationDetails::memoryPool_gc_mark_and_sweep(pool.get());
+   }
+
+   /*
+    * Collects garbage and moves the surviving MemoryNodes next to each other.
+    * Existing MemoryNode<T>s keep referring to the moved MemoryNodes. As the
+    * values are moved with memmove, T must be trivially copyable.
+    */
+   void gc_mark_compact() noexcept {
+      static_assert(std::is_trivially_copyable_v<T>, "Compaction moves values with memmove.");
+      static_assert(alignof(T) <= 8, "Compaction moves values by multiples of 8 bytes.");
+      MemoryPoolImplementationDetails::memoryPool_gc_mark_compact(pool.get());
+   }
+
+   /*
+    * Collects garbage by copying the surviving MemoryNodes into new memory in
+    * the given order. Like gc_mark_compact, T must be trivially copyable.
+    */
+   void gc_copy(const MemoryPoolTraversal order = MemoryPoolTraversal::BreadthFirst) noexcept {
+      static_assert(std::is_trivially_copyable_v<T>, "Copying moves values with memcpy.");
+      static_assert(alignof(T) <= 8, "Copying moves values by multiples of 8 bytes.");
+      const auto traversal = order == MemoryPoolTraversal::BreadthFirst
+              ? MemoryPoolImplementationDetails::MemoryPoolTraversal_BreadthFirst
+              : MemoryPoolImplementationDetails::MemoryPoolTraversal_DepthFirst;
+      MemoryPoolImplementationDetails::memoryPool_gc_copy(pool.get(), traversal);
+   }
+
+   /*
+    * Starts an incremental collection. gc_step marks the pool in steps of
+    * `budget` MemoryNodes and returns whether work is left, gc_finish ends the
+    * collection. MemoryNodes that are reachable when the collection starts or
+    * that are allocated before it finishes are not collected.
+    */
+   void gc_start() {
+      if(!MemoryPoolImplementationDetails::memoryPool_gc_start(pool.get()))
+           throw std::bad_alloc();
+   }
+
+   bool gc_step(const std::size_t budget) noexcept {
+      return MemoryPoolImplementationDetails::memoryPool_gc_step(pool.get(), budget);
+   }
+
+   void gc_finish() noexcept {
+      MemoryPoolImplementationDetails::memoryPool_gc_finish(pool.get());
    }
 
 private:
     MemoryPoolImplementationDetails::MemoryNode& allocNode(const std::size_t neighbours) {
-      const auto node = MemoryPoolImplementationDetails::memoryPool_alloc(&pool, sizeof(T) + alignof(T), neighbours);
+      const auto node = MemoryPoolImplementationDetails::memoryPool_alloc(pool.get(), sizeof(T) + MemoryNode<T>::alignment_slack, neighbours);
        if(node == nullptr)
            throw std::bad_alloc();
 
        return *node;
     }
 
-    MemoryPoolImplementationDetails::MemoryPool pool;
+    template<typename Emplace>
+    std::vector<MemoryNode<T>> emplaceNodes(const std::size_t count, const std::size_t neighbours, Emplace emplace) {
+       std::vector<MemoryPoolImplementationDetails::MemoryNode*> raw(count);
+       if(!MemoryPoolImplementationDetails::memoryPool_alloc_bulk(pool.get(), count, sizeof(T) + MemoryNode<T>::alignment_slack, neighbours, raw.data()))
+           throw std::bad_alloc();
+
+       std::vector<MemoryNode<T>> nodes;
+       std::size_t constructed = 0;
+       try {
+           nodes.reserve(count);
+           for(; constructed < count; ++constructed)
+               nodes.push_back(emplace(*raw[constructed]));
+       } catch(...) {
+           // Nodes that already hold a value are collected as usual, the
+           // others must not be finalized and are handed back right away.
+           MemoryPoolImplementationDetails::memoryPool_release_nodes(pool.get(), raw.data() + constructed, count - constructed);
+           throw;
+       }
+
+       return nodes;
+    }
+
+    std::unique_ptr<MemoryPoolImplementationDetails::MemoryPool> pool;
 };
 
 #endif
@@ -0,0 +1,885 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heap_dump.h"
+#include "memory_pool.h"
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static const size_t NODE_DATA_SIZE = 16;
+static const size_t NODE_FOOTPRINT = 48;
+static const size_t ALLOC_SAMPLES = 10000;
+
+static double time_allocs(MemoryPool *const pool) {
+    const double start = now_ns();
+    for (size_t i = 0; i < ALLOC_SAMPLES; ++i)
+        memoryPool_alloc(pool, NODE_DATA_SIZE, 1);
+
+    return (now_ns() - start) / (double) ALLOC_SAMPLES;
+}
+
+/*
+ * Measures the average latency of memoryPool_alloc depending on the number of
+ * MemoryNodes that are alive in the pool, once for a pool whose free space is
+ * in one piece and once for a pool where every other node has been collected.
+ */
+static void bench_alloc_latency_vs_live_nodes() {
+    printf("%12s %18s %18s\n", "live nodes", "fresh ns/alloc", "fragmented ns/alloc");
+
+    for (size_t live = 1000; live <= 1000000; live *= 10) {
+        MemoryPool fresh = memory_pool_new((live + ALLOC_SAMPLES) * NODE_FOOTPRINT, NULL);
+        for (size_t i = 0; i < live; ++i)
+            memoryPool_alloc(&fresh, NODE_DATA_SIZE, 1);
+
+        const double fresh_ns = time_allocs(&fresh);
+        memoryPool_free(&fresh);
+
+        MemoryPool fragmented = memory_pool_new((2 * live + ALLOC_SAMPLES) * NODE_FOOTPRINT, NULL);
+        MemoryNode *previous = NULL;
+        for (size_t i = 0; i < live; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&fragmented, NODE_DATA_SIZE, 1);
+            memoryNode_setNeighbour(node, previous, 0);
+            previous = node;
+            memoryPool_alloc(&fragmented, NODE_DATA_SIZE, 1);
+        }
+
+        memoryPool_add_root_node(&fragmented, previous);
+        memoryPool_gc_mark_and_sweep(&fragmented);
+        const double fragmented_ns = time_allocs(&fragmented);
+        memoryPool_free(&fragmented);
+
+        printf("%12zu %18.1f %18.1f\n", live, fresh_ns, fragmented_ns);
+    }
+}
+
+static MemoryNode *alloc_list(MemoryPool *const pool, const size_t length) {
+    MemoryNode *previous = NULL;
+    for (size_t i = 0; i < length; ++i) {
+        MemoryNode *const node = memoryPool_alloc(pool, NODE_DATA_SIZE, 1);
+        memoryNode_setNeighbour(node, previous, 0);
+        previous = node;
+    }
+
+    return previous;
+}
+
+/*
+ * Compares the pause of a minor collection with the pause of a full
+ * collection, for a growing amount of old MemoryNodes and a nursery in which
+ * one in a hundred MemoryNodes survives.
+ */
+static void bench_minor_vs_major_gc() {
+    const size_t young = 10000;
+    printf("%12s %18s %18s\n", "old nodes", "minor gc us", "major gc us");
+
+    for (size_t old = 1000; old <= 1000000; old *= 10) {
+        MemoryPool pool = memory_pool_new((old + 2 * young) * NODE_FOOTPRINT, NULL);
+        memoryPool_add_root_node(&pool, alloc_list(&pool, old));
+        memoryPool_enable_generational(&pool, young * NODE_FOOTPRINT);
+
+        MemoryNode *const anchor = memoryPool_alloc(&pool, 0, young / 100);
+        memoryPool_add_root_node(&pool, anchor);
+        memoryPool_gc_mark_and_sweep(&pool);
+
+        double times[2];
+        for (int major = 0; major < 2; ++major) {
+            MemoryNode *const holder = pool.rootSet[1];
+            for (size_t i = 0; i < young; ++i) {
+                MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+                if (i % 100 == 0)
+                    memoryNode_setNeighbour(holder, node, i / 100);
+            }
+
+            const double start = now_ns();
+            if (major)
+                memoryPool_gc_mark_and_sweep(&pool);
+            else
+                memoryPool_gc_minor(&pool);
+            times[major] = (now_ns() - start) / 1000;
+        }
+
+        memoryPool_free(&pool);
+        printf("%12zu %18.1f %18.1f\n", old, times[0], times[1]);
+    }
+}
+
+/*
+ * Compares allocating a batch of MemoryNodes one by one with allocating the
+ * same batch with a single call to memoryPool_alloc_bulk, in a pool whose free
+ * space is fragmented into many small gaps and a few large ones.
+ */
+static void bench_alloc_bulk() {
+    enum { BATCH = 10000 };
+    static MemoryNode *nodes[BATCH];
+    printf("%12s %18s %18s\n", "batches", "single ns/node", "bulk ns/node");
+
+    for (size_t batches = 1; batches <= 100; batches *= 10) {
+        double times[2];
+        for (int bulk = 0; bulk < 2; ++bulk) {
+            MemoryPool pool = memory_pool_new(3 * batches * BATCH * NODE_FOOTPRINT, NULL);
+            MemoryNode *previous = NULL;
+            for (size_t i = 0; i < batches * BATCH; ++i) {
+                MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+                memoryNode_setNeighbour(node, previous, 0);
+                previous = node;
+                memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+            }
+
+            // Touch the rest of the pool, so that page faults do not count.
+            while (memoryPool_alloc(&pool, NODE_DATA_SIZE, 1));
+            memoryPool_add_root_node(&pool, previous);
+            memoryPool_gc_mark_and_sweep(&pool);
+
+            const double start = now_ns();
+            for (size_t b = 0; b < batches; ++b) {
+                if (bulk) {
+                    memoryPool_alloc_bulk(&pool, BATCH, NODE_DATA_SIZE, 1, nodes);
+                } else {
+                    for (size_t i = 0; i < BATCH; ++i)
+                        nodes[i] = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+                }
+            }
+
+            times[bulk] = (now_ns() - start) / (double) (batches * BATCH);
+            memoryPool_free(&pool);
+        }
+
+        printf("%12zu %18.1f %18.1f\n", batches, times[0], times[1]);
+    }
+}
+
+static size_t resident_bytes() {
+    size_t size = 0, resident = 0;
+    FILE *const statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+
+    return resident * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Compares the arenas a pool can be backed by. A list of MemoryNodes that is
+ * scattered randomly over a large pool is collected, which is dominated by
+ * cache and TLB misses. Then all but the first hundredth of the pool becomes
+ * garbage, and the resident memory after the next collection shows whether
+ * free pages are returned to the operating system.
+ */
+static void bench_arenas() {
+    const size_t nodes = 1000000;
+    static const char *const names[] = {"malloc", "mapped", "huge pages", "hugetlb"};
+    printf("%12s %18s %18s %18s\n", "arena", "gc ms", "rss before MiB", "rss after MiB");
+
+    MemoryNode **const allocated = malloc(nodes * sizeof(MemoryNode *));
+    MemoryNode **const order = malloc(nodes * sizeof(MemoryNode *));
+    for (MemoryPoolArena arena = MemoryPoolArena_Malloc; arena <= MemoryPoolArena_HugeTlb; ++arena) {
+        MemoryPool pool = memory_pool_new_arena(nodes * NODE_FOOTPRINT, NULL, arena);
+        for (size_t i = 0; i < nodes; ++i)
+            allocated[i] = order[i] = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+
+        srand(42);
+        for (size_t i = nodes - 1; i > 0; --i) {
+            const size_t j = (size_t) rand() % (i + 1);
+            MemoryNode *const swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+
+        for (size_t i = 1; i < nodes; ++i)
+            memoryNode_setNeighbour(order[i - 1], order[i], 0);
+
+        memoryPool_add_root_node(&pool, order[0]);
+        const double start = now_ns();
+        memoryPool_gc_mark_and_sweep(&pool);
+        const double gc_ms = (now_ns() - start) / 1e6;
+
+        const size_t before = resident_bytes();
+        memoryNode_setNeighbour(order[0], NULL, 0);
+        for (size_t i = 0; i < nodes / 100; ++i) {
+            memoryNode_setNeighbour(allocated[i], NULL, 0);
+            memoryPool_add_root_node(&pool, allocated[i]);
+        }
+
+        memoryPool_gc_mark_and_sweep(&pool);
+        const size_t after = resident_bytes();
+
+        memoryPool_free(&pool);
+        printf("%12s %18.1f %18.1f %18.1f\n", names[arena], gc_ms, before / 1048576.0, after / 1048576.0);
+    }
+
+    free(allocated);
+    free(order);
+}
+
+enum { CHURN_TABLES = 256, CHURN_TABLE_SLOTS = 1024, CHURN_SLOTS = CHURN_TABLES * CHURN_TABLE_SLOTS };
+
+typedef struct {
+    MemoryPool pool;
+    MemoryNode *root;
+    size_t sizes[CHURN_SLOTS];
+    size_t live;
+    double gc_ns;
+} Churn;
+
+static size_t churn_size() {
+    // Mostly small MemoryNodes with a tail of larger buffers.
+    return rand() % 10 < 7 ? 8 + (size_t) rand() % 64 : 64 + (size_t) rand() % 2048;
+}
+
+static void churn_set(Churn *const churn, const size_t slot, MemoryNode *const node, const size_t size) {
+    MemoryNode *const table = memoryNode_getNeighbour(churn->root, slot / CHURN_TABLE_SLOTS);
+    memoryNode_setNeighbour(table, node, slot % CHURN_TABLE_SLOTS);
+    churn->live += size - churn->sizes[slot];
+    churn->sizes[slot] = size;
+}
+
+/*
+ * Puts a new MemoryNode of random size into the given slot and collects the
+ * pool if it is full. Fails if the pool is still full after the collection.
+ */
+static bool churn_step(Churn *const churn, const size_t slot) {
+    const size_t size = churn_size();
+    MemoryNode *node = memoryPool_alloc(&churn->pool, size, 1);
+    if (!node) {
+        const double start = now_ns();
+        memoryPool_gc_mark_and_sweep(&churn->pool);
+        churn->gc_ns += now_ns() - start;
+        if (!(node = memoryPool_alloc(&churn->pool, size, 1)))
+            return false;
+    }
+
+    churn_set(churn, slot, node, size);
+    return true;
+}
+
+/*
+ * Fills half of a pool of fixed size with MemoryNodes of random size, then
+ * replaces random ones of them, and finally fills the pool till an allocation
+ * fails even after a collection. The share of the pool that is alive at that
+ * point shows how well the placement policy avoids fragmentation. The time of
+ * the collections is not part of the allocation latency.
+ */
+static void run_churn(const MemoryPoolPlacement placement, double *const ns_per_alloc, double *const utilization) {
+    const size_t pool_size = 32ULL << 20;
+    const size_t steps = 1000000;
+    static Churn churn;
+    memset(&churn, 0, sizeof(Churn));
+
+    churn.pool = memory_pool_new(pool_size, NULL);
+    memoryPool_set_placement(&churn.pool, placement);
+    churn.root = memoryPool_alloc(&churn.pool, 0, CHURN_TABLES);
+    memoryPool_add_root_node(&churn.pool, churn.root);
+    for (uint16_t t = 0; t < CHURN_TABLES; ++t)
+        memoryNode_setNeighbour(churn.root, memoryPool_alloc(&churn.pool, 0, CHURN_TABLE_SLOTS), t);
+
+    srand(7);
+    size_t used = 0;
+    while (churn.live < pool_size / 2 && churn_step(&churn, used))
+        ++used;
+
+    const double start = now_ns();
+    for (size_t i = 0; i < steps; ++i)
+        churn_step(&churn, (size_t) rand() % used);
+
+    *ns_per_alloc = (now_ns() - start - churn.gc_ns) / (double) steps;
+
+    while (used < CHURN_SLOTS && churn_step(&churn, used))
+        ++used;
+
+    *utilization = (double) churn.live / (double) pool_size;
+    memoryPool_free(&churn.pool);
+}
+
+/*
+ * Compares the placement policies on the churn pattern above.
+ */
+static void bench_placement() {
+    static const char *const names[] = {"segregated", "next fit", "best fit"};
+    printf("%12s %18s %18s\n", "placement", "ns/alloc", "live when full %");
+    for (MemoryPoolPlacement placement = MemoryPoolPlacement_SegregatedFit; placement <= MemoryPoolPlacement_BestFit; ++placement) {
+        double ns_per_alloc, utilization;
+        run_churn(placement, &ns_per_alloc, &utilization);
+        printf("%12s %18.1f %18.1f\n", names[placement], ns_per_alloc, utilization * 100);
+    }
+}
+
+enum { MAX_THREADS = 16 };
+static const size_t ALLOCS_PER_THREAD = 200000;
+
+typedef struct {
+    MemoryPool *pool;
+    mtx_t *lock;
+} AllocThread;
+
+static int alloc_thread(void *const arg) {
+    AllocThread const *const thread = arg;
+    for (size_t i = 0; i < ALLOCS_PER_THREAD; ++i) {
+        if (thread->lock)
+            mtx_lock(thread->lock);
+
+        memoryPool_alloc(thread->pool, NODE_DATA_SIZE, 1);
+
+        if (thread->lock)
+            mtx_unlock(thread->lock);
+    }
+
+    return 0;
+}
+
+static double run_alloc_threads(const int thread_count, const bool thread_safe) {
+    MemoryPool pool = memory_pool_new(thread_count * ALLOCS_PER_THREAD * NODE_FOOTPRINT, NULL);
+    mtx_t lock;
+    mtx_init(&lock, mtx_plain);
+    if (thread_safe)
+        memoryPool_enable_thread_safe_alloc(&pool, 0);
+
+    AllocThread threads[MAX_THREADS];
+    thrd_t ids[MAX_THREADS];
+    const double start = now_ns();
+    for (int t = 0; t < thread_count; ++t) {
+        threads[t] = (AllocThread){.pool = &pool, .lock = thread_safe ? NULL : &lock};
+        thrd_create(&ids[t], alloc_thread, &threads[t]);
+    }
+
+    for (int t = 0; t < thread_count; ++t)
+        thrd_join(ids[t], NULL);
+
+    const double seconds = (now_ns() - start) / 1e9;
+    mtx_destroy(&lock);
+    memoryPool_free(&pool);
+    return (double) (thread_count * ALLOCS_PER_THREAD) / seconds / 1e6;
+}
+
+/*
+ * Measures the allocation throughput of multiple threads that share a pool,
+ * once with a global mutex around every allocation and once with thread
+ * local allocation buffers.
+ */
+static void bench_alloc_threads() {
+    printf("%12s %18s %18s\n", "threads", "mutex Malloc/s", "tlab Malloc/s");
+    for (int thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2) {
+        const double locked = run_alloc_threads(thread_count, false);
+        const double tlab = run_alloc_threads(thread_count, true);
+        printf("%12d %18.2f %18.2f\n", thread_count, locked, tlab);
+    }
+}
+
+static const size_t MARK_NODES = 1000000;
+static const size_t MARK_CHAINS = 64;
+static const size_t MARK_FAN_OUT = 8;
+
+/*
+ * Builds a graph of MARK_NODES MemoryNodes whose order in memory is unrelated to
+ * the order of traversal. A wide graph is a tree with MARK_FAN_OUT children per
+ * MemoryNode, a deep graph consists of MARK_CHAINS long lists below the root.
+ */
+static MemoryPool build_mark_graph(const bool wide, const size_t workers) {
+    MemoryPool pool = memory_pool_new(MARK_NODES * (NODE_FOOTPRINT + MARK_FAN_OUT * sizeof(void *)), NULL);
+    if (workers)
+        memoryPool_enable_parallel_mark(&pool, workers);
+
+    MemoryNode **const nodes = malloc(MARK_NODES * sizeof(MemoryNode *));
+    const size_t neighbours = wide ? MARK_FAN_OUT : 1;
+    for (size_t i = 0; i < MARK_NODES; ++i)
+        nodes[i] = memoryPool_alloc(&pool, NODE_DATA_SIZE, i == 0 ? (wide ? MARK_FAN_OUT : MARK_CHAINS) : neighbours);
+
+    srand(7);
+    for (size_t i = MARK_NODES - 1; i > 1; --i) {
+        const size_t j = 1 + (size_t) rand() % i;
+        MemoryNode *const swap = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = swap;
+    }
+
+    for (size_t i = 1; i < MARK_NODES; ++i) {
+        if (wide)
+            memoryNode_setNeighbour(nodes[(i - 1) / MARK_FAN_OUT], nodes[i], (i - 1) % MARK_FAN_OUT);
+        else if (i <= MARK_CHAINS)
+            memoryNode_setNeighbour(nodes[0], nodes[i], i - 1);
+        else
+            memoryNode_setNeighbour(nodes[i - MARK_CHAINS], nodes[i], 0);
+    }
+
+    memoryPool_add_root_node(&pool, nodes[0]);
+    free(nodes);
+    return pool;
+}
+
+static double time_mark_graph(const bool wide, const size_t workers) {
+    MemoryPool pool = build_mark_graph(wide, workers);
+    double best = 0;
+    for (int i = 0; i < 3; ++i) {
+        const double start = now_ns();
+        memoryPool_gc_mark_and_sweep(&pool);
+        const double pause = now_ns() - start;
+        if (i == 0 || pause < best)
+            best = pause;
+    }
+
+    memoryPool_free(&pool);
+    return best / 1e6;
+}
+
+/*
+ * Measures the pause of a full collection in which every MemoryNode survives,
+ * so that the pause is dominated by marking, with the serial pointer reversal
+ * (workers 0) and with an increasing number of parallel mark workers.
+ */
+static void bench_parallel_mark() {
+    printf("%12s %18s %18s\n", "workers", "wide gc ms", "deep gc ms");
+    for (size_t workers = 0; workers <= MAX_THREADS; workers = workers ? workers * 2 : 1)
+        printf("%12zu %18.1f %18.1f\n", workers, time_mark_graph(true, workers), time_mark_graph(false, workers));
+}
+
+/*
+ * Compares the pause of a collection with an eager and with a lazy sweep, for
+ * a growing number of MemoryNodes of which one in ten is garbage, and the
+ * time it then takes to allocate as many MemoryNodes as were collected.
+ */
+static void bench_lazy_sweep() {
+    printf("%12s %18s %18s %18s %18s\n", "nodes", "eager gc us", "eager alloc us", "lazy gc us", "lazy alloc us");
+    for (size_t nodes = 10000; nodes <= 1000000; nodes *= 10) {
+        double times[2][2];
+        for (int lazy = 0; lazy < 2; ++lazy) {
+            MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, NULL);
+            if (lazy)
+                memoryPool_enable_lazy_sweep(&pool);
+
+            MemoryNode *previous = NULL;
+            for (size_t i = 0; i < nodes; ++i) {
+                MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+                if (i % 10 != 0) {
+                    memoryNode_setNeighbour(node, previous, 0);
+                    previous = node;
+                }
+            }
+
+            memoryPool_add_root_node(&pool, previous);
+            double start = now_ns();
+            memoryPool_gc_mark_and_sweep(&pool);
+            times[lazy][0] = (now_ns() - start) / 1000;
+
+            start = now_ns();
+            for (size_t i = 0; i < nodes / 10; ++i)
+                memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+            times[lazy][1] = (now_ns() - start) / 1000;
+
+            memoryPool_free(&pool);
+        }
+
+        printf("%12zu %18.1f %18.1f %18.1f %18.1f\n", nodes, times[0][0], times[0][1], times[1][0], times[1][1]);
+    }
+}
+
+/*
+ * Measures the pause of a full collection in which one in a hundred MemoryNodes
+ * survives, so that the pause is dominated by sweeping, with a serial sweep
+ * (workers 0) and with an increasing number of parallel sweep workers.
+ */
+static void bench_parallel_sweep() {
+    const size_t nodes = 2000000;
+    printf("%12s %18s\n", "workers", "gc ms");
+    for (size_t workers = 0; workers <= MAX_THREADS; workers = workers ? workers * 2 : 1) {
+        MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, NULL);
+        if (workers)
+            memoryPool_enable_parallel_sweep(&pool, workers);
+
+        MemoryNode *const root = memoryPool_alloc(&pool, 0, 1);
+        memoryPool_add_root_node(&pool, root);
+        double best = 0;
+        for (int i = 0; i < 4; ++i) {
+            // The first collection lays out the regions and is not measured.
+            MemoryNode *previous = root;
+            size_t allocated = 0;
+            MemoryNode *node;
+            while ((node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1))) {
+                if (allocated++ % 100 == 0) {
+                    memoryNode_setNeighbour(previous, node, 0);
+                    previous = node;
+                }
+            }
+
+            memoryNode_setNeighbour(previous, NULL, 0);
+            const double start = now_ns();
+            memoryPool_gc_mark_and_sweep(&pool);
+            const double pause = now_ns() - start;
+            if (i == 1 || (i > 1 && pause < best))
+                best = pause;
+        }
+
+        memoryPool_free(&pool);
+        printf("%12zu %18.1f\n", workers, best / 1e6);
+    }
+}
+
+/*
+ * Measures the pause of a full collection with marks in the MemoryNodes and
+ * with the mark bitmap, for a pool in which runs of garbage of increasing
+ * length lie between the surviving MemoryNodes.
+ */
+static void bench_mark_bitmap() {
+    const size_t nodes = 2000000;
+    printf("%12s %18s %18s\n", "garbage run", "header gc ms", "bitmap gc ms");
+    for (size_t run = 1; run <= 1000; run *= 10) {
+        double pauses[2];
+        for (int bitmap = 0; bitmap < 2; ++bitmap) {
+            MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, NULL);
+            if (bitmap)
+                memoryPool_enable_mark_bitmap(&pool);
+
+            MemoryNode *const root = memoryPool_alloc(&pool, 0, 1);
+            memoryPool_add_root_node(&pool, root);
+            double best = 0;
+            for (int i = 0; i < 3; ++i) {
+                MemoryNode *previous = root;
+                size_t allocated = 0;
+                MemoryNode *node;
+                while ((node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1))) {
+                    if (allocated++ % (run + 1) == 0) {
+                        memoryNode_setNeighbour(previous, node, 0);
+                        previous = node;
+                    }
+                }
+
+                memoryNode_setNeighbour(previous, NULL, 0);
+                const double start = now_ns();
+                memoryPool_gc_mark_and_sweep(&pool);
+                const double pause = now_ns() - start;
+                if (i == 0 || pause < best)
+                    best = pause;
+            }
+
+            memoryPool_free(&pool);
+            pauses[bitmap] = best / 1e6;
+        }
+
+        printf("%12zu %18.1f %18.1f\n", run, pauses[0], pauses[1]);
+    }
+}
+
+static const size_t TRACE_NODES = 1000000;
+static const size_t TRACE_RANDOM_DEGREE = 4;
+
+typedef enum {
+    TraceShape_List,
+    TraceShape_BinaryTree,
+    TraceShape_RandomGraph,
+} TraceShape;
+
+/*
+ * Builds a list, a binary tree or a graph in which every MemoryNode points to
+ * TRACE_RANDOM_DEGREE random others, with the MemoryNodes shuffled in memory.
+ */
+static MemoryPool build_trace_graph(const TraceShape shape, const MemoryPoolTracer tracer) {
+    const size_t neighbours = shape == TraceShape_List ? 1 : shape == TraceShape_BinaryTree ? 2 : TRACE_RANDOM_DEGREE;
+    MemoryPool pool = memory_pool_new_tracer(TRACE_NODES * (NODE_FOOTPRINT + neighbours * sizeof(void *)), NULL, MemoryPoolArena_Malloc, tracer);
+
+    MemoryNode **const nodes = malloc(TRACE_NODES * sizeof(MemoryNode *));
+    for (size_t i = 0; i < TRACE_NODES; ++i)
+        nodes[i] = memoryPool_alloc(&pool, NODE_DATA_SIZE, neighbours);
+
+    srand(11);
+    for (size_t i = TRACE_NODES - 1; i > 1; --i) {
+        const size_t j = 1 + (size_t) rand() % i;
+        MemoryNode *const swap = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = swap;
+    }
+
+    for (size_t i = 0; i < TRACE_NODES; ++i) {
+        if (shape == TraceShape_List && i + 1 < TRACE_NODES)
+            memoryNode_setNeighbour(nodes[i], nodes[i + 1], 0);
+        else if (shape == TraceShape_BinaryTree && i > 0)
+            memoryNode_setNeighbour(nodes[(i - 1) / 2], nodes[i], (i - 1) % 2);
+        else if (shape == TraceShape_RandomGraph)
+            for (size_t j = 0; j < TRACE_RANDOM_DEGREE; ++j)
+                memoryNode_setNeighbour(nodes[i], nodes[(size_t) rand() % TRACE_NODES], j);
+    }
+
+    memoryPool_add_root_node(&pool, nodes[0]);
+    free(nodes);
+    return pool;
+}
+
+static double time_trace_graph(const TraceShape shape, const MemoryPoolTracer tracer) {
+    MemoryPool pool = build_trace_graph(shape, tracer);
+    double best = 0;
+    for (int i = 0; i < 3; ++i) {
+        const double start = now_ns();
+        memoryPool_gc_mark_and_sweep(&pool);
+        const double pause = now_ns() - start;
+        if (i == 0 || pause < best)
+            best = pause;
+    }
+
+    memoryPool_free(&pool);
+    return best / 1e6;
+}
+
+/*
+ * Compares the pause of a full collection in which every MemoryNode survives
+ * with pointer reversal and with the prefetching mark stack, on a list, a
+ * binary tree and a random graph.
+ */
+static void bench_tracers() {
+    static const char *const shapes[] = {"list", "binary tree", "random graph"};
+    printf("%12s %18s %18s\n", "shape", "reversal gc ms", "mark stack gc ms");
+    for (TraceShape shape = TraceShape_List; shape <= TraceShape_RandomGraph; ++shape)
+        printf("%12s %18.1f %18.1f\n", shapes[shape], time_trace_graph(shape, MemoryPoolTracer_PointerReversal), time_trace_graph(shape, MemoryPoolTracer_MarkStack));
+}
+
+static const size_t FINALIZER_BUFFER_SIZE = 4096;
+
+static void free_buffer(void *const data) {
+    free(*(void **) data);
+}
+
+/*
+ * Measures the pause of a full collection in which nine in ten MemoryNodes die
+ * and each of them frees an external buffer in its FreeFn, with the FreeFn
+ * called during the sweep, deferred to memoryPool_run_finalizers (workers 0)
+ * and run by background threads. The last column is the time until all
+ * finalizers have run.
+ */
+static void bench_finalizers() {
+    const size_t nodes = 200000;
+    printf("%12s %18s %18s\n", "workers", "gc ms", "finalized ms");
+    for (long workers = -1; workers <= (long) MAX_THREADS; workers = workers <= 0 ? workers + 1 : workers * 2) {
+        MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, free_buffer);
+        if (workers >= 0)
+            memoryPool_enable_background_finalizers(&pool, (size_t) workers);
+
+        MemoryNode *previous = NULL;
+        for (size_t i = 0; i < nodes; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+            void *const buffer = malloc(FINALIZER_BUFFER_SIZE);
+            memset(buffer, 1, FINALIZER_BUFFER_SIZE);
+            *(void **) memoryNode_get_data(node) = buffer;
+            if (i % 10 == 0) {
+                memoryNode_setNeighbour(node, previous, 0);
+                previous = node;
+            }
+        }
+
+        memoryPool_add_root_node(&pool, previous);
+        const double start = now_ns();
+        memoryPool_gc_mark_and_sweep(&pool);
+        const double pause = now_ns() - start;
+        while (memoryPool_run_finalizers(&pool, workers == 0 ? SIZE_MAX : 0))
+            thrd_yield();
+
+        const double finalized = now_ns() - start;
+        memoryPool_free(&pool);
+        if (workers < 0)
+            printf("%12s %18.1f %18.1f\n", "sweep", pause / 1e6, finalized / 1e6);
+        else
+            printf("%12ld %18.1f %18.1f\n", workers, pause / 1e6, finalized / 1e6);
+    }
+}
+
+static bool fixed_trigger(MemoryPool const *const memoryPool, const size_t allocated, void *const context) {
+    (void) memoryPool;
+    return allocated >= *(size_t const *) context;
+}
+
+/*
+ * Measures the time of allocating short lived MemoryNodes next to a live list
+ * that takes a quarter of the pool, with collections triggered by the
+ * allocations themselves: only when the pool is full, after a fixed number of
+ * bytes and by the adaptive default.
+ */
+static void bench_auto_gc() {
+    const size_t nodes = 200000;
+    const size_t allocations = 5000000;
+    static const size_t thresholds[] = {0, 1 << 16, 1 << 20, SIZE_MAX};
+    printf("%12s %18s\n", "trigger", "alloc ms");
+    for (size_t t = 0; t < sizeof(thresholds) / sizeof(size_t); ++t) {
+        MemoryPool pool = memory_pool_new(4 * nodes * NODE_FOOTPRINT, NULL);
+        memoryPool_enable_auto_gc(&pool);
+        if (thresholds[t])
+            memoryPool_set_gc_trigger(&pool, fixed_trigger, (void *) &thresholds[t]);
+
+        MemoryNode *const root = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+        memoryPool_add_root_node(&pool, root);
+        for (size_t i = 0; i < nodes; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+            memoryNode_setNeighbour(node, memoryNode_getNeighbour(root, 0), 0);
+            memoryNode_setNeighbour(root, node, 0);
+        }
+
+        const double start = now_ns();
+        for (size_t i = 0; i < allocations; ++i)
+            memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+
+        const double elapsed = now_ns() - start;
+        memoryPool_free(&pool);
+        if (thresholds[t] == 0)
+            printf("%12s %18.1f\n", "adaptive", elapsed / 1e6);
+        else if (thresholds[t] == SIZE_MAX)
+            printf("%12s %18.1f\n", "when full", elapsed / 1e6);
+        else
+            printf("%12zu %18.1f\n", thresholds[t], elapsed / 1e6);
+    }
+}
+
+/*
+ * Measures the overhead of the statistics on allocations and collections of
+ * short lived MemoryNodes, and prints what they report.
+ */
+static void bench_stats() {
+    const size_t nodes = 200000;
+    const size_t rounds = 50;
+    printf("%12s %18s %18s\n", "stats", "total ms", "max pause ms");
+    for (int enabled = 0; enabled <= 1; ++enabled) {
+        MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, NULL);
+        if (enabled)
+            memoryPool_enable_stats(&pool);
+
+        const double start = now_ns();
+        for (size_t round = 0; round < rounds; ++round) {
+            MemoryNode *previous = NULL;
+            for (size_t i = 0; i < nodes; ++i) {
+                MemoryNode *const node = memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+                if (i % 10 == 0) {
+                    memoryNode_setNeighbour(node, previous, 0);
+                    previous = node;
+                }
+            }
+
+            memoryPool_add_root_node(&pool, previous);
+            memoryPool_gc_mark_and_sweep(&pool);
+            memoryPool_remove_root_node(&pool, previous);
+        }
+
+        const double elapsed = now_ns() - start;
+        MemoryPoolStats stats;
+        memoryPool_get_stats(&pool, &stats);
+        memoryPool_free(&pool);
+        printf("%12s %18.1f %18.1f\n", enabled ? "enabled" : "disabled", elapsed / 1e6, (double) stats.maxPause / 1e6);
+    }
+}
+
+/*
+ * Measures how long capturing a heap dump blocks the pool, compared with the
+ * time it takes to write it out, for random graphs of increasing size.
+ */
+static void bench_heap_dump() {
+    printf("%12s %18s %18s %18s\n", "nodes", "capture ms", "write ms", "dump bytes");
+    for (size_t nodes = 10000; nodes <= 1000000; nodes *= 10) {
+        MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT * 2, NULL);
+        MemoryNode **const all = malloc(nodes * sizeof(MemoryNode *));
+        for (size_t i = 0; i < nodes; ++i) {
+            all[i] = memoryPool_alloc(&pool, NODE_DATA_SIZE, 2);
+            for (size_t j = 0; j < 2 && i > 0; ++j)
+                memoryNode_setNeighbour(all[i], all[(size_t) rand() % i], j);
+        }
+
+        double start = now_ns();
+        MemoryPoolHeapDump *const dump = memoryPool_capture_heap_dump(&pool);
+        const double capture = now_ns() - start;
+
+        FILE *const file = tmpfile();
+        start = now_ns();
+        memoryPoolHeapDump_write(dump, file);
+        fflush(file);
+        const double write = now_ns() - start;
+
+        printf("%12zu %18.1f %18.1f %18zu\n", nodes, capture / 1e6, write / 1e6, memoryPoolHeapDump_size(dump));
+        fclose(file);
+        memoryPoolHeapDump_free(dump);
+        free(all);
+        memoryPool_free(&pool);
+    }
+}
+
+static bool count_samples(MemoryPoolAllocationSite const *const site, void *const context) {
+    *(size_t *) context += site->samples;
+    return true;
+}
+
+/*
+ * Measures the time of allocating short lived MemoryNodes, with collections in
+ * between, without sampling and with sampling at decreasing intervals. Half of
+ * the allocations are attributed by tag, the other half by backtrace.
+ */
+static void bench_sampling() {
+    const size_t nodes = 200000;
+    const size_t rounds = 50;
+    static const size_t intervals[] = {0, 512 * 1024, 64 * 1024, 4096};
+    printf("%12s %18s %18s\n", "interval", "total ms", "samples");
+    for (size_t t = 0; t < sizeof(intervals) / sizeof(size_t); ++t) {
+        MemoryPool pool = memory_pool_new(nodes * NODE_FOOTPRINT, NULL);
+        if (intervals[t])
+            memoryPool_enable_sampling(&pool, intervals[t]);
+
+        const double start = now_ns();
+        for (size_t round = 0; round < rounds; ++round) {
+            if (intervals[t])
+                memoryPool_set_allocation_site(&pool, round % 2 ? "odd rounds" : NULL);
+
+            for (size_t i = 0; i < nodes; ++i)
+                memoryPool_alloc(&pool, NODE_DATA_SIZE, 1);
+
+            memoryPool_gc_mark_and_sweep(&pool);
+        }
+
+        const double elapsed = now_ns() - start;
+        size_t samples = 0;
+        memoryPool_report_allocation_sites(&pool, count_samples, &samples);
+        memoryPool_free(&pool);
+        if (intervals[t])
+            printf("%12zu %18.1f %18zu\n", intervals[t], elapsed / 1e6, samples);
+        else
+            printf("%12s %18.1f %18zu\n", "off", elapsed / 1e6, samples);
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*run)();
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+        {"alloc_latency", bench_alloc_latency_vs_live_nodes},
+        {"minor_gc", bench_minor_vs_major_gc},
+        {"alloc_threads", bench_alloc_threads},
+        {"alloc_bulk", bench_alloc_bulk},
+        {"arenas", bench_arenas},
+        {"placement", bench_placement},
+        {"parallel_mark", bench_parallel_mark},
+        {"lazy_sweep", bench_lazy_sweep},
+        {"parallel_sweep", bench_parallel_sweep},
+        {"mark_bitmap", bench_mark_bitmap},
+        {"tracers", bench_tracers},
+        {"finalizers", bench_finalizers},
+        {"auto_gc", bench_auto_gc},
+        {"stats", bench_stats},
+        {"heap_dump", bench_heap_dump},
+        {"sampling", bench_sampling},
+};
+
+int main(const int argc, char const *const *const argv) {
+    const size_t count = sizeof(benchmarks) / sizeof(Benchmark);
+    for (size_t i = 0; i < count; ++i) {
+        bool selected = argc <= 1;
+        for (int j = 1; j < argc; ++j)
+            selected |= strcmp(argv[j], benchmarks[i].name) == 0;
+
+        if (!selected)
+            continue;
+
+        printf("== %s ==\n", benchmarks[i].name);
+        benchmarks[i].run();
+        printf("\n");
+    }
+}
@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "heap_dump.h"
+#include "memory.h"
+
+struct MemoryPoolHeapDump {
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+    bool failed;
+};
+
+static void memoryPoolHeapDump_append(MemoryPoolHeapDump *const dump, void const *const bytes, const size_t size) {
+    if (dump->failed)
+        return;
+
+    if (dump->size + size > dump->capacity) {
+        size_t capacity = dump->capacity ? 2 * dump->capacity : 4096;
+        while (capacity < dump->size + size)
+            capacity *= 2;
+
+        unsigned char *const grown = REALLOC(dump->bytes, dump->capacity, capacity);
+        if (!grown) {
+            dump->failed = true;
+            return;
+        }
+
+        dump->bytes = grown;
+        dump->capacity = capacity;
+    }
+
+    memcpy(dump->bytes + dump->size, bytes, size);
+    dump->size += size;
+}
+
+static void memoryPoolHeapDump_append_varint(MemoryPoolHeapDump *const dump, uint64_t value) {
+    unsigned char bytes[10];
+    size_t size = 0;
+    do {
+        bytes[size] = value & 0x7F;
+        value >>= 7;
+        if (value)
+            bytes[size] |= 0x80;
+        ++size;
+    } while (value);
+
+    memoryPoolHeapDump_append(dump, bytes, size);
+}
+
+// ---------- Node Index ----------
+/*
+ * Neighbours are stored as the index of the MemoryNode among the blocks in
+ * use. The first walk collects the MemoryNodes in use, and an open addressing
+ * table maps their addresses to their indices for the second walk.
+ */
+typedef struct {
+    MemoryNode const **memoryNodes;
+    size_t size;
+    size_t capacity;
+    size_t blockCount;
+    size_t *slots;
+    size_t mask;
+    bool failed;
+} MemoryPoolHeapDumpIndex;
+
+static bool memoryPoolHeapDumpIndex_visit(MemoryPoolHeapBlock const *const block, void *const context) {
+    MemoryPoolHeapDumpIndex *const index = context;
+    ++index->blockCount;
+    if (block->free)
+        return true;
+
+    if (index->size == index->capacity) {
+        const size_t capacity = index->capacity ? 2 * index->capacity : 1024;
+        MemoryNode const **const grown = REALLOC(index->memoryNodes, index->capacity * sizeof(MemoryNode *), capacity * sizeof(MemoryNode *));
+        if (!grown) {
+            index->failed = true;
+            return false;
+        }
+
+        index->memoryNodes = grown;
+        index->capacity = capacity;
+    }
+
+    index->memoryNodes[index->size++] = block->memoryNode;
+    return true;
+}
+
+static size_t memoryPoolHeapDumpIndex_slot(MemoryPoolHeapDumpIndex const *const index, MemoryNode const *const memoryNode) {
+    return (size_t) (((uintptr_t) memoryNode >> 3) * 0x9E3779B97F4A7C15ULL) & index->mask;
+}
+
+/*
+ * Builds the table with room for twice the MemoryNodes in use. A slot holds 1
+ * plus the index of its MemoryNode, 0 marks an empty slot.
+ */
+static bool memoryPoolHeapDumpIndex_build(MemoryPoolHeapDumpIndex *const index) {
+    size_t capacity = 16;
+    while (capacity < 2 * index->size)
+        capacity *= 2;
+
+    index->slots = CALLOC(capacity, sizeof(size_t));
+    if (!index->slots)
+        return false;
+
+    index->mask = capacity - 1;
+    for (size_t i = 0; i < index->size; ++i) {
+        size_t slot = memoryPoolHeapDumpIndex_slot(index, index->memoryNodes[i]);
+        while (index->slots[slot])
+            slot = (slot + 1) & index->mask;
+
+        index->slots[slot] = i + 1;
+    }
+
+    return true;
+}
+
+static uint64_t memoryPoolHeapDumpIndex_encode(MemoryPoolHeapDumpIndex const *const index, MemoryNode const *const memoryNode) {
+    if (!memoryNode)
+        return 0;
+
+    for (size_t slot = memoryPoolHeapDumpIndex_slot(index, memoryNode); index->slots[slot]; slot = (slot + 1) & index->mask)
+        if (index->memoryNodes[index->slots[slot] - 1] == memoryNode)
+            return index->slots[slot];
+
+    return 0;
+}
+
+// ---------- Encoding ----------
+typedef struct {
+    MemoryPoolHeapDump *dump;
+    MemoryPoolHeapDumpIndex const *index;
+    uintptr_t previous;
+} MemoryPoolHeapDumpEncoder;
+
+static bool memoryPoolHeapDumpEncoder_visit(MemoryPoolHeapBlock const *const block, void *const context) {
+    MemoryPoolHeapDumpEncoder *const encoder = context;
+    MemoryPoolHeapDump *const dump = encoder->dump;
+
+    const uintptr_t address = (uintptr_t) block->address;
+    const int64_t delta = (int64_t) (address - encoder->previous);
+    encoder->previous = address;
+    memoryPoolHeapDump_append_varint(dump, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+    memoryPoolHeapDump_append_varint(dump, block->size);
+
+    uint64_t flags = (uint64_t) block->space << MemoryPoolHeapDump_SpaceShift;
+    if (block->free)
+        flags |= MemoryPoolHeapDumpFlag_Free;
+    if (block->marked)
+        flags |= MemoryPoolHeapDumpFlag_Marked;
+
+    memoryPoolHeapDump_append_varint(dump, flags);
+    if (block->free)
+        return !dump->failed;
+
+    memoryPoolHeapDump_append_varint(dump, block->neighbourCount);
+    for (uint16_t i = 0; i < block->neighbourCount; ++i)
+        memoryPoolHeapDump_append_varint(dump, memoryPoolHeapDumpIndex_encode(encoder->index, memoryNode_getNeighbour(block->memoryNode, i)));
+
+    return !dump->failed;
+}
+
+MemoryPoolHeapDump *memoryPool_capture_heap_dump(MemoryPool const *const memoryPool) {
+    MemoryPoolHeapDump *const dump = CALLOC(1, sizeof(MemoryPoolHeapDump));
+    if (!dump)
+        return NULL;
+
+    MemoryPoolHeapDumpIndex index;
+    memset(&index, 0, sizeof(MemoryPoolHeapDumpIndex));
+    memoryPool_walk_heap(memoryPool, memoryPoolHeapDumpIndex_visit, &index);
+    if (index.failed || !memoryPoolHeapDumpIndex_build(&index)) {
+        FREE(index.memoryNodes);
+        FREE(dump);
+        return NULL;
+    }
+
+    const uint32_t version = MemoryPoolHeapDump_Version;
+    const uint64_t header[] = {memoryPool->size, index.blockCount, index.size};
+    memoryPoolHeapDump_append(dump, "MPHD", 4);
+    memoryPoolHeapDump_append(dump, &version, sizeof(version));
+    memoryPoolHeapDump_append(dump, header, sizeof(header));
+
+    MemoryPoolHeapDumpEncoder encoder = {dump, &index, 0};
+    memoryPool_walk_heap(memoryPool, memoryPoolHeapDumpEncoder_visit, &encoder);
+    FREE(index.memoryNodes);
+    FREE(index.slots);
+    if (dump->failed) {
+        memoryPoolHeapDump_free(dump);
+        return NULL;
+    }
+
+    return dump;
+}
+
+bool memoryPoolHeapDump_write(MemoryPoolHeapDump const *const dump, FILE *const file) {
+    return fwrite(dump->bytes, 1, dump->size, file) == dump->size;
+}
+
+size_t memoryPoolHeapDump_size(MemoryPoolHeapDump const *const dump) {
+    return dump->size;
+}
+
+void memoryPoolHeapDump_free(MemoryPoolHeapDump *const dump) {
+    FREE(dump->bytes);
+    FREE(dump);
+}
@@ -0,0 +1,60 @@
+#ifndef DFS_HEAP_DUMP_H
+#define DFS_HEAP_DUMP_H
+
+#include <stdio.h>
+
+#include "memory_pool.h"
+
+/*
+ * A heap dump holds the layout of all blocks of a MemoryPool and the graph of
+ * its neighbour pointers, encoded in the file format below.
+ *
+ * The file starts with a header of native byte order:
+ *
+ *     char     magic[4]    "MPHD"
+ *     uint32_t version     MemoryPoolHeapDump_Version
+ *     uint64_t poolSize    the size of the pool in bytes
+ *     uint64_t blockCount  the number of blocks that follow
+ *     uint64_t nodeCount   the number of blocks that are in use
+ *
+ * The blocks follow in the order of memoryPool_walk_heap. All numbers of a
+ * block are unsigned LEB128 varints:
+ *
+ *     address delta  the zigzag encoded distance to the previous block
+ *     size           the size of the block in bytes, including its header
+ *     flags          MemoryPoolHeapDumpFlag bits and the MemoryPoolHeapSpace
+ *                    shifted by MemoryPoolHeapDump_SpaceShift
+ *
+ * A block that is in use continues with its neighbour count and one varint
+ * per neighbour: 0 for NULL, else 1 plus the index of the neighbour among the
+ * blocks in use, counted in the order of the file.
+ */
+enum { MemoryPoolHeapDump_Version = 1 };
+
+enum { MemoryPoolHeapDump_SpaceShift = 2 };
+
+typedef enum {
+    MemoryPoolHeapDumpFlag_Free = 1,
+    MemoryPoolHeapDumpFlag_Marked = 2,
+} MemoryPoolHeapDumpFlag;
+
+typedef struct MemoryPoolHeapDump MemoryPoolHeapDump;
+
+/*
+ * Encodes the heap into memory in two walks over the pool, without any I/O,
+ * so the pool is only blocked for as long as that takes. Returns NULL if the
+ * memory for the dump could not be allocated.
+ */
+MemoryPoolHeapDump *memoryPool_capture_heap_dump(MemoryPool const *memoryPool);
+
+/*
+ * Writes a captured dump to `file`. The dump no longer refers to the pool, so
+ * this may run while the pool is used again, e.g. on another thread. Returns
+ * false if not everything could be written.
+ */
+bool memoryPoolHeapDump_write(MemoryPoolHeapDump const *dump, FILE *file);
+
+size_t memoryPoolHeapDump_size(MemoryPoolHeapDump const *dump);
+
+void memoryPoolHeapDump_free(MemoryPoolHeapDump *dump);
+#endif
@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap_dump.h"
+
+/*
+ * Summarises a heap dump written by memoryPoolHeapDump_write:
+ *
+ *     heap_dump <file> [top]
+ *
+ * prints the totals, a histogram of the block sizes in powers of two, a map of
+ * how much of each part of the pool is in use and the `top` MemoryNodes (10 by
+ * default) with the most neighbours. The fragmentation is the share of the
+ * free bytes outside of the largest range of adjacent free blocks.
+ */
+typedef struct {
+    uint64_t address;
+    uint64_t size;
+    uint64_t flags;
+} Block;
+
+typedef struct {
+    uint64_t index;
+    uint64_t block;
+    uint64_t outDegree;
+    uint64_t inDegree;
+} Node;
+
+typedef struct {
+    unsigned char const *bytes;
+    size_t size;
+    size_t offset;
+    bool failed;
+} Reader;
+
+enum { SIZE_CLASSES = 64, MAP_WIDTH = 64, MAP_LINES = 4 };
+
+static const char MAP_SHADES[] = ".-:=+*%#";
+
+static uint64_t read_varint(Reader *const reader) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (reader->offset >= reader->size) {
+            reader->failed = true;
+            return 0;
+        }
+
+        const unsigned char byte = reader->bytes[reader->offset++];
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    reader->failed = true;
+    return 0;
+}
+
+static unsigned char *read_file(char const *const path, size_t *const size) {
+    FILE *const file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    unsigned char *bytes = NULL;
+    size_t capacity = 0;
+    *size = 0;
+    for (;;) {
+        if (*size == capacity) {
+            capacity = capacity ? 2 * capacity : 1 << 16;
+            unsigned char *const grown = realloc(bytes, capacity);
+            if (!grown) {
+                free(bytes);
+                fclose(file);
+                return NULL;
+            }
+
+            bytes = grown;
+        }
+
+        const size_t read = fread(bytes + *size, 1, capacity - *size, file);
+        *size += read;
+        if (read == 0)
+            break;
+    }
+
+    fclose(file);
+    return bytes;
+}
+
+static unsigned size_class(uint64_t size) {
+    unsigned class = 0;
+    while (size > 1) {
+        size >>= 1;
+        ++class;
+    }
+
+    return class;
+}
+
+static void print_totals(Block const *const blocks, const uint64_t blockCount, const uint64_t poolSize, const uint64_t edges) {
+    uint64_t used = 0;
+    uint64_t usedBytes = 0;
+    uint64_t freeBlocks = 0;
+    uint64_t freeBytes = 0;
+    uint64_t largest = 0;
+    uint64_t run = 0;
+    uint64_t largestRun = 0;
+    for (uint64_t i = 0; i < blockCount; ++i) {
+        if (blocks[i].flags & MemoryPoolHeapDumpFlag_Free) {
+            ++freeBlocks;
+            freeBytes += blocks[i].size;
+            if (blocks[i].size > largest)
+                largest = blocks[i].size;
+
+            // A MemoryPoolNode holds at most 64 KiB, so larger free ranges
+            // consist of adjacent free blocks.
+            const bool adjacent = i > 0 && blocks[i - 1].address + blocks[i - 1].size == blocks[i].address;
+            run = (adjacent && run ? run : 0) + blocks[i].size;
+            if (run > largestRun)
+                largestRun = run;
+        } else {
+            ++used;
+            usedBytes += blocks[i].size;
+            run = 0;
+        }
+    }
+
+    printf("pool size         %llu bytes\n", (unsigned long long) poolSize);
+    printf("in use            %llu nodes, %llu bytes\n", (unsigned long long) used, (unsigned long long) usedBytes);
+    printf("free              %llu blocks, %llu bytes\n", (unsigned long long) freeBlocks, (unsigned long long) freeBytes);
+    printf("largest free      %llu bytes\n", (unsigned long long) largest);
+    printf("largest free run  %llu bytes\n", (unsigned long long) largestRun);
+    printf("fragmentation     %.1f %%\n", freeBytes ? 100.0 * (double) (freeBytes - largestRun) / (double) freeBytes : 0.0);
+    printf("neighbour edges   %llu\n", (unsigned long long) edges);
+}
+
+static void print_size_classes(Block const *const blocks, const uint64_t blockCount) {
+    uint64_t used[SIZE_CLASSES] = {0};
+    uint64_t usedBytes[SIZE_CLASSES] = {0};
+    uint64_t freeBlocks[SIZE_CLASSES] = {0};
+    uint64_t freeBytes[SIZE_CLASSES] = {0};
+    for (uint64_t i = 0; i < blockCount; ++i) {
+        const unsigned class = size_class(blocks[i].size);
+        if (blocks[i].flags & MemoryPoolHeapDumpFlag_Free) {
+            ++freeBlocks[class];
+            freeBytes[class] += blocks[i].size;
+        } else {
+            ++used[class];
+            usedBytes[class] += blocks[i].size;
+        }
+    }
+
+    printf("\n%14s %12s %14s %12s %14s\n", "size class", "in use", "bytes", "free", "bytes");
+    for (unsigned class = 0; class < SIZE_CLASSES; ++class) {
+        if (!used[class] && !freeBlocks[class])
+            continue;
+
+        char range[32];
+        snprintf(range, sizeof(range), "%llu-%llu", 1ULL << class, (2ULL << class) - 1);
+        printf("%14s %12llu %14llu %12llu %14llu\n", range, (unsigned long long) used[class], (unsigned long long) usedBytes[class],
+               (unsigned long long) freeBlocks[class], (unsigned long long) freeBytes[class]);
+    }
+}
+
+/*
+ * Lays the blocks of the pool itself out one after the other and shades every
+ * cell of the map by the fraction of its bytes that is in use, from '.' for
+ * none over '-' for a few to '#' for all.
+ */
+static void print_fragmentation_map(Block const *const blocks, const uint64_t blockCount) {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < blockCount; ++i)
+        if (blocks[i].flags >> MemoryPoolHeapDump_SpaceShift == MemoryPoolHeapSpace_Pool)
+            total += blocks[i].size;
+
+    enum { CELLS = MAP_WIDTH * MAP_LINES };
+    double used[CELLS] = {0};
+    uint64_t offset = 0;
+    for (uint64_t i = 0; total && i < blockCount; ++i) {
+        if (blocks[i].flags >> MemoryPoolHeapDump_SpaceShift != MemoryPoolHeapSpace_Pool)
+            continue;
+
+        const uint64_t end = offset + blocks[i].size;
+        if (!(blocks[i].flags & MemoryPoolHeapDumpFlag_Free)) {
+            for (uint64_t cell = offset * CELLS / total; cell < CELLS && cell * total < end * CELLS; ++cell) {
+                const double cellBegin = (double) cell * (double) total / CELLS;
+                const double cellEnd = (double) (cell + 1) * (double) total / CELLS;
+                const double overlap = (end < cellEnd ? (double) end : cellEnd) - (offset > cellBegin ? (double) offset : cellBegin);
+                if (overlap > 0)
+                    used[cell] += overlap / (cellEnd - cellBegin);
+            }
+        }
+
+        offset = end;
+    }
+
+    printf("\nfragmentation map, %llu bytes per cell\n", (unsigned long long) (total / CELLS));
+    for (unsigned line = 0; line < MAP_LINES; ++line) {
+        char row[MAP_WIDTH + 1];
+        for (unsigned column = 0; column < MAP_WIDTH; ++column) {
+            const double fraction = used[line * MAP_WIDTH + column];
+            size_t shade = fraction >= 1 ? sizeof(MAP_SHADES) - 2 : (size_t) (fraction * (sizeof(MAP_SHADES) - 1));
+            if (shade == 0 && fraction > 0)
+                shade = 1;
+
+            row[column] = MAP_SHADES[shade];
+        }
+
+        row[MAP_WIDTH] = '\0';
+        printf("  %s\n", row);
+    }
+}
+
+static int node_compare_out_degree(void const *const first, void const *const second) {
+    Node const *const a = first;
+    Node const *const b = second;
+    if (a->outDegree != b->outDegree)
+        return a->outDegree > b->outDegree ? -1 : 1;
+
+    return a->index < b->index ? -1 : a->index > b->index;
+}
+
+static void print_top_nodes(Block const *const blocks, Node *const nodes, const uint64_t nodeCount, const uint64_t top) {
+    qsort(nodes, nodeCount, sizeof(Node), node_compare_out_degree);
+    printf("\n%8s %18s %10s %10s %10s\n", "node", "address", "size", "out", "in");
+    for (uint64_t i = 0; i < nodeCount && i < top; ++i) {
+        Block const *const block = &blocks[nodes[i].block];
+        printf("%8llu %#18llx %10llu %10llu %10llu\n", (unsigned long long) nodes[i].index, (unsigned long long) block->address,
+               (unsigned long long) block->size, (unsigned long long) nodes[i].outDegree, (unsigned long long) nodes[i].inDegree);
+    }
+}
+
+int main(const int argc, char const *const *const argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <heap dump> [top]\n", argv[0]);
+        return 2;
+    }
+
+    const uint64_t top = argc > 2 ? strtoull(argv[2], NULL, 10) : 10;
+    size_t size;
+    unsigned char *const bytes = read_file(argv[1], &size);
+    if (!bytes) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    uint32_t version;
+    uint64_t header[3];
+    const size_t headerSize = 4 + sizeof(version) + sizeof(header);
+    if (size < headerSize || memcmp(bytes, "MPHD", 4) != 0) {
+        fprintf(stderr, "%s is not a heap dump\n", argv[1]);
+        free(bytes);
+        return 1;
+    }
+
+    memcpy(&version, bytes + 4, sizeof(version));
+    memcpy(header, bytes + 4 + sizeof(version), sizeof(header));
+    const uint64_t blockCount = header[1];
+    const uint64_t nodeCount = header[2];
+    Block *const blocks = version == MemoryPoolHeapDump_Version ? calloc(blockCount ? blockCount : 1, sizeof(Block)) : NULL;
+    Node *const nodes = blocks ? calloc(nodeCount ? nodeCount : 1, sizeof(Node)) : NULL;
+    if (!nodes) {
+        fprintf(stderr, "%s: unsupported version %u or out of memory\n", argv[1], version);
+        free(blocks);
+        free(bytes);
+        return 1;
+    }
+
+    Reader reader = {bytes, size, headerSize, false};
+    uint64_t address = 0;
+    uint64_t node = 0;
+    uint64_t edges = 0;
+    for (uint64_t i = 0; i < blockCount && !reader.failed; ++i) {
+        const uint64_t delta = read_varint(&reader);
+        address += (delta >> 1) ^ (0 - (delta & 1));
+        blocks[i].address = address;
+        blocks[i].size = read_varint(&reader);
+        blocks[i].flags = read_varint(&reader);
+        if (blocks[i].flags & MemoryPoolHeapDumpFlag_Free)
+            continue;
+
+        if (node == nodeCount) {
+            reader.failed = true;
+            break;
+        }
+
+        nodes[node].index = node;
+        nodes[node].block = i;
+        const uint64_t neighbours = read_varint(&reader);
+        for (uint64_t j = 0; j < neighbours; ++j) {
+            const uint64_t neighbour = read_varint(&reader);
+            if (neighbour == 0)
+                continue;
+
+            ++nodes[node].outDegree;
+            ++edges;
+            if (neighbour <= nodeCount)
+                ++nodes[neighbour - 1].inDegree;
+        }
+
+        ++node;
+    }
+
+    if (reader.failed || node != nodeCount) {
+        fprintf(stderr, "%s is truncated or corrupt\n", argv[1]);
+        free(nodes);
+        free(blocks);
+        free(bytes);
+        return 1;
+    }
+
+    print_totals(blocks, blockCount, header[0], edges);
+    print_size_classes(blocks, blockCount);
+    print_fragmentation_map(blocks, blockCount);
+    print_top_nodes(blocks, nodes, nodeCount, top);
+
+    free(nodes);
+    free(blocks);
+    free(bytes);
+    return 0;
+}
@@ -2,6 +2,9 @@
 
 #include<stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 void *(*custom_malloc)(size_t) = malloc;
 void (*custom_free)(void *) = free;
@@ -46,3 +49,55 @@ void* REALLOC(void * const ptr, const size_t old_size, const size_t new_size) {
 
     return p;
 }
+
+void *MAP(const size_t size) {
+    void *const p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void UNMAP(void *const p, const size_t size) {
+    if (p) {
+        munmap(p, size);
+    }
+}
+
+size_t SYSTEM_PAGE_SIZE(void) {
+    static size_t page_size = 0;
+    if (!page_size) {
+        page_size = (size_t) sysconf(_SC_PAGESIZE);
+    }
+    return page_size;
+}
+
+void *MAP_HUGE(const size_t size, const bool hugetlb) {
+    if (hugetlb) {
+        void *const p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+
+    // Transparent huge pages are only used for huge page aligned memory, so
+    // map more than needed and trim the excess on both ends.
+    char *const reserved = MAP(size + HUGE_PAGE_SIZE);
+    if (!reserved) {
+        return NULL;
+    }
+
+    char *const p = (char *) (((uintptr_t) reserved + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+    if (p != reserved) {
+        UNMAP(reserved, p - reserved);
+    }
+    UNMAP(p + size, reserved + HUGE_PAGE_SIZE - p);
+    madvise(p, size, MADV_HUGEPAGE);
+    return p;
+}
+
+void RELEASE_PAGES(void *const p, const size_t size) {
+    const uintptr_t page_mask = SYSTEM_PAGE_SIZE() - 1;
+    const uintptr_t start = ((uintptr_t) p + page_mask) & ~page_mask;
+    const uintptr_t end = ((uintptr_t) p + size) & ~page_mask;
+    if (start < end) {
+        madvise((void *) start, end - start, MADV_DONTNEED);
+    }
+}
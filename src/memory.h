@@ -1,6 +1,7 @@
 #ifndef DFS_MEMORY_H
 #define DFS_MEMORY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 extern void *(*custom_malloc)(size_t);
@@ -10,4 +11,28 @@ void* MALLOC(size_t size);
 void* CALLOC(size_t member_count, size_t member_size);
 void* REALLOC(void * ptr, size_t old_size, size_t new_size);
 void FREE(void* p);
+
+/*
+ * Maps `size` bytes of zeroed, page aligned memory directly from the operating
+ * system. Returns NULL on failure.
+ */
+void* MAP(size_t size);
+void UNMAP(void* p, size_t size);
+
+enum { HUGE_PAGE_SIZE = 2 * 1024 * 1024 };
+size_t SYSTEM_PAGE_SIZE(void);
+
+/*
+ * Like MAP, but the memory is aligned to and backed by huge pages. `size` must
+ * be a multiple of HUGE_PAGE_SIZE. With `hugetlb` the huge pages are taken from
+ * the pool of reserved huge pages. If that pool is exhausted, or without
+ * `hugetlb`, transparent huge pages are requested instead.
+ */
+void* MAP_HUGE(size_t size, bool hugetlb);
+
+/*
+ * Returns all whole pages in the given range to the operating system. The
+ * range stays mapped and reads as zero once it is touched again.
+ */
+void RELEASE_PAGES(void* p, size_t size);
 #endif
@@ -1,5 +1,13 @@
 #include <assert.h>
+#include <execinfo.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "memory.h"
 #include "memory_pool.h"
@@ -8,6 +16,10 @@
 static const size_t PTR_SIZE = sizeof(void*);
 static_assert(sizeof(void*) == 8, "We assume 64-bit pointers.");
 
+static size_t align_8(const size_t size) {
+    return (size + 7) & ~7;
+}
+
 // ---------- Memory Pool Node ----------
 static MemoryPoolNode *memoryPoolNode_new(void *const location, MemoryPoolNode *const next, const uint16_t size, const bool is_free) {
     assert(extract_top_bits(location) == 0);
@@ -24,17 +36,14 @@ static MemoryPoolNode *memoryPoolNode_get_next(MemoryPoolNode const *const memor
 }
 
 static void memoryPoolNode_set_next(MemoryPoolNode *const memoryPoolNode, MemoryPoolNode const *const next) {
-    MemoryPoolNode *const node = memoryPoolNode->next;
-    const uint16_t size = extract_top_bits(node);
-    const bool is_free = extract_lowest_bit(node);
-    memoryPoolNode->next = set_lowest_bit(set_top_bits(next, size), is_free);
+    memoryPoolNode->next = replace_ptr_bits(memoryPoolNode->next, next);
 }
 
 static uint16_t memoryPoolNode_get_free_space(MemoryPoolNode const *const memoryPoolNode) {
     return extract_top_bits(memoryPoolNode->next);
 }
 
-static uint16_t memoryPoolNode_set_free_space(MemoryPoolNode * const memoryPoolNode, const uint16_t freeSpace) {
+static void memoryPoolNode_set_free_space(MemoryPoolNode * const memoryPoolNode, const uint16_t freeSpace) {
     memoryPoolNode->next = set_top_bits(memoryPoolNode->next, freeSpace);
 }
 
@@ -42,14 +51,63 @@ static bool memoryPoolNode_is_free(MemoryPoolNode const *const memoryPoolNode) {
     return extract_lowest_bit(memoryPoolNode->next);
 }
 
+/*
+ * The pages of a released MemoryPoolNode have been returned to the operating
+ * system. Handing out the MemoryPoolNode, or merging other MemoryPoolNodes
+ * into it, makes it an ordinary MemoryPoolNode again.
+ */
+static bool memoryPoolNode_is_released(MemoryPoolNode const *const memoryPoolNode) {
+    return extract_low_bit(memoryPoolNode->next, 1);
+}
+
+static void memoryPoolNode_set_is_released(MemoryPoolNode *const memoryPoolNode, const bool is_released) {
+    memoryPoolNode->next = set_low_bit(memoryPoolNode->next, 1, is_released);
+}
+
+/*
+ * A region start begins one of the regions of a parallel sweep, see
+ * memoryPool_enable_parallel_sweep.
+ */
+static bool memoryPoolNode_is_region_start(MemoryPoolNode const *const memoryPoolNode) {
+    return extract_low_bit(memoryPoolNode->next, 2);
+}
+
+static void memoryPoolNode_set_is_region_start(MemoryPoolNode *const memoryPoolNode, const bool is_region_start) {
+    memoryPoolNode->next = set_low_bit(memoryPoolNode->next, 2, is_region_start);
+}
+
 static void memoryPoolNode_set_is_free(MemoryPoolNode *const memoryPoolNode, const bool is_free) {
     memoryPoolNode->next = set_lowest_bit(memoryPoolNode->next, is_free);
+    if (!is_free)
+        memoryPoolNode_set_is_released(memoryPoolNode, false);
 }
 
 static void *memoryPoolNode_get_data(MemoryPoolNode const *const memoryPoolNode) {
     return (char *) memoryPoolNode + sizeof(MemoryPoolNode);
 }
 
+/*
+ * The MemoryPoolNode that physically follows, which only is part of the pool if
+ * it is before the end of the segment.
+ */
+static MemoryPoolNode *memoryPoolNode_physical_next(MemoryPoolNode const *const memoryPoolNode) {
+    return (MemoryPoolNode *) ((char *) memoryPoolNode_get_data(memoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode));
+}
+
+/*
+ * A free MemoryPoolNode stores the links of the doubly linked free list of its
+ * size class in its otherwise unused data.
+ */
+typedef struct {
+    MemoryPoolNode *previous;
+    MemoryPoolNode *next;
+} MemoryPoolFreeLinks;
+
+static MemoryPoolFreeLinks *memoryPoolNode_get_free_links(MemoryPoolNode const *const memoryPoolNode) {
+    assert(memoryPoolNode_is_free(memoryPoolNode));
+    return memoryPoolNode_get_data(memoryPoolNode);
+}
+
 
 // ---------- Memory Node ----------
 static MemoryNode *memoryNode_new(void *location, const uint16_t neighbours) {
@@ -61,14 +119,48 @@ static MemoryNode *memoryNode_new(void *location, const uint16_t neighbours) {
     return node;
 }
 
+/*
+ * Reads a neighbour pointer together with its packed bits. The pointers are
+ * read atomically, because a concurrent marker may set the mark bit of the
+ * first one while the mutator reads it.
+ */
+static MemoryNode *memoryNode_load_neighbour_ptr(MemoryNode *const *const ptr) {
+    return (MemoryNode *) atomic_load_explicit((atomic_uintptr_t const *) ptr, memory_order_relaxed);
+}
+
 static bool memoryNode_is_marked(MemoryNode const *const memoryNode) {
-    return extract_lowest_bit(memoryNode->neighbours);
+    return extract_lowest_bit(memoryNode_load_neighbour_ptr(&memoryNode->neighbours));
 }
 
 static void memoryNode_set_is_marked(MemoryNode *const memoryNode, const bool isMarked) {
     memoryNode->neighbours = set_lowest_bit(memoryNode->neighbours, isMarked);
 }
 
+/*
+ * The second lowest bit of the first neighbour pointer marks old MemoryNodes
+ * that are part of the remembered set of a generational MemoryPool.
+ */
+static bool memoryNode_is_remembered(MemoryNode const *const memoryNode) {
+    return extract_low_bit(memoryNode_load_neighbour_ptr(&memoryNode->neighbours), 1);
+}
+
+static void memoryNode_set_is_remembered(MemoryNode *const memoryNode, const bool isRemembered) {
+    memoryNode->neighbours = set_low_bit(memoryNode->neighbours, 1, isRemembered);
+}
+
+/*
+ * The third lowest bit of the first neighbour pointer marks dead MemoryNodes
+ * that wait for a background finalizer, see
+ * memoryPool_enable_background_finalizers.
+ */
+static bool memoryNode_is_finalizing(MemoryNode const *const memoryNode) {
+    return extract_low_bit(memoryNode->neighbours, 2);
+}
+
+static void memoryNode_set_is_finalizing(MemoryNode *const memoryNode, const bool isFinalizing) {
+    memoryNode->neighbours = set_low_bit(memoryNode->neighbours, 2, isFinalizing);
+}
+
 static MemoryNode **memoryNode_ptr_to_neighbour_ptr(MemoryNode const *const memoryNode, const uint16_t index) {
     assert(index < (memoryNode_get_neighbour_count(memoryNode) == 0 ? 1 : memoryNode_get_neighbour_count(memoryNode)));
     return (MemoryNode **) ((uintptr_t) memoryNode + PTR_SIZE * index);
@@ -100,21 +192,68 @@ static void memoryNode_reset_counter(MemoryNode *const memoryNode) {
 }
 
 uint16_t memoryNode_get_neighbour_count(MemoryNode const *const memoryNode) {
-    MemoryNode *const neighbours = memoryNode->neighbours;
+    MemoryNode *const neighbours = memoryNode_load_neighbour_ptr(&memoryNode->neighbours);
     return extract_top_bits(neighbours);
 }
 
 MemoryNode *memoryNode_getNeighbour(MemoryNode const *const memoryNode, const uint16_t index) {
-    MemoryNode *const ptr = *memoryNode_ptr_to_neighbour_ptr(memoryNode, index);
+    MemoryNode *const ptr = memoryNode_load_neighbour_ptr(memoryNode_ptr_to_neighbour_ptr(memoryNode, index));
     return extract_ptr_bits(ptr);
 }
 
-void memoryNode_setNeighbour(MemoryNode *const memoryNode, MemoryNode const *const neighbour, const uint16_t index) {
+/*
+ * Sets a neighbour without going through the write barrier. Used by the
+ * garbage collector itself.
+ */
+static void memoryNode_set_neighbour_ptr(MemoryNode *const memoryNode, MemoryNode const *const neighbour, const uint16_t index) {
     MemoryNode **const ptr = memoryNode_ptr_to_neighbour_ptr(memoryNode, index);
-    const uint16_t top = extract_top_bits(*ptr);
-    const bool low_bit = extract_lowest_bit(*ptr);
-    void *const decorated = set_lowest_bit(set_top_bits(neighbour, top), low_bit);
-    *ptr = decorated;
+    *ptr = replace_ptr_bits(*ptr, neighbour);
+}
+
+/*
+ * The write barriers find the pools they care about through global lists, as a
+ * MemoryNode does not know its MemoryPool. A list is only changed and walked
+ * while holding barrier_lists_lock, so a pool on one thread can be registered
+ * or unregistered while a mutator of another pool walks the list. An empty
+ * list is recognized without taking the lock. The generational write barrier
+ * checks the nurseries through a list of its own that needs no lock, and only
+ * takes it to add to a remembered set.
+ */
+static once_flag barrier_lists_once = ONCE_FLAG_INIT;
+static mtx_t barrier_lists_lock;
+static bool barrier_lists_lock_ready;
+
+static void barrier_lists_lock_init(void) {
+    barrier_lists_lock_ready = mtx_init(&barrier_lists_lock, mtx_plain) == thrd_success;
+}
+
+/*
+ * Takes the lock of the barrier lists to change one of them. Returns false if
+ * the lock could not be created.
+ */
+static bool memoryPool_lock_barrier_lists(void) {
+    call_once(&barrier_lists_once, barrier_lists_lock_init);
+    if (!barrier_lists_lock_ready)
+        return false;
+
+    mtx_lock(&barrier_lists_lock);
+    return true;
+}
+
+static void memoryPool_write_barrier(MemoryNode *memoryNode, MemoryNode const *neighbour);
+static void memoryPool_snapshot_barrier(MemoryNode *memoryNode, MemoryNode const *neighbour, uint16_t index);
+static _Atomic(MemoryPoolMarking *) marking_pools;
+
+void memoryNode_setNeighbour(MemoryNode *const memoryNode, MemoryNode const *const neighbour, const uint16_t index) {
+    memoryPool_write_barrier(memoryNode, neighbour);
+    if (atomic_load_explicit(&marking_pools, memory_order_acquire))
+        memoryPool_snapshot_barrier(memoryNode, neighbour, index);
+    else
+        memoryNode_set_neighbour_ptr(memoryNode, neighbour, index);
+}
+
+static MemoryPoolNode *memoryNode_get_memoryPoolNode(MemoryNode const *const memoryNode) {
+    return (MemoryPoolNode *) ((char *) memoryNode - sizeof(MemoryPoolNode));
 }
 
 void *memoryNode_get_data(MemoryNode const *const memoryNode) {
@@ -124,289 +263,4484 @@ void *memoryNode_get_data(MemoryNode const *const memoryNode) {
     return (MemoryNode **) ((uintptr_t) memoryNode + PTR_SIZE * size);
 }
 
-// ---------- Memory Pool ----------
-static const size_t DEFAULT_ROOT_SET_SIZE = 8;
+// ---------- Free Lists ----------
+static const size_t MemoryPoolNode_MinMemoryPerNode = sizeof(MemoryPoolFreeLinks);
 static const size_t MemoryPoolNode_MaxMemoryPerNode = ((1ULL << 16) - 1) & ~7;
+static const size_t MemoryPool_ExactSizeClassLimit = 256;
 
-MemoryPool memory_pool_new(const size_t pool_size, const FreeFn freeFn) {
-    assert(pool_size >= sizeof(MemoryPoolNode));
+/*
+ * Free MemoryPoolNodes are kept in segregated free lists, one per size class.
+ * Sizes below MemoryPool_ExactSizeClassLimit get one class per multiple of 8,
+ * so every node in such a class fits every request of that class. Larger sizes
+ * are split into four classes per power of two. The bits of freeListMask mark
+ * the classes whose lists are not empty, so finding the next larger non-empty
+ * class is a single bit scan.
+ */
+static unsigned memoryPool_size_class(const size_t size) {
+    assert(size >= MemoryPoolNode_MinMemoryPerNode && size <= MemoryPoolNode_MaxMemoryPerNode);
 
+    if (size < MemoryPool_ExactSizeClassLimit)
+        return size / PTR_SIZE - MemoryPoolNode_MinMemoryPerNode / PTR_SIZE;
 
-    void *const space = MALLOC(pool_size);
-    void *const rootSet = MALLOC(DEFAULT_ROOT_SET_SIZE * PTR_SIZE);
+    const unsigned exact_classes = (MemoryPool_ExactSizeClassLimit - MemoryPoolNode_MinMemoryPerNode) / PTR_SIZE;
+    const unsigned msb = 63 - __builtin_clzll(size);
+    const unsigned sub_class = (size >> (msb - 2)) & 3;
+    const unsigned size_class = exact_classes + (msb - 8) * 4 + sub_class;
+    assert(size_class < MemoryPool_SizeClassCount);
+    return size_class;
+}
 
-    if (!space || !rootSet) {
-        FREE(space);
-        FREE(rootSet);
-        MemoryPool pool;
-        memset(&pool, 0, sizeof(MemoryPool));
-        return pool;
-    }
+/*
+ * In best fit mode the free MemoryPoolNodes of at least
+ * MemoryPool_ExactSizeClassLimit bytes are not kept in free lists, but in a
+ * treap that is ordered by size and address. The free list links of such a
+ * MemoryPoolNode hold its left and right child instead. The priority of a
+ * MemoryPoolNode is a hash of its address, so the treap stays balanced without
+ * storing anything else.
+ */
+static bool memoryPoolNode_is_less(MemoryPoolNode const *const first, MemoryPoolNode const *const second) {
+    const uint16_t first_size = memoryPoolNode_get_free_space(first);
+    const uint16_t second_size = memoryPoolNode_get_free_space(second);
+    return first_size < second_size || (first_size == second_size && first < second);
+}
 
-    assert(((uintptr_t) space & 7) == 0);
+static uint64_t memoryPoolNode_priority(MemoryPoolNode const *const memoryPoolNode) {
+    return ((uintptr_t) memoryPoolNode >> 3) * 0x9E3779B97F4A7C15ULL;
+}
 
-#define min(a, b) (a) <= (b) ? (a) : (b)
+static MemoryPoolNode **memoryPoolTree_left(MemoryPoolNode const *const memoryPoolNode) {
+    return &memoryPoolNode_get_free_links(memoryPoolNode)->previous;
+}
 
-    size_t remaining_size = pool_size - sizeof(MemoryPoolNode);
-    const size_t head_size = min(remaining_size, MemoryPoolNode_MaxMemoryPerNode);
-    MemoryPoolNode *const head = memoryPoolNode_new(space, NULL, head_size, true);
-    remaining_size -= head_size;
-    MemoryPoolNode *current = head;
-    char *remaining_space = (char *) space + sizeof(MemoryPoolNode) + head_size;
+static MemoryPoolNode **memoryPoolTree_right(MemoryPoolNode const *const memoryPoolNode) {
+    return &memoryPoolNode_get_free_links(memoryPoolNode)->next;
+}
 
-    while (remaining_size > sizeof(MemoryPoolNode)) {
-        remaining_size -= sizeof(MemoryPoolNode);
-        const size_t node_size = min(remaining_size, MemoryPoolNode_MaxMemoryPerNode);
-        remaining_size -= node_size;
+/*
+ * Splits the treap into the MemoryPoolNodes that are less than `key` and the
+ * remaining ones.
+ */
+static void memoryPoolTree_split(MemoryPoolNode *const root, MemoryPoolNode const *const key, MemoryPoolNode **const less, MemoryPoolNode **const greater) {
+    if (!root) {
+        *less = *greater = NULL;
+    } else if (memoryPoolNode_is_less(root, key)) {
+        *less = root;
+        memoryPoolTree_split(*memoryPoolTree_right(root), key, memoryPoolTree_right(root), greater);
+    } else {
+        *greater = root;
+        memoryPoolTree_split(*memoryPoolTree_left(root), key, less, memoryPoolTree_left(root));
+    }
+}
 
-        MemoryPoolNode *const next = memoryPoolNode_new(remaining_space, NULL, node_size, true);
-        memoryPoolNode_set_next(current, next);
-        current = next;
+static MemoryPoolNode *memoryPoolTree_merge(MemoryPoolNode *const less, MemoryPoolNode *const greater) {
+    if (!less || !greater)
+        return less ? less : greater;
 
-        remaining_space = remaining_space + sizeof(MemoryPoolNode) + node_size;
+    if (memoryPoolNode_priority(less) > memoryPoolNode_priority(greater)) {
+        *memoryPoolTree_right(less) = memoryPoolTree_merge(*memoryPoolTree_right(less), greater);
+        return less;
     }
 
-#undef min
+    *memoryPoolTree_left(greater) = memoryPoolTree_merge(less, *memoryPoolTree_left(greater));
+    return greater;
+}
+
+static MemoryPoolNode *memoryPoolTree_insert(MemoryPoolNode *const root, MemoryPoolNode *const memoryPoolNode) {
+    if (!root || memoryPoolNode_priority(memoryPoolNode) > memoryPoolNode_priority(root)) {
+        memoryPoolTree_split(root, memoryPoolNode, memoryPoolTree_left(memoryPoolNode), memoryPoolTree_right(memoryPoolNode));
+        return memoryPoolNode;
+    }
 
-    return (MemoryPool){.head = space, .rootSet = rootSet, .rootSetSize = 0, .rootSetCapacity = DEFAULT_ROOT_SET_SIZE, .freeFn = freeFn};
+    MemoryPoolNode **const child = memoryPoolNode_is_less(memoryPoolNode, root) ? memoryPoolTree_left(root) : memoryPoolTree_right(root);
+    *child = memoryPoolTree_insert(*child, memoryPoolNode);
+    return root;
 }
 
-void memoryPool_free(MemoryPool *const memoryPool) {
-    if (memoryPool->freeFn) {
-        MemoryPoolNode *node = memoryPool->head;
-        while (node) {
-            if (!memoryPoolNode_is_free(node)) {
-                memoryPool->freeFn(memoryNode_get_data(memoryPoolNode_get_data(node)));
-            }
+static MemoryPoolNode *memoryPoolTree_remove(MemoryPoolNode *const root, MemoryPoolNode const *const memoryPoolNode) {
+    assert(root);
+    if (root == memoryPoolNode)
+        return memoryPoolTree_merge(*memoryPoolTree_left(root), *memoryPoolTree_right(root));
 
-            node = memoryPoolNode_get_next(node);
+    MemoryPoolNode **const child = memoryPoolNode_is_less(memoryPoolNode, root) ? memoryPoolTree_left(root) : memoryPoolTree_right(root);
+    *child = memoryPoolTree_remove(*child, memoryPoolNode);
+    return root;
+}
+
+/*
+ * Finds the smallest MemoryPoolNode with at least `size` bytes of free space.
+ */
+static MemoryPoolNode *memoryPoolTree_find(MemoryPoolNode *root, const size_t size) {
+    MemoryPoolNode *best = NULL;
+    while (root) {
+        if (memoryPoolNode_get_free_space(root) >= size) {
+            best = root;
+            root = *memoryPoolTree_left(root);
+        } else {
+            root = *memoryPoolTree_right(root);
         }
     }
 
-    FREE(memoryPool->rootSet);
-    FREE(memoryPool->head);
-    memset(memoryPool, 0, sizeof(MemoryPool));
+    return best;
 }
 
-static size_t align_8(const size_t size) {
-    return (size + 7) & ~7;
+static bool memoryPool_is_in_tree(MemoryPool const *const memoryPool, MemoryPoolNode const *const memoryPoolNode) {
+    return memoryPool->placement == MemoryPoolPlacement_BestFit && memoryPoolNode_get_free_space(memoryPoolNode) >= MemoryPool_ExactSizeClassLimit;
 }
 
-MemoryNode *memoryPool_alloc(MemoryPool *const memoryPool, size_t data_size, const size_t neighbours) {
-    data_size = align_8(data_size);
-    const size_t memoryNode_size = sizeof(MemoryNode *) * (neighbours == 0 ? 1 : neighbours);
-    const size_t total_size = memoryNode_size + data_size;
-    assert(total_size < 1ULL << 16);
+static void memoryPool_insert_free_node(MemoryPool *const memoryPool, MemoryPoolNode *const memoryPoolNode) {
+    memoryPool->freeBytes += sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    if (memoryPool_is_in_tree(memoryPool, memoryPoolNode)) {
+        memoryPool->freeTree = memoryPoolTree_insert(memoryPool->freeTree, memoryPoolNode);
+        return;
+    }
+
+    const unsigned size_class = memoryPool_size_class(memoryPoolNode_get_free_space(memoryPoolNode));
+    MemoryPoolNode *const first = memoryPool->freeLists[size_class];
+
+    MemoryPoolFreeLinks *const links = memoryPoolNode_get_free_links(memoryPoolNode);
+    links->previous = NULL;
+    links->next = first;
+    if (first)
+        memoryPoolNode_get_free_links(first)->previous = memoryPoolNode;
+
+    memoryPool->freeLists[size_class] = memoryPoolNode;
+    memoryPool->freeListMask |= 1ULL << size_class;
+}
+
+static void memoryPool_remove_free_node(MemoryPool *const memoryPool, MemoryPoolNode *const memoryPoolNode) {
+    memoryPool->freeBytes -= sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    if (memoryPool_is_in_tree(memoryPool, memoryPoolNode)) {
+        memoryPool->freeTree = memoryPoolTree_remove(memoryPool->freeTree, memoryPoolNode);
+        return;
+    }
+
+    const unsigned size_class = memoryPool_size_class(memoryPoolNode_get_free_space(memoryPoolNode));
+    MemoryPoolFreeLinks const *const links = memoryPoolNode_get_free_links(memoryPoolNode);
+
+    if (links->previous)
+        memoryPoolNode_get_free_links(links->previous)->next = links->next;
+    else
+        memoryPool->freeLists[size_class] = links->next;
+
+    if (links->next)
+        memoryPoolNode_get_free_links(links->next)->previous = links->previous;
+
+    if (!memoryPool->freeLists[size_class])
+        memoryPool->freeListMask &= ~(1ULL << size_class);
+}
+
+/*
+ * Also resets the roving cursor of the next fit policy, since the
+ * MemoryPoolNode it points to may be merged away while the lists are rebuilt.
+ */
+static void memoryPool_clear_free_lists(MemoryPool *const memoryPool) {
+    memset(memoryPool->freeLists, 0, sizeof(memoryPool->freeLists));
+    memoryPool->freeListMask = 0;
+    memoryPool->freeTree = NULL;
+    memoryPool->rover = NULL;
+    memoryPool->freeBytes = 0;
+}
+
+/*
+ * Walks the list of all MemoryPoolNodes from the roving cursor to the end and
+ * then from the start to the cursor.
+ */
+static MemoryPoolNode *memoryPool_find_next_fit(MemoryPool const *const memoryPool, const size_t size) {
+    MemoryPoolNode *const start = memoryPool->rover ? memoryPool->rover : memoryPool->head;
+    for (MemoryPoolNode *node = start; node; node = memoryPoolNode_get_next(node))
+        if (memoryPoolNode_is_free(node) && memoryPoolNode_get_free_space(node) >= size)
+            return node;
+
+    for (MemoryPoolNode *node = memoryPool->head; node != start; node = memoryPoolNode_get_next(node))
+        if (memoryPoolNode_is_free(node) && memoryPoolNode_get_free_space(node) >= size)
+            return node;
+
+    return NULL;
+}
+
+/*
+ * The exact size classes hold MemoryPoolNodes of a single size each, so the
+ * first non-empty one that fits holds the best fit. Only if there is none,
+ * the treap is searched.
+ */
+static MemoryPoolNode *memoryPool_find_best_fit(MemoryPool const *const memoryPool, const size_t size) {
+    if (size < MemoryPool_ExactSizeClassLimit) {
+        const uint64_t fitting = memoryPool->freeListMask & (~0ULL << memoryPool_size_class(size));
+        if (fitting)
+            return memoryPool->freeLists[__builtin_ctzll(fitting)];
+    }
+
+    return memoryPoolTree_find(memoryPool->freeTree, size);
+}
+
+/*
+ * Finds a free MemoryPoolNode with at least `size` bytes of free space.
+ * Usually this only looks at the head of a single list. Only if the class of
+ * `size` holds nodes of different sizes and no larger class has a free node,
+ * the list of the class itself is searched.
+ */
+static MemoryPoolNode *memoryPool_find_free_node(MemoryPool const *const memoryPool, const size_t size) {
+    if (memoryPool->placement == MemoryPoolPlacement_NextFit)
+        return memoryPool_find_next_fit(memoryPool, size);
+
+    if (memoryPool->placement == MemoryPoolPlacement_BestFit)
+        return memoryPool_find_best_fit(memoryPool, size);
+
+    const unsigned size_class = memoryPool_size_class(size);
+    MemoryPoolNode *candidate = memoryPool->freeLists[size_class];
+    if (candidate && memoryPoolNode_get_free_space(candidate) >= size)
+        return candidate;
+
+    const uint64_t larger = memoryPool->freeListMask & (~0ULL << (size_class + 1));
+    if (larger)
+        return memoryPool->freeLists[__builtin_ctzll(larger)];
+
+    while (candidate && memoryPoolNode_get_free_space(candidate) < size)
+        candidate = memoryPoolNode_get_free_links(candidate)->next;
+
+    return candidate;
+}
 
-    MemoryPoolNode *head = memoryPool->head;
-    while (head && (!memoryPoolNode_is_free(head) || memoryPoolNode_get_free_space(head) < total_size)) {
-        head = memoryPoolNode_get_next(head);
+/*
+ * Bump allocates `total_size` bytes from the front of `*rest`, a free
+ * MemoryPoolNode that is not part of any free list. Afterwards `*rest` points
+ * to the remaining free MemoryPoolNode, or to NULL if nothing remains.
+ */
+static MemoryPoolNode *memoryPool_carve(MemoryPoolNode **const rest, const size_t total_size) {
+    MemoryPoolNode *const head = *rest;
+    if (!head || memoryPoolNode_get_free_space(head) < total_size)
+        return NULL;
+
+    memoryPoolNode_set_is_free(head, false);
+    const size_t remaining_space = memoryPoolNode_get_free_space(head) - total_size;
+    if (remaining_space < sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode) {
+        *rest = NULL;
+        return head;
+    }
+
+    void *const location = (char *) memoryPoolNode_get_data(head) + total_size;
+    *rest = memoryPoolNode_new(location, memoryPoolNode_get_next(head), remaining_space - sizeof(MemoryPoolNode), true);
+    memoryPoolNode_set_next(head, *rest);
+    memoryPoolNode_set_free_space(head, total_size);
+    return head;
+}
+
+static MemoryPoolNode *memoryPool_find_largest_free_node(MemoryPool const *const memoryPool) {
+    if (memoryPool->freeTree) {
+        MemoryPoolNode *largest = memoryPool->freeTree;
+        while (*memoryPoolTree_right(largest))
+            largest = *memoryPoolTree_right(largest);
+
+        return largest;
     }
 
+    if (!memoryPool->freeListMask)
+        return NULL;
+
+    return memoryPool->freeLists[63 - __builtin_clzll(memoryPool->freeListMask)];
+}
+
+static bool memoryPool_grow(MemoryPool *memoryPool, size_t total_size);
+static bool memoryPool_sweep_lazily(MemoryPool *memoryPool, size_t size);
+static bool memoryPool_reclaim_finalized(MemoryPool *memoryPool, bool insert);
+
+/*
+ * Takes a MemoryPoolNode with at least `total_size` bytes of space from the
+ * free lists and splits off the part that is not needed.
+ */
+static MemoryPoolNode *memoryPool_alloc_node(MemoryPool *const memoryPool, const size_t total_size) {
+    MemoryPoolNode *head = memoryPool_find_free_node(memoryPool, total_size);
+    while (!head && (memoryPool_sweep_lazily(memoryPool, total_size) || memoryPool_reclaim_finalized(memoryPool, true)))
+        head = memoryPool_find_free_node(memoryPool, total_size);
+
+    if (!head && memoryPool_grow(memoryPool, total_size))
+        head = memoryPool_find_free_node(memoryPool, total_size);
+
     if (!head)
         return NULL;
 
+    memoryPool_remove_free_node(memoryPool, head);
     memoryPoolNode_set_is_free(head, false);
     void *const space = memoryPoolNode_get_data(head);
-    MemoryNode *const memoryNode = memoryNode_new(space, neighbours);
 
     const size_t total_space = memoryPoolNode_get_free_space(head);
     const size_t remaining_space = total_space - total_size;
-    if (remaining_space > sizeof(MemoryPoolNode)) {
+    if (remaining_space >= sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode) {
         void *const location = (char *) space + total_size;
         MemoryPoolNode *next = memoryPoolNode_new(location, memoryPoolNode_get_next(head), remaining_space - sizeof(MemoryPoolNode), true);
         memoryPoolNode_set_next(head, next);
         memoryPoolNode_set_free_space(head, total_size);
+        memoryPool_insert_free_node(memoryPool, next);
     }
 
+    if (memoryPool->placement == MemoryPoolPlacement_NextFit)
+        memoryPool->rover = memoryPoolNode_get_next(head);
 
-    return memoryNode;
+    return head;
 }
 
-bool memoryPool_add_root_node(MemoryPool *const memoryPool, MemoryNode *const memoryNode) {
-    if (memoryPool->rootSetSize == memoryPool->rootSetCapacity) {
-        MemoryNode ** const newSet = REALLOC(memoryPool->rootSet, memoryPool->rootSetCapacity * PTR_SIZE , memoryPool->rootSetCapacity * PTR_SIZE * 2);
-        if (!newSet)
-            return false;
-
-        memoryPool->rootSet = newSet;
-        memoryPool->rootSetCapacity *= 2;
-    }
+/*
+ * Coalescing walks the pool in address order and keeps track of a run, the
+ * free MemoryPoolNode the following free MemoryPoolNodes are merged into.
+ * A run is only added to the free lists once it cannot grow any further.
+ * The free lists must have been cleared before a walk starts, since neither
+ * the run nor the merged MemoryPoolNodes are removed from them.
+ */
+static bool memoryPoolNode_can_merge(MemoryPoolNode const *const first, MemoryPoolNode const *const second) {
+    const size_t first_size = memoryPoolNode_get_free_space(first);
+    const size_t merged_size = first_size + sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(second);
+    return (char *) memoryPoolNode_get_data(first) + first_size == (char *) second && merged_size <= MemoryPoolNode_MaxMemoryPerNode && !memoryPoolNode_is_region_start(second);
+}
 
-    memoryPool->rootSet[memoryPool->rootSetSize++] = memoryNode;
-    return true;
+static void memoryPoolNode_merge(MemoryPoolNode *const run, MemoryPoolNode const *const memoryPoolNode) {
+    const size_t merged_size = memoryPoolNode_get_free_space(run) + sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    memoryPoolNode_set_next(run, memoryPoolNode_get_next(memoryPoolNode));
+    memoryPoolNode_set_free_space(run, merged_size);
+    memoryPoolNode_set_is_released(run, false);
 }
 
+static const size_t MemoryPool_ReleaseThreshold = 1ULL << 14;
+
 /*
- * An implementation of an iterative Depth-first Search algorithm that marks all
- * nodes it encounters and applies to each node for_each function the first time
- * the node is found.
- *
- * The search uses a technique called pointer reversal to reduce the amount of
- * bookkeeping memory needed. The algorithm is complicated by the fact that the
- * counter of MemoryNode is only available for Memory nodes that have two more
- * neighbours. The BACK_OFF and FORWARD macros contain the code that is needed
- * to work around this limitation: If a node has no neighbours no counter is
- * needed because the search cannot continue past this node. If a node only has
- * one neighbour, then we only need to know whether we already continued the
- * search past that node. We can memorize this by always moving past nodes that
- * have only one neighbour till we find a node which has more than one
- * neighbour. If no such node exists, meaning if the search gets stuck in a node
- * that has no neighbours at all, than we need to back off past the node with
- * only one neighbour, from which the forward search originally started.
+ * Returns the whole pages of a large free MemoryPoolNode of a mapped pool to
+ * the operating system. The free list links at the start of the data stay.
  */
-void memoryPool_dfs(MemoryNode *current, void (*const for_each)(MemoryNode const *)) {
+static void memoryPool_release_pages(MemoryPool const *const memoryPool, MemoryPoolNode *const memoryPoolNode) {
+    const size_t size = memoryPoolNode_get_free_space(memoryPoolNode);
+    if (memoryPool->arena != MemoryPoolArena_Mapped || size < MemoryPool_ReleaseThreshold || memoryPoolNode_is_released(memoryPoolNode))
+        return;
 
-#define BACK_OFF                                                                \
-    /*                                                                          \
-     * Move backwards till we find a node with more than one neighbour.         \
-     *  Invariant: We have visited all neighbours of the current node.          \
-     */                                                                         \
-    while (true) {                                                              \
-        next = current;                                                         \
-        current = previous;                                                     \
-        if (!current)                                                           \
-            break;                                                              \
-                                                                                \
-        const uint16_t preNeighbours = memoryNode_get_neighbour_count(current); \
-        if(preNeighbours >= 2) {                                                \
-            const uint16_t counter = memoryNode_get_counter(current);           \
-            previous = memoryNode_getNeighbour(current, counter);               \
-            memoryNode_setNeighbour(current, next, counter);                    \
-            memoryNode_inc_counter(current);                                    \
-            break;                                                              \
-        }                                                                       \
-                                                                                \
-        previous = memoryNode_getNeighbour(current, 0);                         \
-        memoryNode_setNeighbour(current, next, 0);                              \
-    }
+    char *const data = memoryPoolNode_get_data(memoryPoolNode);
+    RELEASE_PAGES(data + sizeof(MemoryPoolFreeLinks), size - sizeof(MemoryPoolFreeLinks));
+    memoryPoolNode_set_is_released(memoryPoolNode, true);
+}
 
-#define FORWARD                                                                 \
-    /*                                                                          \
-     * Move forward till there is a node with more than one neighbour.          \
-     * If no such node is found, back off.                                      \
-     * Invariant: The current node refers to a node that has only one neighbour.\
-     */                                                                         \
-    while (true) {                                                              \
-        next = memoryNode_getNeighbour(current, 0);                             \
-        if (!next || memoryNode_is_marked(next)) {                              \
-            BACK_OFF                                                            \
-            break;                                                              \
-        }                                                                       \
-                                                                                \
-        memoryNode_set_is_marked(next, true);                                   \
-        if (for_each)                                                           \
-            for_each(next);                                                     \
-                                                                                \
-        const int neighbours = memoryNode_get_neighbour_count(next);            \
-        if (neighbours == 0) {                                                  \
-            BACK_OFF                                                            \
-            break;                                                              \
-        }                                                                       \
-                                                                                \
-        memoryNode_setNeighbour(current, previous, 0);                          \
-        previous = current;                                                     \
-        current = next;                                                         \
-        if (neighbours >= 2) {                                                  \
-            break;                                                              \
-        }                                                                       \
+static MemoryPoolNode *memoryPool_end_free_run(MemoryPool *const memoryPool, MemoryPoolNode *const run) {
+    if (run) {
+        memoryPool_release_pages(memoryPool, run);
+        memoryPool_insert_free_node(memoryPool, run);
     }
 
-    if (!current || memoryNode_is_marked(current))
-        return;
+    return NULL;
+}
 
-    if (for_each)
-        for_each(current);
+static MemoryPoolNode *memoryPool_coalesce_free_node(MemoryPool *const memoryPool, MemoryPoolNode *const run, MemoryPoolNode *const memoryPoolNode) {
+    assert(memoryPoolNode_is_free(memoryPoolNode));
 
-    memoryNode_set_is_marked(current, true);
+    if (!run || !memoryPoolNode_can_merge(run, memoryPoolNode)) {
+        memoryPool_end_free_run(memoryPool, run);
+        return memoryPoolNode;
+    }
 
-    const uint16_t neighbours = memoryNode_get_neighbour_count(current);
-    if (neighbours == 0)
-        return;
+    memoryPoolNode_merge(run, memoryPoolNode);
+    return run;
+}
+
+static bool memoryPool_is_marked(MemoryPool const *memoryPool, MemoryNode const *memoryNode);
+static bool memoryPool_defer_finalization(MemoryPool const *memoryPool, MemoryNode *memoryNode);
+
+/*
+ * Finalizes the MemoryNode of a MemoryPoolNode if it is not marked and clears
+ * the mark otherwise. Marks in the mark bitmap are cleared in bulk after the
+ * sweep instead. Returns whether the MemoryPoolNode is free afterwards, which
+ * it is not while its MemoryNode waits for a background finalizer.
+ */
+static bool memoryPool_sweep_is_free(MemoryPool const *const memoryPool, MemoryPoolNode *const memoryPoolNode) {
+    if (memoryPoolNode_is_free(memoryPoolNode))
+        return true;
+
+    MemoryNode *const memoryNode = memoryPoolNode_get_data(memoryPoolNode);
+    if (memoryPool_is_marked(memoryPool, memoryNode)) {
+        if (memoryNode_is_marked(memoryNode))
+            memoryNode_set_is_marked(memoryNode, false);
+
+        return false;
+    }
+
+    if (memoryNode_is_finalizing(memoryNode) || memoryPool_defer_finalization(memoryPool, memoryNode))
+        return false;
+
+    if (memoryPool->freeFn)
+        memoryPool->freeFn(memoryNode_get_data(memoryNode));
+
+    memoryPoolNode_set_is_free(memoryPoolNode, true);
+    return true;
+}
+
+// ---------- Memory Node Stack ----------
+static const size_t DEFAULT_STACK_SIZE = 64;
+
+/*
+ * A growable stack of MemoryNodes used as bookkeeping memory by the garbage
+ * collector.
+ */
+typedef struct {
+    MemoryNode **items;
+    size_t size;
+    size_t capacity;
+} MemoryNodeStack;
+
+static bool memoryNodeStack_push(MemoryNodeStack *const stack, MemoryNode *const memoryNode) {
+    if (stack->size == stack->capacity) {
+        const size_t capacity = stack->capacity ? stack->capacity * 2 : DEFAULT_STACK_SIZE;
+        MemoryNode **const items = REALLOC(stack->items, stack->capacity * PTR_SIZE, capacity * PTR_SIZE);
+        if (!items)
+            return false;
+
+        stack->items = items;
+        stack->capacity = capacity;
+    }
+
+    stack->items[stack->size++] = memoryNode;
+    return true;
+}
+
+static MemoryNode *memoryNodeStack_pop(MemoryNodeStack *const stack) {
+    return stack->size ? stack->items[--stack->size] : NULL;
+}
+
+static void memoryNodeStack_free(MemoryNodeStack *const stack) {
+    FREE(stack->items);
+    memset(stack, 0, sizeof(MemoryNodeStack));
+}
+
+// ---------- Nursery ----------
+/*
+ * In generational mode new MemoryNodes are bump allocated in the nursery, a
+ * separate region that only holds young MemoryNodes. The MemoryPoolNodes in
+ * the nursery are laid out back to back, their next pointers are unused.
+ *
+ * Old MemoryNodes that refer to young MemoryNodes are kept in the remembered
+ * set, so a minor collection finds all young MemoryNodes without looking at
+ * the old ones. The remembered set is maintained by the write barrier in
+ * memoryNode_setNeighbour. As a MemoryNode does not know its MemoryPool, the
+ * barrier finds the nursery of a neighbour through the list of all
+ * generational pools.
+ */
+struct MemoryPoolGenerations {
+    char *nursery;
+    char *nurseryTop;
+    char *nurseryEnd;
+    MemoryNodeStack remembered;
+    bool rememberedOverflow;
+    MemoryNodeStack grey;
+    struct MemoryPoolNurseryRange *range;
+    MemoryPoolGenerations *next;
+};
+
+static _Atomic(MemoryPoolGenerations *) generational_pools = NULL;
+
+/*
+ * The nursery ranges of all generational pools, walked by the write barrier
+ * without a lock. Entries are only added at the front and are never freed:
+ * the entry of a pool that is freed is cleared and taken over by the next
+ * generational pool. An entry only changes while nobody can hold a MemoryNode
+ * of its nursery, so a walk at worst sees a stale range of a nursery that
+ * does not matter to it.
+ */
+typedef struct MemoryPoolNurseryRange {
+    atomic_uintptr_t begin;
+    atomic_uintptr_t end;
+    struct MemoryPoolNurseryRange *next;
+} MemoryPoolNurseryRange;
+
+static _Atomic(MemoryPoolNurseryRange *) nursery_ranges = NULL;
+
+static bool memoryPoolNurseryRange_contains(MemoryPoolNurseryRange const *const range, void const *const memory) {
+    return (uintptr_t) memory >= atomic_load_explicit(&range->begin, memory_order_relaxed) && (uintptr_t) memory < atomic_load_explicit(&range->end, memory_order_relaxed);
+}
+
+/*
+ * Takes over a cleared entry or adds a new one. Requires barrier_lists_lock.
+ */
+static MemoryPoolNurseryRange *memoryPoolNurseryRange_claim(char const *const begin, char const *const end) {
+    MemoryPoolNurseryRange *range = atomic_load_explicit(&nursery_ranges, memory_order_relaxed);
+    while (range && atomic_load_explicit(&range->end, memory_order_relaxed))
+        range = range->next;
+
+    if (!range) {
+        range = CALLOC(1, sizeof(MemoryPoolNurseryRange));
+        if (!range)
+            return NULL;
+
+        range->next = atomic_load_explicit(&nursery_ranges, memory_order_relaxed);
+        atomic_store_explicit(&nursery_ranges, range, memory_order_release);
+    }
+
+    atomic_store_explicit(&range->begin, (uintptr_t) begin, memory_order_relaxed);
+    atomic_store_explicit(&range->end, (uintptr_t) end, memory_order_relaxed);
+    return range;
+}
+
+static void memoryPoolNurseryRange_clear(MemoryPoolNurseryRange *const range) {
+    atomic_store_explicit(&range->begin, 0, memory_order_relaxed);
+    atomic_store_explicit(&range->end, 0, memory_order_relaxed);
+}
+
+static bool memoryPoolGenerations_is_young(MemoryPoolGenerations const *const generations, void const *const memory) {
+    return (char const *) memory >= generations->nursery && (char const *) memory < generations->nurseryEnd;
+}
+
+static MemoryPoolNode *memoryPoolGenerations_first(MemoryPoolGenerations const *const generations) {
+    return generations->nursery < generations->nurseryTop ? (MemoryPoolNode *) generations->nursery : NULL;
+}
+
+static MemoryPoolNode *memoryPoolGenerations_next(MemoryPoolGenerations const *const generations, MemoryPoolNode const *const memoryPoolNode) {
+    char *const next = (char *) memoryPoolNode_get_data(memoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    return next < generations->nurseryTop ? (MemoryPoolNode *) next : NULL;
+}
+
+static MemoryNode *memoryPoolGenerations_alloc(MemoryPoolGenerations *const generations, const size_t total_size, const size_t neighbours) {
+    if ((size_t) (generations->nurseryEnd - generations->nurseryTop) < sizeof(MemoryPoolNode) + total_size)
+        return NULL;
+
+    MemoryPoolNode *const memoryPoolNode = memoryPoolNode_new(generations->nurseryTop, NULL, total_size, false);
+    generations->nurseryTop += sizeof(MemoryPoolNode) + total_size;
+    return memoryNode_new(memoryPoolNode_get_data(memoryPoolNode), neighbours);
+}
+
+static bool memoryPoolGenerations_alloc_bulk(MemoryPoolGenerations *const generations, const size_t count, const size_t total_size, const size_t neighbours, MemoryNode **const out) {
+    if ((size_t) (generations->nurseryEnd - generations->nurseryTop) < count * (sizeof(MemoryPoolNode) + total_size))
+        return false;
+
+    for (size_t i = 0; i < count; ++i)
+        out[i] = memoryPoolGenerations_alloc(generations, total_size, neighbours);
+
+    return true;
+}
+
+static void memoryPoolGenerations_remember(MemoryPoolGenerations *const generations, MemoryNode *const memoryNode) {
+    memoryNode_set_is_remembered(memoryNode, true);
+    if (!memoryNodeStack_push(&generations->remembered, memoryNode))
+        generations->rememberedOverflow = true;
+}
+
+static void memoryPool_write_barrier(MemoryNode *const memoryNode, MemoryNode const *const neighbour) {
+    if (!neighbour || memoryNode_is_remembered(memoryNode))
+        return;
+
+    MemoryPoolNurseryRange const *range = atomic_load_explicit(&nursery_ranges, memory_order_acquire);
+    while (range && !memoryPoolNurseryRange_contains(range, neighbour))
+        range = range->next;
+
+    if (!range || memoryPoolNurseryRange_contains(range, memoryNode))
+        return;
+
+    mtx_lock(&barrier_lists_lock);
+    for (MemoryPoolGenerations *generations = atomic_load_explicit(&generational_pools, memory_order_relaxed); generations; generations = generations->next) {
+        if (!memoryPoolGenerations_is_young(generations, neighbour))
+            continue;
+
+        if (!memoryPoolGenerations_is_young(generations, memoryNode))
+            memoryPoolGenerations_remember(generations, memoryNode);
+
+        break;
+    }
+    mtx_unlock(&barrier_lists_lock);
+}
+
+bool memoryPool_enable_generational(MemoryPool *const memoryPool, const size_t nursery_size) {
+    assert(!memoryPool->generations);
+    assert(!memoryPool->marking);
+    assert(!memoryPool->threads);
+
+    MemoryPoolGenerations *const generations = CALLOC(1, sizeof(MemoryPoolGenerations));
+    char *const nursery = MALLOC(nursery_size);
+    if (!generations || !nursery || !memoryPool_lock_barrier_lists()) {
+        FREE(generations);
+        FREE(nursery);
+        return false;
+    }
+
+    generations->nursery = nursery;
+    generations->nurseryTop = nursery;
+    generations->nurseryEnd = nursery + (nursery_size & ~7);
+    generations->range = memoryPoolNurseryRange_claim(generations->nursery, generations->nurseryEnd);
+    if (!generations->range) {
+        mtx_unlock(&barrier_lists_lock);
+        FREE(generations);
+        FREE(nursery);
+        return false;
+    }
+
+    generations->next = atomic_load_explicit(&generational_pools, memory_order_relaxed);
+    atomic_store_explicit(&generational_pools, generations, memory_order_release);
+    mtx_unlock(&barrier_lists_lock);
+    memoryPool->generations = generations;
+    return true;
+}
+
+static void memoryPoolGenerations_free(MemoryPoolGenerations *const generations, const FreeFn freeFn) {
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node && freeFn; node = memoryPoolGenerations_next(generations, node))
+        if (!memoryPoolNode_is_free(node))
+            freeFn(memoryNode_get_data(memoryPoolNode_get_data(node)));
+
+    mtx_lock(&barrier_lists_lock);
+    if (atomic_load_explicit(&generational_pools, memory_order_relaxed) == generations) {
+        atomic_store_explicit(&generational_pools, generations->next, memory_order_release);
+    } else {
+        MemoryPoolGenerations *previous = atomic_load_explicit(&generational_pools, memory_order_relaxed);
+        while (previous->next != generations)
+            previous = previous->next;
+        previous->next = generations->next;
+    }
+    memoryPoolNurseryRange_clear(generations->range);
+    mtx_unlock(&barrier_lists_lock);
+
+    memoryNodeStack_free(&generations->remembered);
+    memoryNodeStack_free(&generations->grey);
+    FREE(generations->nursery);
+    FREE(generations);
+}
+
+// ---------- Thread Local Allocation ----------
+/*
+ * In thread safe mode every thread claims a free MemoryPoolNode of the pool as
+ * its thread local allocation buffer (TLAB) and bump allocates MemoryNodes from
+ * it without synchronisation. Only claiming a new TLAB and allocations that are
+ * too large for a TLAB go through the free lists, which are protected by a
+ * mutex. While a thread owns it, the rest of a TLAB is a free MemoryPoolNode
+ * that is not part of any free list.
+ *
+ * A collection rebuilds the free lists, which also adds the rest of all TLABs.
+ * It therefore increments the epoch of the pool, and threads drop TLABs they
+ * claimed in an older epoch.
+ *
+ * Every thread keeps the TLABs of the TLAB_CACHE_SIZE pools it used last. A
+ * thread that uses more pools evicts the least recently used TLAB, whose rest
+ * stays out of the free lists until its pool is collected, as the pool may no
+ * longer exist.
+ */
+struct MemoryPoolThreads {
+    mtx_t lock;
+    uint64_t id;
+    atomic_uint_fast64_t epoch;
+    size_t tlabSize;
+};
+
+typedef struct {
+    uint64_t owner;
+    uint64_t epoch;
+    uint64_t lastUse;
+    MemoryPoolNode *rest;
+} MemoryPoolTlab;
+
+enum { TLAB_CACHE_SIZE = 4 };
+static const size_t DEFAULT_TLAB_SIZE = 1ULL << 14;
+
+static atomic_uint_fast64_t next_threads_id = 1;
+static _Thread_local MemoryPoolTlab tlabs[TLAB_CACHE_SIZE];
+static _Thread_local uint64_t tlab_clock;
+
+bool memoryPool_enable_thread_safe_alloc(MemoryPool *const memoryPool, const size_t tlab_size) {
+    assert(!memoryPool->threads);
+    assert(!memoryPool->generations);
+    assert(!memoryPool->autoGc);
+    assert(!memoryPool->sampler);
+    assert(memoryPool->placement != MemoryPoolPlacement_NextFit);
+
+    MemoryPoolThreads *const threads = CALLOC(1, sizeof(MemoryPoolThreads));
+    if (!threads)
+        return false;
+
+    if (mtx_init(&threads->lock, mtx_plain) != thrd_success) {
+        FREE(threads);
+        return false;
+    }
+
+    const size_t size = tlab_size ? align_8(tlab_size) : DEFAULT_TLAB_SIZE;
+    threads->tlabSize = size < MemoryPoolNode_MaxMemoryPerNode ? size : MemoryPoolNode_MaxMemoryPerNode;
+    threads->id = atomic_fetch_add(&next_threads_id, 1);
+    atomic_init(&threads->epoch, 0);
+    memoryPool->threads = threads;
+    return true;
+}
+
+static void memoryPoolThreads_free(MemoryPoolThreads *const threads) {
+    mtx_destroy(&threads->lock);
+    FREE(threads);
+}
+
+static void memoryPool_lock(MemoryPool *const memoryPool) {
+    if (memoryPool->threads)
+        mtx_lock(&memoryPool->threads->lock);
+}
+
+static void memoryPool_unlock(MemoryPool *const memoryPool) {
+    if (memoryPool->threads)
+        mtx_unlock(&memoryPool->threads->lock);
+}
+
+/*
+ * Locks the pool for a call that no other call on the pool may run alongside,
+ * which the lock cannot enforce for the calls that do not take it. It only
+ * asserts that no other thread is inside the pool right now.
+ */
+static void memoryPool_lock_exclusive(MemoryPool *const memoryPool) {
+    if (!memoryPool->threads)
+        return;
+
+    const int locked = mtx_trylock(&memoryPool->threads->lock);
+    assert(locked != thrd_busy);
+    if (locked != thrd_success)
+        mtx_lock(&memoryPool->threads->lock);
+}
+
+/*
+ * Invalidates the TLABs of all threads. Needs to be called whenever the free
+ * lists are rebuilt.
+ */
+static void memoryPool_retire_tlabs(MemoryPool *const memoryPool) {
+    if (memoryPool->threads)
+        atomic_fetch_add(&memoryPool->threads->epoch, 1);
+}
+
+static MemoryPoolTlab *memoryPoolThreads_get_tlab(MemoryPoolThreads *const threads) {
+    MemoryPoolTlab *tlab = &tlabs[0];
+    for (size_t i = 0; i < TLAB_CACHE_SIZE; ++i) {
+        if (tlabs[i].owner == threads->id) {
+            tlab = &tlabs[i];
+            break;
+        }
+
+        if (tlabs[i].lastUse < tlab->lastUse)
+            tlab = &tlabs[i];
+    }
+
+    tlab->lastUse = ++tlab_clock;
+    const uint64_t epoch = atomic_load_explicit(&threads->epoch, memory_order_acquire);
+    if (tlab->owner != threads->id || tlab->epoch != epoch) {
+        tlab->owner = threads->id;
+        tlab->epoch = epoch;
+        tlab->rest = NULL;
+    }
+
+    return tlab;
+}
+
+static MemoryPoolNode *memoryPoolThreads_alloc(MemoryPool *const memoryPool, const size_t total_size) {
+    MemoryPoolThreads *const threads = memoryPool->threads;
+    MemoryPoolTlab *const tlab = memoryPoolThreads_get_tlab(threads);
+
+    MemoryPoolNode *node = memoryPool_carve(&tlab->rest, total_size);
+    if (node)
+        return node;
+
+    mtx_lock(&threads->lock);
+    if (total_size <= threads->tlabSize / 4) {
+        if (tlab->rest)
+            memoryPool_insert_free_node(memoryPool, tlab->rest);
+
+        tlab->rest = memoryPool_alloc_node(memoryPool, threads->tlabSize);
+        if (tlab->rest)
+            memoryPoolNode_set_is_free(tlab->rest, true);
+
+        node = memoryPool_carve(&tlab->rest, total_size);
+    }
+
+    if (!node)
+        node = memoryPool_alloc_node(memoryPool, total_size);
+
+    mtx_unlock(&threads->lock);
+    return node;
+}
+
+// ---------- Arena ----------
+static size_t memoryPool_arena_granularity(const MemoryPoolArena arena) {
+    switch (arena) {
+        case MemoryPoolArena_Malloc:
+            return 1;
+        case MemoryPoolArena_Mapped:
+            return SYSTEM_PAGE_SIZE();
+        default:
+            return HUGE_PAGE_SIZE;
+    }
+}
+
+static size_t memoryPool_arena_round(const MemoryPoolArena arena, const size_t size) {
+    const size_t granularity = memoryPool_arena_granularity(arena);
+    return (size + granularity - 1) & ~(granularity - 1);
+}
+
+/*
+ * `size` has to be rounded with memoryPool_arena_round.
+ */
+static void *memoryPool_arena_alloc(const MemoryPoolArena arena, const size_t size) {
+    switch (arena) {
+        case MemoryPoolArena_Malloc:
+            return MALLOC(size);
+        case MemoryPoolArena_Mapped:
+            return MAP(size);
+        default:
+            return MAP_HUGE(size, arena == MemoryPoolArena_HugeTlb);
+    }
+}
+
+static void memoryPool_arena_free(const MemoryPoolArena arena, void *const space, const size_t size) {
+    if (arena == MemoryPoolArena_Malloc)
+        FREE(space);
+    else
+        UNMAP(space, size);
+}
+
+// ---------- Large Object Space ----------
+/*
+ * MemoryNodes that exceed MemoryPoolNode_MaxMemoryPerNode are mapped one by
+ * one and kept in a doubly linked list. They never touch the MemoryPoolNodes of
+ * the pool, so they cannot fragment it.
+ *
+ * Each large object still is preceded by a MemoryPoolNode. Its size is zero,
+ * which no other MemoryPoolNode can have, so a MemoryNode can tell whether it
+ * is a large object.
+ */
+struct MemoryPoolLargeObject {
+    MemoryPoolLargeObject *previous;
+    MemoryPoolLargeObject *next;
+    size_t size;
+    MemoryPoolNode node;
+};
+
+static bool memoryNode_is_large(MemoryNode const *const memoryNode) {
+    return memoryPoolNode_get_free_space(memoryNode_get_memoryPoolNode(memoryNode)) == 0;
+}
+
+static MemoryPoolLargeObject *memoryNode_get_large_object(MemoryNode const *const memoryNode) {
+    return (MemoryPoolLargeObject *) ((char *) memoryNode - sizeof(MemoryPoolLargeObject));
+}
+
+static MemoryNode *memoryPoolLargeObject_get_node(MemoryPoolLargeObject const *const largeObject) {
+    return memoryPoolNode_get_data(&largeObject->node);
+}
+
+static MemoryNode *memoryPool_alloc_large(MemoryPool *const memoryPool, const size_t total_size, const size_t neighbours) {
+    const size_t size = sizeof(MemoryPoolLargeObject) + total_size;
+    MemoryPoolLargeObject *const largeObject = MAP(size);
+    if (!largeObject)
+        return NULL;
+
+    largeObject->size = size;
+    largeObject->previous = NULL;
+    memoryPoolNode_new(&largeObject->node, NULL, 0, false);
+
+    memoryPool_lock(memoryPool);
+    largeObject->next = memoryPool->largeObjects;
+    if (largeObject->next)
+        largeObject->next->previous = largeObject;
+    memoryPool->largeObjects = largeObject;
+    memoryPool_unlock(memoryPool);
+
+    return memoryNode_new(memoryPoolLargeObject_get_node(largeObject), neighbours);
+}
+
+static void memoryPool_release_large(MemoryPool *const memoryPool, MemoryPoolLargeObject *const largeObject) {
+    if (largeObject->previous)
+        largeObject->previous->next = largeObject->next;
+    else
+        memoryPool->largeObjects = largeObject->next;
+
+    if (largeObject->next)
+        largeObject->next->previous = largeObject->previous;
+
+    UNMAP(largeObject, largeObject->size);
+}
+
+static void memoryPool_sweep_large_objects(MemoryPool *const memoryPool) {
+    MemoryPoolLargeObject *largeObject = memoryPool->largeObjects;
+    while (largeObject) {
+        MemoryPoolLargeObject *const next = largeObject->next;
+        MemoryNode *const memoryNode = memoryPoolLargeObject_get_node(largeObject);
+        if (memoryNode_is_marked(memoryNode)) {
+            memoryNode_set_is_marked(memoryNode, false);
+        } else {
+            if (memoryPool->freeFn)
+                memoryPool->freeFn(memoryNode_get_data(memoryNode));
+
+            memoryPool_release_large(memoryPool, largeObject);
+        }
+
+        largeObject = next;
+    }
+}
+
+// ---------- Segments ----------
+/*
+ * A growing pool consists of multiple segments, each of which is split into
+ * MemoryPoolNodes on its own. A new segment is put in front of the list of all
+ * MemoryPoolNodes, so the head of the pool always is the first MemoryPoolNode
+ * of the most recently added segment.
+ *
+ * Coalescing and compaction treat physically adjacent MemoryPoolNodes as one
+ * run, so no run may cross into other memory. The header at the start of a
+ * segment keeps its first MemoryPoolNode apart from whatever lies below, and
+ * an unused granule at its end keeps its last MemoryPoolNode apart from
+ * whatever lies above, which may well be the initial space of the pool.
+ */
+typedef struct MemoryPoolSegment {
+    struct MemoryPoolSegment *next;
+    size_t size;
+} MemoryPoolSegment;
+
+static const size_t MemoryPoolSegment_Guard = 8;
+
+struct MemoryPoolGrowth {
+    size_t maxSize;
+    MemoryPoolSegment *segments;
+    MemoryPoolNode *initialHead;
+};
+
+/*
+ * Splits `size` bytes at `space` into linked free MemoryPoolNodes that are at
+ * most MemoryPoolNode_MaxMemoryPerNode bytes large and puts them into the free
+ * lists. Returns the first of them and stores the last one in `*last`.
+ */
+static MemoryPoolNode *memoryPool_add_space(MemoryPool *const memoryPool, void *const space, size_t size, MemoryPoolNode **const last) {
+    MemoryPoolNode *first = NULL;
+    MemoryPoolNode *current = NULL;
+    char *location = space;
+    while (size >= sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode) {
+        size -= sizeof(MemoryPoolNode);
+        const size_t node_size = (size < MemoryPoolNode_MaxMemoryPerNode ? size : MemoryPoolNode_MaxMemoryPerNode) & ~7;
+        size -= node_size;
+
+        MemoryPoolNode *const node = memoryPoolNode_new(location, NULL, node_size, true);
+        if (current)
+            memoryPoolNode_set_next(current, node);
+        else
+            first = node;
+
+        memoryPool_insert_free_node(memoryPool, node);
+        current = node;
+        location += sizeof(MemoryPoolNode) + node_size;
+    }
+
+    *last = current;
+    return first;
+}
+
+bool memoryPool_enable_growth(MemoryPool *const memoryPool, const size_t max_pool_size) {
+    assert(!memoryPool->growth);
+
+    MemoryPoolGrowth *const growth = CALLOC(1, sizeof(MemoryPoolGrowth));
+    if (!growth)
+        return false;
+
+    growth->maxSize = max_pool_size ? max_pool_size : SIZE_MAX;
+    growth->initialHead = memoryPool->head;
+    memoryPool->growth = growth;
+    return true;
+}
+
+static void memoryPool_invalidate_regions(MemoryPool const *memoryPool);
+
+static bool memoryPool_grow(MemoryPool *const memoryPool, const size_t total_size) {
+    MemoryPoolGrowth *const growth = memoryPool->growth;
+    if (!growth || memoryPool->size >= growth->maxSize)
+        return false;
+
+    const size_t needed = sizeof(MemoryPoolSegment) + sizeof(MemoryPoolNode) + total_size + MemoryPoolSegment_Guard;
+    const size_t available = growth->maxSize - memoryPool->size;
+    size_t size = memoryPool_arena_round(memoryPool->arena, memoryPool->size > needed ? memoryPool->size : needed);
+    if (size > available)
+        size = available & ~(memoryPool_arena_granularity(memoryPool->arena) - 1);
+
+    if (size < needed)
+        return false;
+
+    MemoryPoolSegment *const segment = memoryPool_arena_alloc(memoryPool->arena, size);
+    if (!segment)
+        return false;
+
+    segment->size = size;
+    segment->next = growth->segments;
+    growth->segments = segment;
+    memoryPool->size += size;
+    memoryPool_invalidate_regions(memoryPool);
+
+    MemoryPoolNode *last;
+    MemoryPoolNode *const first = memoryPool_add_space(memoryPool, (char *) segment + sizeof(MemoryPoolSegment), size - sizeof(MemoryPoolSegment) - MemoryPoolSegment_Guard, &last);
+    memoryPoolNode_set_next(last, memoryPool->head);
+    memoryPool->head = first;
+    return true;
+}
+
+static bool memoryPoolSegment_contains(MemoryPoolSegment const *const segment, void const *const memory) {
+    return (uintptr_t) memory > (uintptr_t) segment && (uintptr_t) memory < (uintptr_t) segment + segment->size;
+}
+
+/*
+ * Releases the most recently added segments for as long as they do not hold
+ * any MemoryNode. Requires the free lists to be up to date, so it does nothing
+ * while a lazy sweep is outstanding.
+ */
+static void memoryPool_release_empty_segments(MemoryPool *const memoryPool) {
+    MemoryPoolGrowth *const growth = memoryPool->growth;
+    if (!growth || memoryPool->sweepCursor)
+        return;
+
+    while (growth->segments) {
+        MemoryPoolSegment *const segment = growth->segments;
+        MemoryPoolNode *end = memoryPool->head;
+        for (; memoryPoolSegment_contains(segment, end); end = memoryPoolNode_get_next(end))
+            if (!memoryPoolNode_is_free(end))
+                return;
+
+        for (MemoryPoolNode *node = memoryPool->head; node != end; node = memoryPoolNode_get_next(node))
+            memoryPool_remove_free_node(memoryPool, node);
+
+        memoryPool->head = end;
+        memoryPool->size -= segment->size;
+        growth->segments = segment->next;
+        memoryPool_invalidate_regions(memoryPool);
+        memoryPool_arena_free(memoryPool->arena, segment, segment->size);
+    }
+}
+
+/*
+ * Releases all segments the pool has grown by, no matter whether they still
+ * hold MemoryNodes. Afterwards the size of the pool is the size of its initial
+ * space.
+ */
+static void memoryPool_release_segments(MemoryPool *const memoryPool) {
+    MemoryPoolGrowth *const growth = memoryPool->growth;
+    while (growth->segments) {
+        MemoryPoolSegment *const segment = growth->segments;
+        growth->segments = segment->next;
+        memoryPool->size -= segment->size;
+        memoryPool_arena_free(memoryPool->arena, segment, segment->size);
+    }
+}
+
+static void memoryPoolGrowth_free(MemoryPool *const memoryPool) {
+    memoryPool_release_segments(memoryPool);
+    FREE(memoryPool->growth);
+}
+
+// ---------- Mark Bitmap ----------
+/*
+ * The mark bitmap holds the marks of the MemoryNodes in the spaces of the pool,
+ * the initial space and every segment, with one bit per 8 byte granule. The
+ * bit of a MemoryNode is the one of the granule its address falls into. Large
+ * objects and young MemoryNodes keep their marks in their first neighbour
+ * pointer.
+ *
+ * The bitmap is only in use from the mark phase of memoryPool_gc_mark_and_sweep
+ * till the end of the following sweep, which clears it with memset. All
+ * other collections mark in the MemoryNodes. The spaces of the bitmap are
+ * matched with the spaces of the pool at the start of every collection, since
+ * the pool may have grown, shrunk or been copied since the last one.
+ */
+typedef struct {
+    char const *begin;
+    char const *end;
+    uint64_t *bits;
+} MemoryPoolBitmapSpace;
+
+struct MemoryPoolMarkBitmap {
+    MemoryPoolBitmapSpace *spaces;
+    size_t count;
+    bool active;
+};
+
+static size_t memoryPoolBitmapSpace_words(MemoryPoolBitmapSpace const *const space) {
+    return ((size_t) (space->end - space->begin) / PTR_SIZE + 63) / 64;
+}
+
+bool memoryPool_enable_mark_bitmap(MemoryPool *const memoryPool) {
+    assert(!memoryPool->markBitmap);
+
+    MemoryPoolMarkBitmap *const bitmap = CALLOC(1, sizeof(MemoryPoolMarkBitmap));
+    if (!bitmap || (!memoryPool->markers && !memoryPool_enable_parallel_mark(memoryPool, 1))) {
+        FREE(bitmap);
+        return false;
+    }
+
+    memoryPool->markBitmap = bitmap;
+    return true;
+}
+
+static void memoryPoolMarkBitmap_free(MemoryPoolMarkBitmap *const bitmap) {
+    for (size_t i = 0; i < bitmap->count; ++i)
+        FREE(bitmap->spaces[i].bits);
+
+    FREE(bitmap->spaces);
+    FREE(bitmap);
+}
+
+/*
+ * Finds the word and the bit of a MemoryNode. Returns false if the MemoryNode
+ * is not in a space of the pool.
+ */
+static bool memoryPoolMarkBitmap_locate(MemoryPoolMarkBitmap const *const bitmap, void const *const memory, uint64_t **const word, uint64_t *const mask) {
+    size_t low = 0;
+    size_t high = bitmap->count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        MemoryPoolBitmapSpace const *const space = &bitmap->spaces[middle];
+        if ((char const *) memory < space->begin) {
+            high = middle;
+        } else if ((char const *) memory >= space->end) {
+            low = middle + 1;
+        } else {
+            const size_t granule = (size_t) ((char const *) memory - space->begin) / PTR_SIZE;
+            *word = &space->bits[granule / 64];
+            *mask = 1ULL << (granule % 64);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool memoryPool_is_marked(MemoryPool const *const memoryPool, MemoryNode const *const memoryNode) {
+    MemoryPoolMarkBitmap const *const bitmap = memoryPool->markBitmap;
+    uint64_t *word;
+    uint64_t mask;
+    if (bitmap && bitmap->active && memoryPoolMarkBitmap_locate(bitmap, memoryNode, &word, &mask))
+        return atomic_load_explicit((atomic_uint_least64_t *) word, memory_order_relaxed) & mask;
+
+    return memoryNode_is_marked(memoryNode);
+}
+
+static int memoryPoolBitmapSpace_compare(void const *const first, void const *const second) {
+    char const *const a = ((MemoryPoolBitmapSpace const *) first)->begin;
+    char const *const b = ((MemoryPoolBitmapSpace const *) second)->begin;
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Matches the spaces of the bitmap with the spaces of the pool, keeping the
+ * cleared bits of spaces that still exist. Returns false if the memory for the
+ * bits of a new space could not be allocated.
+ */
+static bool memoryPoolMarkBitmap_sync(MemoryPool const *const memoryPool, MemoryPoolMarkBitmap *const bitmap) {
+    size_t count = 1;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next)
+        ++count;
+
+    MemoryPoolBitmapSpace *const spaces = CALLOC(count, sizeof(MemoryPoolBitmapSpace));
+    if (!spaces)
+        return false;
+
+    size_t initialSize = memoryPool->size;
+    size_t i = 0;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next) {
+        spaces[i++] = (MemoryPoolBitmapSpace) {(char const *) segment, (char const *) segment + segment->size, NULL};
+        initialSize -= segment->size;
+    }
+
+    char const *const initialSpace = (char const *) (memoryPool->growth ? memoryPool->growth->initialHead : memoryPool->head);
+    spaces[i] = (MemoryPoolBitmapSpace) {initialSpace, initialSpace + initialSize, NULL};
+    qsort(spaces, count, sizeof(MemoryPoolBitmapSpace), memoryPoolBitmapSpace_compare);
+
+    bool complete = true;
+    for (i = 0; i < count; ++i) {
+        for (size_t j = 0; j < bitmap->count; ++j) {
+            MemoryPoolBitmapSpace *const old = &bitmap->spaces[j];
+            if (old->begin == spaces[i].begin && old->end == spaces[i].end) {
+                spaces[i].bits = old->bits;
+                old->bits = NULL;
+            }
+        }
+
+        if (!spaces[i].bits && !(spaces[i].bits = CALLOC(memoryPoolBitmapSpace_words(&spaces[i]), sizeof(uint64_t))))
+            complete = false;
+    }
+
+    for (size_t j = 0; j < bitmap->count; ++j)
+        FREE(bitmap->spaces[j].bits);
+
+    FREE(bitmap->spaces);
+    bitmap->spaces = spaces;
+    bitmap->count = count;
+    if (!complete) {
+        for (i = 0; i < count; ++i)
+            FREE(spaces[i].bits);
+
+        bitmap->count = 0;
+    }
+
+    return complete;
+}
+
+/*
+ * Starts to use the bitmap for the marks of a collection. Returns false if the
+ * marks have to go into the MemoryNodes this time.
+ */
+static bool memoryPool_begin_mark_bitmap(MemoryPool const *const memoryPool) {
+    MemoryPoolMarkBitmap *const bitmap = memoryPool->markBitmap;
+    if (!bitmap)
+        return false;
+
+    bitmap->active = memoryPoolMarkBitmap_sync(memoryPool, bitmap);
+    return bitmap->active;
+}
+
+static void memoryPool_end_mark_bitmap(MemoryPool const *const memoryPool) {
+    MemoryPoolMarkBitmap *const bitmap = memoryPool->markBitmap;
+    if (!bitmap || !bitmap->active)
+        return;
+
+    for (size_t i = 0; i < bitmap->count; ++i)
+        memset(bitmap->spaces[i].bits, 0, memoryPoolBitmapSpace_words(&bitmap->spaces[i]) * sizeof(uint64_t));
+
+    bitmap->active = false;
+}
+
+/*
+ * Moves the marks from the bitmap into the MemoryNodes and stops using the
+ * bitmap for the rest of the collection.
+ */
+static void memoryPool_move_marks_to_nodes(MemoryPool const *const memoryPool) {
+    for (MemoryPoolNode *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+        if (!memoryPoolNode_is_free(node) && memoryPool_is_marked(memoryPool, memoryPoolNode_get_data(node)))
+            memoryNode_set_is_marked(memoryPoolNode_get_data(node), true);
+
+    memoryPool_end_mark_bitmap(memoryPool);
+}
+
+/*
+ * Returns the index of the first set bit at or after `from` and before
+ * `limit`, or `limit` if there is none. Runs of cleared bits are skipped a
+ * vector at a time where the instruction set allows it.
+ */
+static size_t memoryPoolMarkBitmap_find(uint64_t const *const bits, const size_t from, const size_t limit) {
+    size_t word = from / 64;
+    const size_t words = (limit + 63) / 64;
+    uint64_t current = word < words ? bits[word] & (~0ULL << (from % 64)) : 0;
+    while (!current) {
+        if (++word >= words)
+            return limit;
+
+#if defined(__AVX2__)
+        while (word + 4 <= words && _mm256_testz_si256(_mm256_loadu_si256((__m256i const *) &bits[word]), _mm256_loadu_si256((__m256i const *) &bits[word])))
+            word += 4;
+#elif defined(__SSE2__)
+        while (word + 2 <= words && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *) &bits[word]), _mm_setzero_si128())) == 0xFFFF)
+            word += 2;
+#endif
+        if (word >= words)
+            return limit;
+
+        current = bits[word];
+    }
+
+    const size_t index = word * 64 + (size_t) __builtin_ctzll(current);
+    return index < limit ? index : limit;
+}
+
+/*
+ * Returns the first MemoryPoolNode behind `memoryPoolNode` in the same space
+ * whose MemoryNode is marked in the bitmap, or NULL if there is none.
+ */
+static MemoryPoolNode *memoryPool_next_marked_node(MemoryPool const *const memoryPool, MemoryPoolNode const *const memoryPoolNode) {
+    MemoryPoolMarkBitmap const *const bitmap = memoryPool->markBitmap;
+    char const *const data = memoryPoolNode_get_data(memoryPoolNode);
+    for (size_t i = 0; i < bitmap->count; ++i) {
+        MemoryPoolBitmapSpace const *const space = &bitmap->spaces[i];
+        if (data < space->begin || data >= space->end)
+            continue;
+
+        const size_t granules = (size_t) (space->end - space->begin) / PTR_SIZE;
+        const size_t next = memoryPoolMarkBitmap_find(space->bits, (size_t) (data - space->begin) / PTR_SIZE + 1, granules);
+        return next < granules ? (MemoryPoolNode *) (space->begin + next * PTR_SIZE - sizeof(MemoryPoolNode)) : NULL;
+    }
+
+    return NULL;
+}
+
+/*
+ * Turns the MemoryPoolNodes from `first` up to `end`, which are all free or
+ * garbage without a FreeFn, into as few free MemoryPoolNodes as possible
+ * without looking at them, and coalesces those into `run`.
+ */
+static MemoryPoolNode *memoryPool_sweep_range(MemoryPool *const memoryPool, MemoryPoolNode *run, MemoryPoolNode *const first, MemoryPoolNode *const end) {
+    char *location = (char *) first;
+    size_t bytes = (size_t) ((char *) end - location);
+    while (bytes) {
+        size_t size = bytes - sizeof(MemoryPoolNode);
+        if (size > MemoryPoolNode_MaxMemoryPerNode) {
+            size = MemoryPoolNode_MaxMemoryPerNode;
+            const size_t rest = bytes - sizeof(MemoryPoolNode) - size;
+            if (rest < sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode)
+                size -= sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode - rest;
+        }
+
+        bytes -= sizeof(MemoryPoolNode) + size;
+        MemoryPoolNode *const next = bytes ? (MemoryPoolNode *) (location + sizeof(MemoryPoolNode) + size) : end;
+        run = memoryPool_coalesce_free_node(memoryPool, run, memoryPoolNode_new(location, next, size, true));
+        location = (char *) next;
+    }
+
+    return run;
+}
+
+// ---------- Handles ----------
+/*
+ * Handles are slots in chunks that are never moved, so the address of a
+ * handle stays valid till it is freed. A free slot holds the next free slot
+ * with its lowest bit set, which no pointer to a MemoryNode has.
+ *
+ * The free slots form a lock free stack, so the threads of a thread safe pool
+ * create and free handles without the pool lock, which is only taken to add a
+ * chunk. The top bits of the top of the stack count its changes, so a pop
+ * fails if its slot has been popped and pushed again in the meantime. Chunks
+ * live as long as the pool, so a pop may read a slot another thread has
+ * taken meanwhile.
+ */
+enum { HANDLES_PER_CHUNK = 255 };
+
+typedef struct MemoryPoolHandleChunk {
+    struct MemoryPoolHandleChunk *next;
+    MemoryNode *slots[HANDLES_PER_CHUNK];
+} MemoryPoolHandleChunk;
+
+struct MemoryPoolHandles {
+    MemoryPoolHandleChunk *chunks;
+    atomic_uintptr_t freeSlots;
+};
+
+static atomic_uintptr_t *memoryPoolHandles_slot(MemoryNode **const handle) {
+    return (atomic_uintptr_t *) handle;
+}
+
+/*
+ * Pushes the free slots from `first` to `last`, which are already linked to
+ * each other.
+ */
+static void memoryPoolHandles_push(MemoryPoolHandles *const handles, MemoryNode **const first, MemoryNode **const last) {
+    uintptr_t top = atomic_load_explicit(&handles->freeSlots, memory_order_relaxed);
+    do
+        atomic_store_explicit(memoryPoolHandles_slot(last), (uintptr_t) set_lowest_bit(mask_top_bits((void *) top), true), memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&handles->freeSlots, &top, (uintptr_t) set_top_bits(first, extract_top_bits((void *) top) + 1), memory_order_release, memory_order_relaxed));
+}
+
+static MemoryNode **memoryPoolHandles_pop(MemoryPoolHandles *const handles) {
+    uintptr_t top = atomic_load_explicit(&handles->freeSlots, memory_order_acquire);
+    for (;;) {
+        MemoryNode **const handle = mask_top_bits((void *) top);
+        if (!handle)
+            return NULL;
+
+        void *const next = set_lowest_bit((void *) atomic_load_explicit(memoryPoolHandles_slot(handle), memory_order_relaxed), false);
+        if (atomic_compare_exchange_weak_explicit(&handles->freeSlots, &top, (uintptr_t) set_top_bits(next, extract_top_bits((void *) top) + 1), memory_order_acquire, memory_order_acquire))
+            return handle;
+    }
+}
+
+static MemoryPoolHandles *memoryPool_load_handles(MemoryPool const *const memoryPool) {
+    return atomic_load_explicit((_Atomic(MemoryPoolHandles *) const *) &memoryPool->handles, memory_order_acquire);
+}
+
+/*
+ * Adds a chunk of free slots unless another thread has just done so. Requires
+ * the pool lock.
+ */
+static bool memoryPool_add_handle_chunk(MemoryPool *const memoryPool) {
+    MemoryPoolHandles *handles = memoryPool->handles;
+    if (!handles) {
+        if (!(handles = CALLOC(1, sizeof(MemoryPoolHandles))))
+            return false;
+
+        atomic_store_explicit((_Atomic(MemoryPoolHandles *) *) &memoryPool->handles, handles, memory_order_release);
+    }
+
+    if (mask_top_bits((void *) atomic_load_explicit(&handles->freeSlots, memory_order_relaxed)))
+        return true;
+
+    MemoryPoolHandleChunk *const chunk = MALLOC(sizeof(MemoryPoolHandleChunk));
+    if (!chunk)
+        return false;
+
+    for (size_t i = 0; i + 1 < HANDLES_PER_CHUNK; ++i)
+        chunk->slots[i] = set_lowest_bit(&chunk->slots[i + 1], true);
+
+    chunk->next = handles->chunks;
+    handles->chunks = chunk;
+    memoryPoolHandles_push(handles, chunk->slots, &chunk->slots[HANDLES_PER_CHUNK - 1]);
+    return true;
+}
+
+MemoryNode **memoryPool_new_handle(MemoryPool *const memoryPool, MemoryNode *const memoryNode) {
+    MemoryPoolHandles *handles = memoryPool_load_handles(memoryPool);
+    MemoryNode **handle = handles ? memoryPoolHandles_pop(handles) : NULL;
+    while (!handle) {
+        memoryPool_lock(memoryPool);
+        const bool added = memoryPool_add_handle_chunk(memoryPool);
+        memoryPool_unlock(memoryPool);
+        if (!added)
+            return NULL;
+
+        handles = memoryPool_load_handles(memoryPool);
+        handle = memoryPoolHandles_pop(handles);
+    }
+
+    atomic_store_explicit(memoryPoolHandles_slot(handle), (uintptr_t) memoryNode, memory_order_relaxed);
+    return handle;
+}
+
+void memoryPool_free_handle(MemoryPool *const memoryPool, MemoryNode **const handle) {
+    memoryPoolHandles_push(memoryPool_load_handles(memoryPool), handle, handle);
+}
+
+static void memoryPool_retire_samples(MemoryPool const *memoryPool);
+
+/*
+ * Replaces the MemoryNode of every handle that is in use by what `update`
+ * returns for it.
+ */
+static void memoryPool_update_handles(MemoryPool const *const memoryPool, MemoryNode *(*const update)(MemoryPool const *, MemoryNode *)) {
+    if (!memoryPool->handles)
+        return;
+
+    for (MemoryPoolHandleChunk *chunk = memoryPool->handles->chunks; chunk; chunk = chunk->next)
+        for (size_t i = 0; i < HANDLES_PER_CHUNK; ++i)
+            if (chunk->slots[i] && !extract_lowest_bit(chunk->slots[i]))
+                chunk->slots[i] = update(memoryPool, chunk->slots[i]);
+
+    memoryPool_retire_samples(memoryPool);
+}
+
+static MemoryNode *memoryPool_keep_if_marked(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    return memoryPool_is_marked(memoryPool, memoryNode) ? memoryNode : NULL;
+}
+
+static void memoryPoolHandles_free(MemoryPoolHandles *const handles) {
+    while (handles->chunks) {
+        MemoryPoolHandleChunk *const chunk = handles->chunks;
+        handles->chunks = chunk->next;
+        FREE(chunk);
+    }
+
+    FREE(handles);
+}
+
+// ---------- Parallel Marking ----------
+/*
+ * The parallel mark phase traces the graph with a number of workers, one of
+ * which is the collecting thread. Every worker marks MemoryNodes with an atomic
+ * test-and-set of the mark bit, so each MemoryNode is scanned by exactly one
+ * worker, and keeps the MemoryNodes it still has to scan on a private stack.
+ *
+ * A worker whose stack grows large moves a batch of it to its shared deque, from
+ * where idle workers steal half of it. Workers only synchronise on the shared
+ * deques, not on their private stacks. Marking ends once all workers are idle
+ * and all shared deques are empty.
+ *
+ * Neighbour pointers are only read, so unlike memoryPool_dfs the graph stays
+ * intact during marking. If a stack cannot grow, the MemoryNodes that were
+ * marked but not scanned are found by a serial pass over the pool afterwards.
+ */
+enum { MARK_BATCH_SIZE = 64 };
+
+typedef struct {
+    mtx_t lock;
+    MemoryNodeStack shared;
+    atomic_size_t sharedSize;
+} MemoryPoolMarkDeque;
+
+struct MemoryPoolMarkers {
+    size_t workers;
+    MemoryPoolMarkBitmap *bitmap;
+    MemoryPoolMarkDeque *deques;
+    atomic_size_t active;
+    atomic_size_t idle;
+    atomic_bool overflow;
+};
+
+typedef struct {
+    MemoryPoolMarkers *markers;
+    size_t index;
+} MemoryPoolMarkWorker;
+
+bool memoryPool_enable_parallel_mark(MemoryPool *const memoryPool, const size_t workers) {
+    assert(!memoryPool->markers);
+    assert(workers > 0);
+
+    MemoryPoolMarkers *const markers = CALLOC(1, sizeof(MemoryPoolMarkers));
+    MemoryPoolMarkDeque *const deques = CALLOC(workers, sizeof(MemoryPoolMarkDeque));
+    if (!markers || !deques) {
+        FREE(markers);
+        FREE(deques);
+        return false;
+    }
+
+    for (size_t i = 0; i < workers; ++i) {
+        if (mtx_init(&deques[i].lock, mtx_plain) != thrd_success) {
+            while (i--)
+                mtx_destroy(&deques[i].lock);
+
+            FREE(markers);
+            FREE(deques);
+            return false;
+        }
+    }
+
+    markers->workers = workers;
+    markers->deques = deques;
+    memoryPool->markers = markers;
+    return true;
+}
+
+static void memoryPoolMarkers_free(MemoryPoolMarkers *const markers) {
+    for (size_t i = 0; i < markers->workers; ++i) {
+        mtx_destroy(&markers->deques[i].lock);
+        memoryNodeStack_free(&markers->deques[i].shared);
+    }
+
+    FREE(markers->deques);
+    FREE(markers);
+}
+
+static atomic_uintptr_t *memoryNode_atomic_neighbours(MemoryNode *const memoryNode) {
+    return (atomic_uintptr_t *) &memoryNode->neighbours;
+}
+
+/*
+ * Sets the mark bit and returns whether this call set it. The first neighbour
+ * pointer shares its bits with the mark, so it is only accessed atomically.
+ */
+static bool memoryNode_try_mark(MemoryNode *const memoryNode) {
+    atomic_uintptr_t *const neighbours = memoryNode_atomic_neighbours(memoryNode);
+    if (atomic_load_explicit(neighbours, memory_order_relaxed) & 1)
+        return false;
+
+    return !(atomic_fetch_or_explicit(neighbours, 1, memory_order_relaxed) & 1);
+}
+
+/*
+ * Sets the mark of a MemoryNode in the bitmap, if one is in use and holds the
+ * MemoryNode, and in the MemoryNode otherwise.
+ */
+static bool memoryPoolMarkers_try_mark(MemoryPoolMarkers const *const markers, MemoryNode *const memoryNode) {
+    uint64_t *word;
+    uint64_t mask;
+    if (!markers->bitmap || !memoryPoolMarkBitmap_locate(markers->bitmap, memoryNode, &word, &mask))
+        return memoryNode_try_mark(memoryNode);
+
+    atomic_uint_least64_t *const bits = (atomic_uint_least64_t *) word;
+    if (atomic_load_explicit(bits, memory_order_relaxed) & mask)
+        return false;
+
+    return !(atomic_fetch_or_explicit(bits, mask, memory_order_relaxed) & mask);
+}
+
+static void memoryPoolMarkers_push(MemoryPoolMarkers *const markers, MemoryNodeStack *const stack, MemoryNode *const memoryNode) {
+    if (!memoryNodeStack_push(stack, memoryNode))
+        atomic_store_explicit(&markers->overflow, true, memory_order_relaxed);
+}
+
+static void memoryPoolMarkers_scan(MemoryPoolMarkers *const markers, MemoryNodeStack *const local, MemoryNode *const memoryNode) {
+    MemoryNode *const first = (MemoryNode *) atomic_load_explicit(memoryNode_atomic_neighbours(memoryNode), memory_order_relaxed);
+    const uint16_t count = extract_top_bits(first);
+    for (uint16_t i = 0; i < count; ++i) {
+        MemoryNode *const neighbour = i == 0 ? extract_ptr_bits(first) : memoryNode_getNeighbour(memoryNode, i);
+        if (neighbour && memoryPoolMarkers_try_mark(markers, neighbour))
+            memoryPoolMarkers_push(markers, local, neighbour);
+    }
+}
+
+/*
+ * Moves `count` MemoryNodes from the top of `from` to `to`.
+ */
+static void memoryPoolMarkers_transfer(MemoryPoolMarkers *const markers, MemoryNodeStack *const from, MemoryNodeStack *const to, const size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        memoryPoolMarkers_push(markers, to, memoryNodeStack_pop(from));
+}
+
+static void memoryPoolMarkers_publish(MemoryPoolMarkers *const markers, MemoryPoolMarkDeque *const deque, MemoryNodeStack *const local) {
+    mtx_lock(&deque->lock);
+    memoryPoolMarkers_transfer(markers, local, &deque->shared, local->size / 2);
+    atomic_store_explicit(&deque->sharedSize, deque->shared.size, memory_order_relaxed);
+    mtx_unlock(&deque->lock);
+}
+
+/*
+ * Takes half of the shared MemoryNodes of `deque`, but at least one.
+ */
+static bool memoryPoolMarkers_take(MemoryPoolMarkers *const markers, MemoryPoolMarkDeque *const deque, MemoryNodeStack *const local) {
+    if (!atomic_load_explicit(&deque->sharedSize, memory_order_relaxed))
+        return false;
+
+    mtx_lock(&deque->lock);
+    const size_t count = (deque->shared.size + 1) / 2;
+    memoryPoolMarkers_transfer(markers, &deque->shared, local, count);
+    atomic_store_explicit(&deque->sharedSize, deque->shared.size, memory_order_relaxed);
+    mtx_unlock(&deque->lock);
+    return count > 0;
+}
+
+static bool memoryPoolMarkers_steal(MemoryPoolMarkers *const markers, const size_t thief, MemoryNodeStack *const local) {
+    for (size_t i = 1; i < markers->workers; ++i)
+        if (memoryPoolMarkers_take(markers, &markers->deques[(thief + i) % markers->workers], local))
+            return true;
+
+    return false;
+}
+
+static bool memoryPoolMarkers_has_shared(MemoryPoolMarkers *const markers) {
+    for (size_t i = 0; i < markers->workers; ++i)
+        if (atomic_load_explicit(&markers->deques[i].sharedSize, memory_order_relaxed))
+            return true;
+
+    return false;
+}
+
+/*
+ * Waits till there is something to steal. Returns false once all workers are
+ * idle, as then no work is left.
+ */
+static bool memoryPoolMarkers_await_work(MemoryPoolMarkers *const markers) {
+    atomic_fetch_add(&markers->idle, 1);
+    for (;;) {
+        if (memoryPoolMarkers_has_shared(markers)) {
+            atomic_fetch_sub(&markers->idle, 1);
+            return true;
+        }
+
+        if (atomic_load(&markers->idle) == atomic_load(&markers->active))
+            return false;
+
+        thrd_yield();
+    }
+}
+
+static int memoryPoolMarkers_work(void *const arg) {
+    MemoryPoolMarkWorker const *const worker = arg;
+    MemoryPoolMarkers *const markers = worker->markers;
+    MemoryPoolMarkDeque *const own = &markers->deques[worker->index];
+
+    MemoryNodeStack local;
+    memset(&local, 0, sizeof(MemoryNodeStack));
+    for (;;) {
+        MemoryNode *memoryNode;
+        while ((memoryNode = memoryNodeStack_pop(&local))) {
+            memoryPoolMarkers_scan(markers, &local, memoryNode);
+            if (local.size >= 2 * MARK_BATCH_SIZE && !atomic_load_explicit(&own->sharedSize, memory_order_relaxed))
+                memoryPoolMarkers_publish(markers, own, &local);
+        }
+
+        if (memoryPoolMarkers_take(markers, own, &local) || memoryPoolMarkers_steal(markers, worker->index, &local))
+            continue;
+
+        if (!memoryPoolMarkers_await_work(markers))
+            break;
+    }
+
+    memoryNodeStack_free(&local);
+    return 0;
+}
+
+static void memoryPool_scan_unmarked_neighbours(MemoryNode const *const memoryNode) {
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i) {
+        MemoryNode *const neighbour = memoryNode_getNeighbour(memoryNode, i);
+        if (neighbour && !memoryNode_is_marked(neighbour))
+            memoryPool_dfs(neighbour, NULL);
+    }
+}
+
+/*
+ * Finishes marking after a worker failed to remember a MemoryNode, by tracing
+ * the unmarked neighbours of every marked MemoryNode.
+ */
+static void memoryPool_complete_mark(MemoryPool const *const memoryPool) {
+    for (MemoryPoolNode *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+        if (!memoryPoolNode_is_free(node) && memoryNode_is_marked(memoryPoolNode_get_data(node)))
+            memoryPool_scan_unmarked_neighbours(memoryPoolNode_get_data(node));
+
+    for (MemoryPoolLargeObject *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        if (memoryNode_is_marked(memoryPoolLargeObject_get_node(largeObject)))
+            memoryPool_scan_unmarked_neighbours(memoryPoolLargeObject_get_node(largeObject));
+
+    MemoryPoolGenerations const *const generations = memoryPool->generations;
+    for (MemoryPoolNode *node = generations ? memoryPoolGenerations_first(generations) : NULL; node; node = memoryPoolGenerations_next(generations, node))
+        if (!memoryPoolNode_is_free(node) && memoryNode_is_marked(memoryPoolNode_get_data(node)))
+            memoryPool_scan_unmarked_neighbours(memoryPoolNode_get_data(node));
+}
+
+static void memoryPool_gc_mark_parallel(MemoryPool const *const memoryPool) {
+    MemoryPoolMarkers *const markers = memoryPool->markers;
+    const size_t workers = markers->workers;
+    atomic_store(&markers->idle, 0);
+    atomic_store(&markers->overflow, false);
+    markers->bitmap = memoryPool->markBitmap && memoryPool->markBitmap->active ? memoryPool->markBitmap : NULL;
+
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i) {
+        MemoryNode *const root = memoryPool->rootSet[i];
+        MemoryPoolMarkDeque *const deque = &markers->deques[i % workers];
+        if (root && memoryPoolMarkers_try_mark(markers, root)) {
+            memoryPoolMarkers_push(markers, &deque->shared, root);
+            atomic_store(&deque->sharedSize, deque->shared.size);
+        }
+    }
+
+    MemoryPoolMarkWorker *const arguments = MALLOC(workers * sizeof(MemoryPoolMarkWorker));
+    thrd_t *const threads = MALLOC(workers * sizeof(thrd_t));
+    bool *const started = CALLOC(workers, sizeof(bool));
+    const bool spawn = arguments && threads && started;
+    atomic_store(&markers->active, spawn ? workers : 1);
+
+    MemoryPoolMarkWorker self = {markers, 0};
+    for (size_t i = 1; spawn && i < workers; ++i) {
+        arguments[i] = (MemoryPoolMarkWorker) {markers, i};
+        started[i] = thrd_create(&threads[i], memoryPoolMarkers_work, &arguments[i]) == thrd_success;
+        if (!started[i])
+            atomic_fetch_sub(&markers->active, 1);
+    }
+
+    memoryPoolMarkers_work(&self);
+    for (size_t i = 1; spawn && i < workers; ++i)
+        if (started[i])
+            thrd_join(threads[i], NULL);
+
+    FREE(arguments);
+    FREE(threads);
+    FREE(started);
+
+    if (!atomic_load(&markers->overflow))
+        return;
+
+    if (markers->bitmap)
+        memoryPool_move_marks_to_nodes(memoryPool);
+
+    memoryPool_complete_mark(memoryPool);
+}
+
+// ---------- Parallel Sweeping ----------
+/*
+ * A parallel sweep splits the pool into regions that are swept independently.
+ * Each region starts at a MemoryPoolNode with the region start flag, and free
+ * MemoryPoolNodes are never merged into the one in front of a region start,
+ * so the start of a region stays a MemoryPoolNode from one sweep to the next.
+ * Only compaction, copying and adding or releasing a segment change the
+ * MemoryPoolNodes in a way that invalidates the regions. The next sweep then
+ * runs serially and lays out the regions anew.
+ *
+ * Workers, one of which is the collecting thread, claim regions through an
+ * atomic counter. A region collects its free runs in a list of its own that
+ * is linked through the free list links. Once all workers are done, the
+ * collecting thread moves the runs of all regions into the free lists.
+ */
+enum { SWEEP_REGIONS_PER_WORKER = 8 };
+static const size_t MemoryPool_MinRegionSize = 1ULL << 16;
+
+typedef struct {
+    MemoryPoolNode *start;
+    MemoryPoolNode *freeRuns;
+} MemoryPoolSweepRegion;
+
+struct MemoryPoolSweepers {
+    size_t workers;
+    MemoryPoolSweepRegion *regions;
+    size_t regionCount;
+    size_t regionCapacity;
+    atomic_size_t nextRegion;
+    size_t regionSize;
+    size_t sinceRegionStart;
+    bool layoutFailed;
+};
+
+typedef struct {
+    MemoryPool const *memoryPool;
+    MemoryPoolSweepers *sweepers;
+} MemoryPoolSweepWorker;
+
+bool memoryPool_enable_parallel_sweep(MemoryPool *const memoryPool, const size_t workers) {
+    assert(!memoryPool->sweepers);
+    assert(workers > 0);
+
+    MemoryPoolSweepers *const sweepers = CALLOC(1, sizeof(MemoryPoolSweepers));
+    if (!sweepers)
+        return false;
+
+    sweepers->workers = workers;
+    memoryPool->sweepers = sweepers;
+    return true;
+}
+
+static void memoryPoolSweepers_free(MemoryPoolSweepers *const sweepers) {
+    FREE(sweepers->regions);
+    FREE(sweepers);
+}
+
+static void memoryPool_invalidate_regions(MemoryPool const *const memoryPool) {
+    if (memoryPool->sweepers)
+        memoryPool->sweepers->regionCount = 0;
+}
+
+static void memoryPoolSweepers_begin_layout(MemoryPool const *const memoryPool) {
+    MemoryPoolSweepers *const sweepers = memoryPool->sweepers;
+    const size_t size = memoryPool->size / (SWEEP_REGIONS_PER_WORKER * sweepers->workers);
+    sweepers->regionSize = size > MemoryPool_MinRegionSize ? size : MemoryPool_MinRegionSize;
+    sweepers->regionCount = 0;
+    sweepers->sinceRegionStart = SIZE_MAX;
+    sweepers->layoutFailed = false;
+}
+
+/*
+ * Called by a serial sweep for every MemoryPoolNode before it is swept. Starts
+ * a new region once the current one is large enough and ends the free run in
+ * front of it. Clears stale region start flags of all other MemoryPoolNodes.
+ */
+static MemoryPoolNode *memoryPoolSweepers_lay_out(MemoryPool *const memoryPool, MemoryPoolNode *run, MemoryPoolNode *const memoryPoolNode) {
+    MemoryPoolSweepers *const sweepers = memoryPool->sweepers;
+    const bool start = sweepers->sinceRegionStart >= sweepers->regionSize && !sweepers->layoutFailed;
+    memoryPoolNode_set_is_region_start(memoryPoolNode, start);
+    if (start) {
+        if (sweepers->regionCount == sweepers->regionCapacity) {
+            const size_t capacity = sweepers->regionCapacity ? 2 * sweepers->regionCapacity : DEFAULT_STACK_SIZE;
+            MemoryPoolSweepRegion *const regions = REALLOC(sweepers->regions, sweepers->regionCapacity * sizeof(MemoryPoolSweepRegion), capacity * sizeof(MemoryPoolSweepRegion));
+            if (!regions) {
+                sweepers->layoutFailed = true;
+                memoryPoolNode_set_is_region_start(memoryPoolNode, false);
+                return run;
+            }
+
+            sweepers->regions = regions;
+            sweepers->regionCapacity = capacity;
+        }
+
+        sweepers->regions[sweepers->regionCount++] = (MemoryPoolSweepRegion) {memoryPoolNode, NULL};
+        sweepers->sinceRegionStart = 0;
+        run = memoryPool_end_free_run(memoryPool, run);
+    }
+
+    sweepers->sinceRegionStart += sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    return run;
+}
+
+static MemoryPoolNode *memoryPoolSweepRegion_end_run(MemoryPool const *const memoryPool, MemoryPoolSweepRegion *const region, MemoryPoolNode *const run) {
+    if (run) {
+        memoryPool_release_pages(memoryPool, run);
+        memoryPoolNode_get_free_links(run)->next = region->freeRuns;
+        region->freeRuns = run;
+    }
+
+    return NULL;
+}
+
+static void memoryPoolSweepRegion_sweep(MemoryPool const *const memoryPool, MemoryPoolSweepRegion *const region, MemoryPoolNode const *const end) {
+    MemoryPoolNode *run = NULL;
+    region->freeRuns = NULL;
+    for (MemoryPoolNode *current = region->start; current != end;) {
+        MemoryPoolNode *const next = memoryPoolNode_get_next(current);
+        if (!memoryPool_sweep_is_free(memoryPool, current))
+            run = memoryPoolSweepRegion_end_run(memoryPool, region, run);
+        else if (run && memoryPoolNode_can_merge(run, current))
+            memoryPoolNode_merge(run, current);
+        else {
+            memoryPoolSweepRegion_end_run(memoryPool, region, run);
+            run = current;
+        }
+
+        current = next;
+    }
+
+    memoryPoolSweepRegion_end_run(memoryPool, region, run);
+}
+
+static int memoryPoolSweepers_work(void *const arg) {
+    MemoryPoolSweepWorker const *const worker = arg;
+    MemoryPoolSweepers *const sweepers = worker->sweepers;
+    size_t index;
+    while ((index = atomic_fetch_add(&sweepers->nextRegion, 1)) < sweepers->regionCount) {
+        MemoryPoolNode const *const end = index + 1 < sweepers->regionCount ? sweepers->regions[index + 1].start : NULL;
+        memoryPoolSweepRegion_sweep(worker->memoryPool, &sweepers->regions[index], end);
+    }
+
+    return 0;
+}
+
+static void memoryPool_sweep_parallel(MemoryPool *const memoryPool) {
+    MemoryPoolSweepers *const sweepers = memoryPool->sweepers;
+    const size_t workers = sweepers->workers;
+    atomic_store(&sweepers->nextRegion, 0);
+
+    MemoryPoolSweepWorker self = {memoryPool, sweepers};
+    thrd_t *const threads = MALLOC(workers * sizeof(thrd_t));
+    bool *const started = CALLOC(workers, sizeof(bool));
+    const bool spawn = threads && started;
+    for (size_t i = 1; spawn && i < workers; ++i)
+        started[i] = thrd_create(&threads[i], memoryPoolSweepers_work, &self) == thrd_success;
+
+    memoryPoolSweepers_work(&self);
+    for (size_t i = 1; spawn && i < workers; ++i)
+        if (started[i])
+            thrd_join(threads[i], NULL);
+
+    FREE(threads);
+    FREE(started);
+
+    for (size_t i = 0; i < sweepers->regionCount; ++i) {
+        MemoryPoolNode *run = sweepers->regions[i].freeRuns;
+        while (run) {
+            MemoryPoolNode *const next = memoryPoolNode_get_free_links(run)->next;
+            memoryPool_insert_free_node(memoryPool, run);
+            run = next;
+        }
+    }
+
+    memoryPool_end_mark_bitmap(memoryPool);
+}
+
+// ---------- Finalizers ----------
+/*
+ * With background finalizers a sweep does not call the FreeFn of a dead
+ * MemoryNode, but flags the MemoryNode and queues it as pending. The workers,
+ * or memoryPool_run_finalizers, call the FreeFn of pending MemoryNodes and
+ * then put them in the list of finalized MemoryNodes, which is linked through
+ * their second pointer. The mutator returns the finalized MemoryNodes to the
+ * pool when an allocation finds no free memory or when the next sweep starts.
+ * Till then every sweep skips them.
+ */
+struct MemoryPoolFinalizers {
+    FreeFn freeFn;
+    mtx_t lock;
+    cnd_t work;
+    cnd_t idle;
+    MemoryNodeStack pending;
+    MemoryNode *finalized;
+    size_t running;
+    bool stop;
+    size_t workers;
+    thrd_t threads[];
+};
+
+static MemoryNode **memoryNode_get_finalized_link(MemoryNode *const memoryNode) {
+    return (MemoryNode **) memoryNode + 1;
+}
+
+/*
+ * Calls the FreeFn of a pending MemoryNode. Must be called with the lock held,
+ * which is released while the FreeFn runs.
+ */
+static void memoryPoolFinalizers_finalize(MemoryPoolFinalizers *const finalizers, MemoryNode *const memoryNode) {
+    ++finalizers->running;
+    mtx_unlock(&finalizers->lock);
+    finalizers->freeFn(memoryNode_get_data(memoryNode));
+    mtx_lock(&finalizers->lock);
+
+    *memoryNode_get_finalized_link(memoryNode) = finalizers->finalized;
+    finalizers->finalized = memoryNode;
+    if (--finalizers->running == 0 && finalizers->pending.size == 0)
+        cnd_broadcast(&finalizers->idle);
+}
+
+static int memoryPoolFinalizers_work(void *const argument) {
+    MemoryPoolFinalizers *const finalizers = argument;
+    mtx_lock(&finalizers->lock);
+    for (;;) {
+        while (!finalizers->stop && finalizers->pending.size == 0)
+            cnd_wait(&finalizers->work, &finalizers->lock);
+
+        MemoryNode *const memoryNode = memoryNodeStack_pop(&finalizers->pending);
+        if (!memoryNode)
+            break;
+
+        memoryPoolFinalizers_finalize(finalizers, memoryNode);
+    }
+
+    mtx_unlock(&finalizers->lock);
+    return 0;
+}
+
+static void memoryPoolFinalizers_free(MemoryPoolFinalizers *const finalizers, const size_t started) {
+    mtx_lock(&finalizers->lock);
+    finalizers->stop = true;
+    cnd_broadcast(&finalizers->work);
+    mtx_unlock(&finalizers->lock);
+    for (size_t i = 0; i < started; ++i)
+        thrd_join(finalizers->threads[i], NULL);
+
+    cnd_destroy(&finalizers->idle);
+    cnd_destroy(&finalizers->work);
+    mtx_destroy(&finalizers->lock);
+    memoryNodeStack_free(&finalizers->pending);
+    FREE(finalizers);
+}
+
+bool memoryPool_enable_background_finalizers(MemoryPool *const memoryPool, const size_t workers) {
+    assert(!memoryPool->finalizers);
+
+    MemoryPoolFinalizers *const finalizers = CALLOC(1, sizeof(MemoryPoolFinalizers) + workers * sizeof(thrd_t));
+    if (!finalizers)
+        return false;
+
+    if (mtx_init(&finalizers->lock, mtx_plain) != thrd_success) {
+        FREE(finalizers);
+        return false;
+    }
+
+    if (cnd_init(&finalizers->work) != thrd_success) {
+        mtx_destroy(&finalizers->lock);
+        FREE(finalizers);
+        return false;
+    }
+
+    if (cnd_init(&finalizers->idle) != thrd_success) {
+        cnd_destroy(&finalizers->work);
+        mtx_destroy(&finalizers->lock);
+        FREE(finalizers);
+        return false;
+    }
+
+    finalizers->freeFn = memoryPool->freeFn;
+    finalizers->workers = workers;
+    for (size_t i = 0; i < workers; ++i) {
+        if (thrd_create(&finalizers->threads[i], memoryPoolFinalizers_work, finalizers) != thrd_success) {
+            memoryPoolFinalizers_free(finalizers, i);
+            return false;
+        }
+    }
+
+    memoryPool->finalizers = finalizers;
+    return true;
+}
+
+/*
+ * Queues a dead MemoryNode for a background finalizer. Returns false if the
+ * FreeFn has to be called right away instead.
+ */
+static bool memoryPool_defer_finalization(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    MemoryPoolFinalizers *const finalizers = memoryPool->finalizers;
+    if (!finalizers || !finalizers->freeFn)
+        return false;
+
+    memoryNode_set_is_finalizing(memoryNode, true);
+    mtx_lock(&finalizers->lock);
+    const bool queued = memoryNodeStack_push(&finalizers->pending, memoryNode);
+    mtx_unlock(&finalizers->lock);
+    if (!queued)
+        memoryNode_set_is_finalizing(memoryNode, false);
+
+    return queued;
+}
+
+/*
+ * Lets the workers finalize the MemoryNodes that have been queued. They are
+ * only woken once a sweep or a step of a lazy sweep is done, so that they do
+ * not compete with it for the processor.
+ */
+static void memoryPool_wake_finalizers(MemoryPool const *const memoryPool) {
+    MemoryPoolFinalizers *const finalizers = memoryPool->finalizers;
+    if (!finalizers)
+        return;
+
+    mtx_lock(&finalizers->lock);
+    if (finalizers->pending.size > 0)
+        cnd_broadcast(&finalizers->work);
+
+    mtx_unlock(&finalizers->lock);
+}
+
+/*
+ * Frees the MemoryPoolNodes of all finalized MemoryNodes and, if `insert` is
+ * set, puts them into the free lists. Returns whether there were any.
+ */
+static bool memoryPool_reclaim_finalized(MemoryPool *const memoryPool, const bool insert) {
+    MemoryPoolFinalizers *const finalizers = memoryPool->finalizers;
+    if (!finalizers)
+        return false;
+
+    mtx_lock(&finalizers->lock);
+    MemoryNode *memoryNode = finalizers->finalized;
+    finalizers->finalized = NULL;
+    mtx_unlock(&finalizers->lock);
+
+    const bool reclaimed = memoryNode;
+    while (memoryNode) {
+        MemoryNode *const next = *memoryNode_get_finalized_link(memoryNode);
+        MemoryPoolNode *const memoryPoolNode = memoryNode_get_memoryPoolNode(memoryNode);
+        memoryPoolNode_set_is_free(memoryPoolNode, true);
+        if (insert)
+            memoryPool_insert_free_node(memoryPool, memoryPoolNode);
+
+        memoryNode = next;
+    }
+
+    return reclaimed;
+}
+
+bool memoryPool_run_finalizers(MemoryPool *const memoryPool, const size_t budget) {
+    MemoryPoolFinalizers *const finalizers = memoryPool->finalizers;
+    if (!finalizers)
+        return false;
+
+    mtx_lock(&finalizers->lock);
+    MemoryNode *memoryNode;
+    for (size_t i = 0; i < budget && (memoryNode = memoryNodeStack_pop(&finalizers->pending)); ++i)
+        memoryPoolFinalizers_finalize(finalizers, memoryNode);
+
+    const bool left = finalizers->pending.size > 0 || finalizers->running > 0;
+    mtx_unlock(&finalizers->lock);
+
+    memoryPool_lock(memoryPool);
+    memoryPool_reclaim_finalized(memoryPool, !memoryPool->sweepCursor);
+    memoryPool_unlock(memoryPool);
+    return left;
+}
+
+/*
+ * Finalizes all pending MemoryNodes and returns them to the pool, so that no
+ * MemoryNode waits for a finalizer anymore.
+ */
+static void memoryPool_settle_finalizers(MemoryPool *const memoryPool) {
+    MemoryPoolFinalizers *const finalizers = memoryPool->finalizers;
+    if (!finalizers)
+        return;
+
+    memoryPool_run_finalizers(memoryPool, SIZE_MAX);
+    mtx_lock(&finalizers->lock);
+    while (finalizers->running > 0)
+        cnd_wait(&finalizers->idle, &finalizers->lock);
+
+    mtx_unlock(&finalizers->lock);
+    memoryPool_reclaim_finalized(memoryPool, !memoryPool->sweepCursor);
+}
+
+// ---------- Concurrent Marking ----------
+/*
+ * A concurrent collection marks the pool on a background thread while the
+ * mutators keep running, an incremental one in steps between which the
+ * mutator runs. It preserves the graph as it was at the start of the
+ * collection (snapshot at the beginning): Whenever memoryNode_setNeighbour
+ * overwrites a pointer to an unmarked MemoryNode of a marking pool, the old
+ * pointer is recorded, so the marker still visits everything that was
+ * reachable in the snapshot. MemoryNodes allocated during marking are marked
+ * right away.
+ *
+ * The marker only reads neighbour pointers, so the graph stays intact for the
+ * mutators. A marking pool knows the address ranges of its spaces and large
+ * objects as of the start of the collection, which tells the write barrier
+ * whether an overwritten MemoryNode belongs to it. Later memory only holds
+ * MemoryNodes that are marked anyway.
+ *
+ * There is no handshake with the mutators when the marking starts: a barrier
+ * that does not see the pool registered stores without recording the old
+ * pointer, and an allocation that does not see the marking leaves its
+ * MemoryNode white. So the start is a pause like the finish, in which no
+ * other thread may be inside the pool or memoryNode_setNeighbour, and the
+ * synchronisation that keeps them out is what makes them see the marking
+ * afterwards. In the thread safe mode the pool lock is held during the start,
+ * which orders it with every later slow path allocation and root change.
+ *
+ * The marker may still reach a MemoryNode that is released during marking,
+ * so such a MemoryNode is marked and only returned to the pool once the
+ * marking has finished.
+ *
+ * If a stack cannot grow, memoryPool_gc_finish marks the pool again from
+ * scratch.
+ */
+typedef struct {
+    char const *begin;
+    char const *end;
+} MemoryPoolRange;
+
+struct MemoryPoolMarking {
+    MemoryNodeStack grey;
+    mtx_t lock;
+    MemoryNodeStack snapshot;
+    atomic_bool overflow;
+    MemoryPoolRange *ranges;
+    size_t rangeCount;
+    MemoryNodeStack released;
+    bool concurrent;
+    thrd_t marker;
+    atomic_bool finishing;
+    MemoryPoolMarking *next;
+};
+
+static void memoryPool_gc_mark(MemoryPool *memoryPool);
+static void memoryPool_finish_sweep(MemoryPool *memoryPool);
+static void memoryPool_auto_gc_collected(MemoryPool const *memoryPool);
+static void memoryPool_release_node(MemoryPool *memoryPool, MemoryNode *memoryNode);
+
+static const struct timespec MARKER_IDLE_SLEEP = {.tv_sec = 0, .tv_nsec = 50000};
+
+static int memoryPoolRange_compare(void const *const first, void const *const second) {
+    char const *const a = ((MemoryPoolRange const *) first)->begin;
+    char const *const b = ((MemoryPoolRange const *) second)->begin;
+    return a < b ? -1 : a > b;
+}
+
+static bool memoryPoolMarking_collect_ranges(MemoryPool const *const memoryPool, MemoryPoolMarking *const marking) {
+    size_t count = 1;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next)
+        ++count;
+
+    for (MemoryPoolLargeObject const *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        ++count;
+
+    MemoryPoolRange *const ranges = MALLOC(count * sizeof(MemoryPoolRange));
+    if (!ranges)
+        return false;
+
+    size_t initialSize = memoryPool->size;
+    size_t i = 0;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next) {
+        ranges[i++] = (MemoryPoolRange) {(char const *) segment, (char const *) segment + segment->size};
+        initialSize -= segment->size;
+    }
+
+    for (MemoryPoolLargeObject const *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        ranges[i++] = (MemoryPoolRange) {(char const *) largeObject, (char const *) largeObject + largeObject->size};
+
+    char const *const initialSpace = (char const *) (memoryPool->growth ? memoryPool->growth->initialHead : memoryPool->head);
+    ranges[i++] = (MemoryPoolRange) {initialSpace, initialSpace + initialSize};
+
+    qsort(ranges, count, sizeof(MemoryPoolRange), memoryPoolRange_compare);
+    marking->ranges = ranges;
+    marking->rangeCount = count;
+    return true;
+}
+
+static bool memoryPoolMarking_contains(MemoryPoolMarking const *const marking, void const *const memory) {
+    size_t low = 0;
+    size_t high = marking->rangeCount;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if ((char const *) memory < marking->ranges[middle].begin)
+            high = middle;
+        else if ((char const *) memory >= marking->ranges[middle].end)
+            low = middle + 1;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Marks a MemoryNode and puts it on the grey stack, unless it already is
+ * marked.
+ */
+static void memoryPoolMarking_shade(MemoryPoolMarking *const marking, MemoryNode *const memoryNode) {
+    if (memoryNode && memoryNode_try_mark(memoryNode) && !memoryNodeStack_push(&marking->grey, memoryNode))
+        atomic_store(&marking->overflow, true);
+}
+
+static void memoryPool_snapshot_barrier(MemoryNode *const memoryNode, MemoryNode const *const neighbour, const uint16_t index) {
+    atomic_uintptr_t *const ptr = (atomic_uintptr_t *) memoryNode_ptr_to_neighbour_ptr(memoryNode, index);
+    uintptr_t old = atomic_load_explicit(ptr, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(ptr, &old, (uintptr_t) replace_ptr_bits((void *) old, neighbour), memory_order_release, memory_order_relaxed));
+
+    MemoryNode *const previous = extract_ptr_bits((void *) old);
+    if (!previous || memoryNode_is_marked(previous))
+        return;
+
+    mtx_lock(&barrier_lists_lock);
+    for (MemoryPoolMarking *marking = atomic_load_explicit(&marking_pools, memory_order_relaxed); marking; marking = marking->next) {
+        if (!memoryPoolMarking_contains(marking, previous))
+            continue;
+
+        mtx_lock(&marking->lock);
+        if (!memoryNodeStack_push(&marking->snapshot, previous))
+            atomic_store(&marking->overflow, true);
+        mtx_unlock(&marking->lock);
+        break;
+    }
+    mtx_unlock(&barrier_lists_lock);
+}
+
+/*
+ * Scans the neighbours of up to `budget` grey MemoryNodes and returns how many
+ * were scanned.
+ */
+static size_t memoryPoolMarking_step(MemoryPoolMarking *const marking, const size_t budget) {
+    size_t scanned = 0;
+    MemoryNode *memoryNode;
+    while (scanned < budget && (memoryNode = memoryNodeStack_pop(&marking->grey))) {
+        atomic_uintptr_t const *const first = memoryNode_atomic_neighbours(memoryNode);
+        const uint16_t count = extract_top_bits((void *) atomic_load_explicit(first, memory_order_acquire));
+        for (uint16_t i = 0; i < count; ++i) {
+            atomic_uintptr_t const *const ptr = (atomic_uintptr_t const *) memoryNode_ptr_to_neighbour_ptr(memoryNode, i);
+            memoryPoolMarking_shade(marking, extract_ptr_bits((void *) atomic_load_explicit(ptr, memory_order_acquire)));
+        }
+
+        ++scanned;
+    }
+
+    return scanned;
+}
+
+/*
+ * Shades the MemoryNodes recorded by the write barrier. Returns whether there
+ * were any.
+ */
+static bool memoryPoolMarking_drain_snapshot(MemoryPoolMarking *const marking) {
+    mtx_lock(&marking->lock);
+    MemoryNodeStack snapshot = marking->snapshot;
+    memset(&marking->snapshot, 0, sizeof(MemoryNodeStack));
+    mtx_unlock(&marking->lock);
+
+    const bool any = snapshot.size > 0;
+    MemoryNode *memoryNode;
+    while ((memoryNode = memoryNodeStack_pop(&snapshot)))
+        memoryPoolMarking_shade(marking, memoryNode);
+
+    memoryNodeStack_free(&snapshot);
+    return any;
+}
+
+static int memoryPoolMarking_run(void *const arg) {
+    MemoryPoolMarking *const marking = arg;
+    for (;;) {
+        if (memoryPoolMarking_step(marking, SIZE_MAX) || memoryPoolMarking_drain_snapshot(marking))
+            continue;
+
+        if (atomic_load(&marking->finishing))
+            return 0;
+
+        thrd_sleep(&MARKER_IDLE_SLEEP, NULL);
+    }
+}
+
+/*
+ * Marks the roots grey and registers the pool with the write barrier.
+ */
+static MemoryPoolMarking *memoryPool_start_marking(MemoryPool *const memoryPool) {
+    assert(!memoryPool->marking);
+    assert(!memoryPool->generations);
+    memoryPool_finish_sweep(memoryPool);
+
+    MemoryPoolMarking *const marking = CALLOC(1, sizeof(MemoryPoolMarking));
+    if (!marking)
+        return NULL;
+
+    if (mtx_init(&marking->lock, mtx_plain) != thrd_success) {
+        FREE(marking);
+        return NULL;
+    }
+
+    memoryPool_lock_exclusive(memoryPool);
+    if (!memoryPoolMarking_collect_ranges(memoryPool, marking) || !memoryPool_lock_barrier_lists()) {
+        memoryPool_unlock(memoryPool);
+        FREE(marking->ranges);
+        mtx_destroy(&marking->lock);
+        FREE(marking);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        memoryPoolMarking_shade(marking, memoryPool->rootSet[i]);
+
+    marking->next = atomic_load_explicit(&marking_pools, memory_order_relaxed);
+    atomic_store_explicit(&marking_pools, marking, memory_order_release);
+    memoryPool->marking = marking;
+    mtx_unlock(&barrier_lists_lock);
+    memoryPool_unlock(memoryPool);
+    return marking;
+}
+
+bool memoryPool_gc_start_concurrent(MemoryPool *const memoryPool) {
+    MemoryPoolMarking *const marking = memoryPool_start_marking(memoryPool);
+    if (!marking)
+        return false;
+
+    marking->concurrent = thrd_create(&marking->marker, memoryPoolMarking_run, marking) == thrd_success;
+    return true;
+}
+
+bool memoryPool_gc_start(MemoryPool *const memoryPool) {
+    return memoryPool_start_marking(memoryPool) != NULL;
+}
+
+bool memoryPool_gc_step(MemoryPool *const memoryPool, const size_t budget) {
+    MemoryPoolMarking *const marking = memoryPool->marking;
+    assert(marking && !marking->concurrent);
+
+    memoryPoolMarking_drain_snapshot(marking);
+    memoryPoolMarking_step(marking, budget);
+    return marking->grey.size > 0;
+}
+
+/*
+ * Finishes the marking in a stop-the-world pause and unregisters the pool
+ * from the write barrier.
+ */
+static void memoryPool_finish_marking(MemoryPool *const memoryPool) {
+    MemoryPoolMarking *const marking = memoryPool->marking;
+    if (marking->concurrent) {
+        atomic_store(&marking->finishing, true);
+        thrd_join(marking->marker, NULL);
+    }
+
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        memoryPoolMarking_shade(marking, memoryPool->rootSet[i]);
+
+    // Once the pool is unregistered, no barrier can record more MemoryNodes,
+    // so draining the snapshot afterwards does not miss any.
+    mtx_lock(&barrier_lists_lock);
+    if (atomic_load_explicit(&marking_pools, memory_order_relaxed) == marking) {
+        atomic_store_explicit(&marking_pools, marking->next, memory_order_release);
+    } else {
+        MemoryPoolMarking *previous = atomic_load_explicit(&marking_pools, memory_order_relaxed);
+        while (previous->next != marking)
+            previous = previous->next;
+        previous->next = marking->next;
+    }
+    mtx_unlock(&barrier_lists_lock);
+
+    while (memoryPoolMarking_step(marking, SIZE_MAX) || memoryPoolMarking_drain_snapshot(marking));
+
+    const bool overflow = atomic_load(&marking->overflow);
+    MemoryNodeStack released = marking->released;
+    memoryNodeStack_free(&marking->grey);
+    memoryNodeStack_free(&marking->snapshot);
+    mtx_destroy(&marking->lock);
+    FREE(marking->ranges);
+    FREE(marking);
+    memoryPool->marking = NULL;
+
+    if (overflow) {
+        for (MemoryPoolNode *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+            if (!memoryPoolNode_is_free(node))
+                memoryNode_set_is_marked(memoryPoolNode_get_data(node), false);
+
+        for (MemoryPoolLargeObject *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+            memoryNode_set_is_marked(memoryPoolLargeObject_get_node(largeObject), false);
+
+        memoryPool_gc_mark(memoryPool);
+    }
+
+    MemoryNode *memoryNode;
+    while ((memoryNode = memoryNodeStack_pop(&released)))
+        memoryPool_release_node(memoryPool, memoryNode);
+
+    memoryNodeStack_free(&released);
+}
+
+// ---------- Heap Walking ----------
+static bool memoryPool_visit_node(MemoryPool const *const memoryPool, MemoryPoolNode const *const memoryPoolNode, const MemoryPoolHeapSpace space, const MemoryPoolHeapVisitor visitor, void *const context) {
+    MemoryPoolHeapBlock block;
+    block.address = memoryPoolNode;
+    block.size = sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(memoryPoolNode);
+    block.space = space;
+    block.free = memoryPoolNode_is_free(memoryPoolNode);
+    block.memoryNode = block.free ? NULL : memoryPoolNode_get_data(memoryPoolNode);
+    block.marked = block.memoryNode && memoryPool_is_marked(memoryPool, block.memoryNode);
+    block.neighbourCount = block.memoryNode ? memoryNode_get_neighbour_count(block.memoryNode) : 0;
+    return visitor(&block, context);
+}
+
+bool memoryPool_walk_heap(MemoryPool const *const memoryPool, const MemoryPoolHeapVisitor visitor, void *const context) {
+    for (MemoryPoolNode const *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+        if (!memoryPool_visit_node(memoryPool, node, MemoryPoolHeapSpace_Pool, visitor, context))
+            return false;
+
+    MemoryPoolGenerations const *const generations = memoryPool->generations;
+    for (MemoryPoolNode const *node = generations ? memoryPoolGenerations_first(generations) : NULL; node; node = memoryPoolGenerations_next(generations, node))
+        if (!memoryPool_visit_node(memoryPool, node, MemoryPoolHeapSpace_Nursery, visitor, context))
+            return false;
+
+    for (MemoryPoolLargeObject const *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next) {
+        MemoryPoolHeapBlock block;
+        block.address = largeObject;
+        block.size = largeObject->size;
+        block.space = MemoryPoolHeapSpace_Large;
+        block.free = false;
+        block.memoryNode = memoryPoolLargeObject_get_node(largeObject);
+        block.marked = memoryNode_is_marked(block.memoryNode);
+        block.neighbourCount = memoryNode_get_neighbour_count(block.memoryNode);
+        if (!visitor(&block, context))
+            return false;
+    }
+
+    return true;
+}
+
+// ---------- Statistics ----------
+/*
+ * The counters are only updated if the pool has them, so a pool without
+ * statistics pays a branch per allocation and collection. The bytes a
+ * collection reclaims are the drop of the bytes in use across it, and a lazy
+ * sweep adds the bytes each of its steps frees.
+ */
+struct MemoryPoolStatsCounters {
+    size_t collections;
+    uint64_t markTime;
+    uint64_t sweepTime;
+    uint64_t pauseTime;
+    uint64_t lastPause;
+    uint64_t maxPause;
+    size_t pauseHistogram[MemoryPoolStats_PauseBuckets];
+    size_t reclaimedBytes;
+    atomic_size_t allocations;
+    atomic_size_t failedAllocations;
+};
+
+bool memoryPool_enable_stats(MemoryPool *const memoryPool) {
+    if (memoryPool->stats)
+        return true;
+
+    memoryPool->stats = CALLOC(1, sizeof(MemoryPoolStatsCounters));
+    return memoryPool->stats != NULL;
+}
+
+static uint64_t memoryPool_stats_now(MemoryPool const *const memoryPool) {
+    if (!memoryPool->stats)
+        return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/*
+ * The bytes in the pool, the nursery and the large object space that are not
+ * free.
+ */
+static size_t memoryPool_stats_used_bytes(MemoryPool const *const memoryPool) {
+    if (!memoryPool->stats)
+        return 0;
+
+    size_t used = memoryPool->size - memoryPool->freeBytes;
+    if (memoryPool->generations)
+        used += memoryPool->generations->nurseryTop - memoryPool->generations->nursery;
+
+    for (MemoryPoolLargeObject const *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        used += largeObject->size;
+
+    return used;
+}
+
+static void memoryPool_stats_reclaimed(MemoryPool const *const memoryPool, const size_t usedBefore) {
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    if (memoryPool->stats && used < usedBefore)
+        memoryPool->stats->reclaimedBytes += usedBefore - used;
+}
+
+/*
+ * Records a collection that started at `start`, finished marking at `marked`
+ * and had `usedBefore` bytes in use once the previous sweep was done.
+ */
+static void memoryPool_stats_collected(MemoryPool const *const memoryPool, const uint64_t start, const uint64_t marked, const size_t usedBefore) {
+    MemoryPoolStatsCounters *const stats = memoryPool->stats;
+    if (!stats)
+        return;
+
+    const uint64_t end = memoryPool_stats_now(memoryPool);
+    const uint64_t pause = end - start;
+    ++stats->collections;
+    stats->markTime += marked - start;
+    stats->sweepTime += end - marked;
+    stats->pauseTime += pause;
+    stats->lastPause = pause;
+    if (pause > stats->maxPause)
+        stats->maxPause = pause;
+
+    size_t bucket = 0;
+    for (uint64_t micros = pause / 1000; micros > 1 && bucket + 1 < MemoryPoolStats_PauseBuckets; micros >>= 1)
+        ++bucket;
+
+    ++stats->pauseHistogram[bucket];
+    memoryPool_stats_reclaimed(memoryPool, usedBefore);
+}
+
+static void memoryPool_stats_allocated(MemoryPool const *const memoryPool, const size_t count, const bool success) {
+    MemoryPoolStatsCounters *const stats = memoryPool->stats;
+    if (stats)
+        atomic_fetch_add_explicit(success ? &stats->allocations : &stats->failedAllocations, count, memory_order_relaxed);
+}
+
+static bool memoryPoolStats_visit(MemoryPoolHeapBlock const *const block, void *const context) {
+    MemoryPoolStats *const stats = context;
+    if (!block->free) {
+        ++stats->liveNodes;
+        stats->liveBytes += block->size;
+        return true;
+    }
+
+    ++stats->freeBlocks;
+    stats->freeBytes += block->size;
+    if (block->size - sizeof(MemoryPoolNode) > stats->largestFreeBlock)
+        stats->largestFreeBlock = block->size - sizeof(MemoryPoolNode);
+
+    return true;
+}
+
+void memoryPool_get_stats(MemoryPool const *const memoryPool, MemoryPoolStats *const stats) {
+    memset(stats, 0, sizeof(MemoryPoolStats));
+    MemoryPoolStatsCounters *const counters = memoryPool->stats;
+    if (counters) {
+        stats->collections = counters->collections;
+        stats->markTime = counters->markTime;
+        stats->sweepTime = counters->sweepTime;
+        stats->pauseTime = counters->pauseTime;
+        stats->lastPause = counters->lastPause;
+        stats->maxPause = counters->maxPause;
+        memcpy(stats->pauseHistogram, counters->pauseHistogram, sizeof(stats->pauseHistogram));
+        stats->reclaimedBytes = counters->reclaimedBytes;
+        stats->allocations = atomic_load_explicit(&counters->allocations, memory_order_relaxed);
+        stats->failedAllocations = atomic_load_explicit(&counters->failedAllocations, memory_order_relaxed);
+    }
+
+    memoryPool_walk_heap(memoryPool, memoryPoolStats_visit, stats);
+    stats->rootSetSize = memoryPool->rootSetSize;
+}
+
+// ---------- Allocation Sampling ----------
+/*
+ * The sampler counts down the bytes till the next sample. Every time the
+ * countdown runs out within an allocation, the allocation is attributed
+ * `interval` bytes and a new distance is drawn uniformly from 1 to twice the
+ * interval, so on average every byte is sampled with the same probability no
+ * matter how the allocations are sized. A sampled MemoryNode is followed
+ * through a handle, which every collection moves along with it or clears once
+ * it is dead. Dead samples are retired right after the handles are updated.
+ */
+typedef struct {
+    char const *tag;
+    void *frames[MemoryPoolAllocationSite_MaxFrames];
+    size_t frameCount;
+    size_t samples;
+    size_t allocatedBytes;
+    size_t survivingBytes;
+    size_t deaths;
+    uint64_t lifetime;
+} MemoryPoolSamplerSite;
+
+typedef struct {
+    MemoryNode **handle;
+    size_t site;
+    size_t weight;
+    uint64_t allocatedAt;
+} MemoryPoolSample;
+
+struct MemoryPoolSampler {
+    size_t interval;
+    int64_t countdown;
+    uint64_t allocated;
+    uint64_t random;
+    char const *tag;
+    MemoryPoolSamplerSite *sites;
+    size_t siteCount;
+    size_t siteCapacity;
+    MemoryPoolSample *samples;
+    size_t sampleCount;
+    size_t sampleCapacity;
+};
+
+static int64_t memoryPoolSampler_next_distance(MemoryPoolSampler *const sampler) {
+    // xorshift64*
+    sampler->random ^= sampler->random >> 12;
+    sampler->random ^= sampler->random << 25;
+    sampler->random ^= sampler->random >> 27;
+    return (int64_t) (1 + (sampler->random * 0x2545F4914F6CDD1DULL) % (2 * sampler->interval));
+}
+
+bool memoryPool_enable_sampling(MemoryPool *const memoryPool, const size_t interval) {
+    assert(!memoryPool->sampler);
+    assert(!memoryPool->threads);
+    assert(interval > 0);
+
+    MemoryPoolSampler *const sampler = CALLOC(1, sizeof(MemoryPoolSampler));
+    if (!sampler)
+        return false;
+
+    sampler->interval = interval;
+    sampler->random = 0x9E3779B97F4A7C15ULL ^ (uintptr_t) memoryPool;
+    sampler->countdown = memoryPoolSampler_next_distance(sampler);
+    memoryPool->sampler = sampler;
+    return true;
+}
+
+void memoryPool_set_allocation_site(MemoryPool *const memoryPool, char const *const tag) {
+    assert(memoryPool->sampler);
+    memoryPool->sampler->tag = tag;
+}
+
+static bool memoryPoolSamplerSite_matches(MemoryPoolSamplerSite const *const site, char const *const tag, void *const *const frames, const size_t frameCount) {
+    if (tag || site->tag)
+        return tag && site->tag && (tag == site->tag || strcmp(tag, site->tag) == 0);
+
+    return site->frameCount == frameCount && memcmp(site->frames, frames, frameCount * sizeof(void *)) == 0;
+}
+
+enum { MemoryPoolSampler_InternalFrames = 8 };
+
+/*
+ * Returns the index of the current allocation site, adding it if it was not
+ * sampled before, or SIZE_MAX if it could not be added. A backtrace starts at
+ * `caller`, the return address of the public allocation function, so it does
+ * not depend on what the compiler inlined. Sites are searched linearly, which
+ * is cheap next to the backtrace of a sample.
+ */
+static size_t memoryPoolSampler_current_site(MemoryPoolSampler *const sampler, void const *const caller) {
+    void *captured[MemoryPoolAllocationSite_MaxFrames + MemoryPoolSampler_InternalFrames];
+    void *const *frames = captured;
+    size_t frameCount = 0;
+    if (!sampler->tag) {
+        frameCount = (size_t) backtrace(captured, MemoryPoolAllocationSite_MaxFrames + MemoryPoolSampler_InternalFrames);
+        for (size_t i = 0; i < frameCount; ++i) {
+            if (captured[i] == caller) {
+                frames = captured + i;
+                frameCount -= i;
+                break;
+            }
+        }
+
+        if (frameCount > MemoryPoolAllocationSite_MaxFrames)
+            frameCount = MemoryPoolAllocationSite_MaxFrames;
+    }
+
+    for (size_t i = 0; i < sampler->siteCount; ++i)
+        if (memoryPoolSamplerSite_matches(&sampler->sites[i], sampler->tag, frames, frameCount))
+            return i;
+
+    if (sampler->siteCount == sampler->siteCapacity) {
+        const size_t capacity = sampler->siteCapacity ? 2 * sampler->siteCapacity : 16;
+        MemoryPoolSamplerSite *const sites = REALLOC(sampler->sites, sampler->siteCapacity * sizeof(MemoryPoolSamplerSite), capacity * sizeof(MemoryPoolSamplerSite));
+        if (!sites)
+            return SIZE_MAX;
+
+        sampler->sites = sites;
+        sampler->siteCapacity = capacity;
+    }
+
+    MemoryPoolSamplerSite *const site = &sampler->sites[sampler->siteCount];
+    memset(site, 0, sizeof(MemoryPoolSamplerSite));
+    site->tag = sampler->tag;
+    site->frameCount = frameCount;
+    memcpy(site->frames, frames, frameCount * sizeof(void *));
+    return sampler->siteCount++;
+}
+
+static void memoryPool_take_sample(MemoryPool *const memoryPool, MemoryNode *const memoryNode, const size_t weight, void const *const caller) {
+    MemoryPoolSampler *const sampler = memoryPool->sampler;
+    const size_t site = memoryPoolSampler_current_site(sampler, caller);
+    if (site == SIZE_MAX)
+        return;
+
+    sampler->sites[site].samples++;
+    sampler->sites[site].allocatedBytes += weight;
+    if (sampler->sampleCount == sampler->sampleCapacity) {
+        const size_t capacity = sampler->sampleCapacity ? 2 * sampler->sampleCapacity : 64;
+        MemoryPoolSample *const samples = REALLOC(sampler->samples, sampler->sampleCapacity * sizeof(MemoryPoolSample), capacity * sizeof(MemoryPoolSample));
+        if (!samples)
+            return;
+
+        sampler->samples = samples;
+        sampler->sampleCapacity = capacity;
+    }
+
+    MemoryNode **const handle = memoryPool_new_handle(memoryPool, memoryNode);
+    if (!handle)
+        return;
+
+    sampler->sites[site].survivingBytes += weight;
+    sampler->samples[sampler->sampleCount++] = (MemoryPoolSample) {handle, site, weight, sampler->allocated};
+}
+
+/*
+ * Counts an allocation of `size` bytes and samples it if the countdown runs
+ * out within it.
+ */
+static void memoryPool_sample_allocation(MemoryPool *const memoryPool, MemoryNode *const memoryNode, const size_t size, void const *const caller) {
+    MemoryPoolSampler *const sampler = memoryPool->sampler;
+    sampler->allocated += size;
+    if ((sampler->countdown -= (int64_t) size) > 0)
+        return;
+
+    size_t weight = 0;
+    while (sampler->countdown <= 0) {
+        weight += sampler->interval;
+        sampler->countdown += memoryPoolSampler_next_distance(sampler);
+    }
+
+    memoryPool_take_sample(memoryPool, memoryNode, weight, caller);
+}
+
+/*
+ * Retires the samples whose MemoryNode a collection found dead and hands their
+ * handles back.
+ */
+static void memoryPool_retire_samples(MemoryPool const *const memoryPool) {
+    MemoryPoolSampler *const sampler = memoryPool->sampler;
+    if (!sampler)
+        return;
+
+    MemoryPoolHandles *const handles = memoryPool->handles;
+    for (size_t i = 0; i < sampler->sampleCount;) {
+        MemoryPoolSample const sample = sampler->samples[i];
+        if (*sample.handle) {
+            ++i;
+            continue;
+        }
+
+        MemoryPoolSamplerSite *const site = &sampler->sites[sample.site];
+        site->survivingBytes -= sample.weight;
+        site->deaths++;
+        site->lifetime += sampler->allocated - sample.allocatedAt;
+
+        memoryPoolHandles_push(handles, sample.handle, sample.handle);
+        sampler->samples[i] = sampler->samples[--sampler->sampleCount];
+    }
+}
+
+/*
+ * MemoryNodes that are handed back without a collection, like those of a bulk
+ * allocation whose initialization failed, end their samples as well.
+ */
+static void memoryPool_release_samples(MemoryPool *const memoryPool, MemoryNode *const *const memoryNodes, const size_t count) {
+    MemoryPoolSampler *const sampler = memoryPool->sampler;
+    if (!sampler || !memoryPool->handles)
+        return;
+
+    bool released = false;
+    for (size_t i = 0; i < sampler->sampleCount; ++i) {
+        for (size_t j = 0; j < count; ++j) {
+            if (*sampler->samples[i].handle == memoryNodes[j]) {
+                *sampler->samples[i].handle = NULL;
+                released = true;
+            }
+        }
+    }
+
+    if (released)
+        memoryPool_retire_samples(memoryPool);
+}
+
+void memoryPool_report_allocation_sites(MemoryPool const *const memoryPool, const MemoryPoolSiteVisitor visitor, void *const context) {
+    MemoryPoolSampler const *const sampler = memoryPool->sampler;
+    for (size_t i = 0; sampler && i < sampler->siteCount; ++i) {
+        MemoryPoolSamplerSite const *const site = &sampler->sites[i];
+        MemoryPoolAllocationSite report;
+        report.tag = site->tag;
+        memcpy(report.frames, site->frames, sizeof(report.frames));
+        report.frameCount = site->frameCount;
+        report.samples = site->samples;
+        report.allocatedBytes = site->allocatedBytes;
+        report.survivingBytes = site->survivingBytes;
+        report.deaths = site->deaths;
+        report.averageLifetime = site->deaths ? site->lifetime / site->deaths : 0;
+        if (!visitor(&report, context))
+            return;
+    }
+}
+
+static void memoryPoolSampler_free(MemoryPoolSampler *const sampler) {
+    FREE(sampler->sites);
+    FREE(sampler->samples);
+    FREE(sampler);
+}
+
+// ---------- Memory Pool ----------
+static const size_t DEFAULT_ROOT_SET_SIZE = 8;
+
+MemoryPool memory_pool_new(const size_t pool_size, const FreeFn freeFn) {
+    return memory_pool_new_arena(pool_size, freeFn, MemoryPoolArena_Malloc);
+}
+
+MemoryPool memory_pool_new_arena(const size_t pool_size, const FreeFn freeFn, const MemoryPoolArena arena) {
+    return memory_pool_new_tracer(pool_size, freeFn, arena, MemoryPoolTracer_PointerReversal);
+}
+
+MemoryPool memory_pool_new_tracer(size_t pool_size, const FreeFn freeFn, const MemoryPoolArena arena, const MemoryPoolTracer tracer) {
+    assert(pool_size >= sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode);
+
+    pool_size = memoryPool_arena_round(arena, pool_size);
+    void *const space = memoryPool_arena_alloc(arena, pool_size);
+    void *const rootSet = MALLOC(DEFAULT_ROOT_SET_SIZE * PTR_SIZE);
+    void *const rootCounts = MALLOC(DEFAULT_ROOT_SET_SIZE * sizeof(size_t));
+    void *const rootIndex = CALLOC(DEFAULT_ROOT_SET_SIZE * 2, sizeof(size_t));
+
+    MemoryPool pool;
+    memset(&pool, 0, sizeof(MemoryPool));
+
+    if (!space || !rootSet || !rootCounts || !rootIndex) {
+        if (space)
+            memoryPool_arena_free(arena, space, pool_size);
+
+        FREE(rootSet);
+        FREE(rootCounts);
+        FREE(rootIndex);
+        return pool;
+    }
+
+    assert(((uintptr_t) space & 7) == 0);
+
+    MemoryPoolNode *last;
+    pool.head = memoryPool_add_space(&pool, space, pool_size, &last);
+    pool.size = pool_size;
+    pool.arena = arena;
+    pool.rootSet = rootSet;
+    pool.rootCounts = rootCounts;
+    pool.rootIndex = rootIndex;
+    pool.rootSetSize = 0;
+    pool.rootSetCapacity = DEFAULT_ROOT_SET_SIZE;
+    pool.freeFn = freeFn;
+    pool.tracer = tracer;
+    return pool;
+}
+
+void memoryPool_free(MemoryPool *const memoryPool) {
+    if (memoryPool->marking)
+        memoryPool_finish_marking(memoryPool);
+
+    if (memoryPool->finalizers) {
+        memoryPool_settle_finalizers(memoryPool);
+        memoryPoolFinalizers_free(memoryPool->finalizers, memoryPool->finalizers->workers);
+    }
+
+    if (memoryPool->generations)
+        memoryPoolGenerations_free(memoryPool->generations, memoryPool->freeFn);
+
+    if (memoryPool->threads)
+        memoryPoolThreads_free(memoryPool->threads);
+
+    if (memoryPool->handles)
+        memoryPoolHandles_free(memoryPool->handles);
+
+    if (memoryPool->markers)
+        memoryPoolMarkers_free(memoryPool->markers);
+
+    if (memoryPool->sweepers)
+        memoryPoolSweepers_free(memoryPool->sweepers);
+
+    if (memoryPool->markBitmap)
+        memoryPoolMarkBitmap_free(memoryPool->markBitmap);
+
+    FREE(memoryPool->autoGc);
+    FREE(memoryPool->stats);
+    if (memoryPool->sampler)
+        memoryPoolSampler_free(memoryPool->sampler);
+
+    while (memoryPool->largeObjects) {
+        if (memoryPool->freeFn)
+            memoryPool->freeFn(memoryNode_get_data(memoryPoolLargeObject_get_node(memoryPool->largeObjects)));
+
+        memoryPool_release_large(memoryPool, memoryPool->largeObjects);
+    }
+
+    if (memoryPool->freeFn) {
+        MemoryPoolNode *node = memoryPool->head;
+        while (node) {
+            if (!memoryPoolNode_is_free(node)) {
+                memoryPool->freeFn(memoryNode_get_data(memoryPoolNode_get_data(node)));
+            }
+
+            node = memoryPoolNode_get_next(node);
+        }
+    }
+
+    MemoryPoolNode *const initialHead = memoryPool->growth ? memoryPool->growth->initialHead : memoryPool->head;
+    if (memoryPool->growth)
+        memoryPoolGrowth_free(memoryPool);
+
+    FREE(memoryPool->rootSet);
+    FREE(memoryPool->rootCounts);
+    FREE(memoryPool->rootIndex);
+    memoryPool_arena_free(memoryPool->arena, initialHead, memoryPool->size);
+    memset(memoryPool, 0, sizeof(MemoryPool));
+}
+
+static size_t memoryPool_total_size(const size_t data_size, const size_t neighbours) {
+    const size_t memoryNode_size = sizeof(MemoryNode *) * (neighbours == 0 ? 1 : neighbours);
+    const size_t total_size = memoryNode_size + align_8(data_size);
+
+    // Every node needs to be able to hold the free list links once it is freed.
+    return total_size < MemoryPoolNode_MinMemoryPerNode ? MemoryPoolNode_MinMemoryPerNode : total_size;
+}
+
+static MemoryNode *memoryPool_alloc_white(MemoryPool *const memoryPool, const size_t data_size, const size_t neighbours) {
+    const size_t total_size = memoryPool_total_size(data_size, neighbours);
+    if (total_size > MemoryPoolNode_MaxMemoryPerNode)
+        return memoryPool_alloc_large(memoryPool, total_size, neighbours);
+
+    if (memoryPool->generations) {
+        MemoryNode *const young = memoryPoolGenerations_alloc(memoryPool->generations, total_size, neighbours);
+        if (young)
+            return young;
+    }
+
+    MemoryPoolNode *const head = memoryPool->threads ? memoryPoolThreads_alloc(memoryPool, total_size) : memoryPool_alloc_node(memoryPool, total_size);
+    if (!head)
+        return NULL;
+
+    MemoryNode *const memoryNode = memoryNode_new(memoryPoolNode_get_data(head), neighbours);
+    return memoryNode;
+}
+
+static bool memoryPool_auto_collect(MemoryPool *memoryPool, size_t size, bool failed);
+
+MemoryNode *memoryPool_alloc(MemoryPool *const memoryPool, const size_t data_size, const size_t neighbours) {
+    assert(neighbours < 1ULL << 16);
+    const size_t size = sizeof(MemoryPoolNode) + memoryPool_total_size(data_size, neighbours);
+    memoryPool_auto_collect(memoryPool, size, false);
+    MemoryNode *memoryNode = memoryPool_alloc_white(memoryPool, data_size, neighbours);
+    if (!memoryNode && memoryPool_auto_collect(memoryPool, size, true))
+        memoryNode = memoryPool_alloc_white(memoryPool, data_size, neighbours);
+
+    memoryPool_stats_allocated(memoryPool, 1, memoryNode != NULL);
+    if (memoryNode && memoryPool->sampler)
+        memoryPool_sample_allocation(memoryPool, memoryNode, size, __builtin_return_address(0));
+
+    // MemoryNodes that are allocated while the pool is marked are not part of
+    // the snapshot and are kept alive.
+    if (memoryNode && memoryPool->marking)
+        memoryNode_set_is_marked(memoryNode, true);
+
+    return memoryNode;
+}
+
+static bool memoryPool_is_swept(MemoryPool const *memoryPool, MemoryPoolNode const *memoryPoolNode);
+
+static void memoryPool_release_node(MemoryPool *const memoryPool, MemoryNode *const memoryNode) {
+    // A MemoryNode that cannot be recorded stays allocated and is collected
+    // like garbage later on.
+    if (memoryPool->marking) {
+        memoryNode_try_mark(memoryNode);
+        memoryNodeStack_push(&memoryPool->marking->released, memoryNode);
+        return;
+    }
+
+    if (memoryNode_is_large(memoryNode))
+        return memoryPool_release_large(memoryPool, memoryNode_get_large_object(memoryNode));
+
+    MemoryPoolNode *const memoryPoolNode = memoryNode_get_memoryPoolNode(memoryNode);
+    memoryPoolNode_set_is_free(memoryPoolNode, true);
+    if (memoryPool->generations && memoryPoolGenerations_is_young(memoryPool->generations, memoryNode))
+        return;
+
+    // A lazy sweep that is still outstanding puts the free MemoryPoolNodes
+    // from its cursor on into the free lists itself.
+    if (memoryPool_is_swept(memoryPool, memoryPoolNode))
+        memoryPool_insert_free_node(memoryPool, memoryPoolNode);
+}
+
+void memoryPool_release_nodes(MemoryPool *const memoryPool, MemoryNode *const *const memoryNodes, const size_t count) {
+    memoryPool_release_samples(memoryPool, memoryNodes, count);
+    memoryPool_lock(memoryPool);
+    for (size_t i = 0; i < count; ++i)
+        memoryPool_release_node(memoryPool, memoryNodes[i]);
+
+    memoryPool_unlock(memoryPool);
+}
+
+/*
+ * Carves the MemoryNodes out of as few free MemoryPoolNodes as possible.
+ * Preferably a single free MemoryPoolNode holds all of them, otherwise the
+ * largest free MemoryPoolNodes are used one after the other.
+ */
+static bool memoryPool_alloc_bulk_white(MemoryPool *const memoryPool, const size_t count, const size_t data_size, const size_t neighbours, MemoryNode **const out) {
+    const size_t total_size = memoryPool_total_size(data_size, neighbours);
+    if (total_size > MemoryPoolNode_MaxMemoryPerNode) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!(out[i] = memoryPool_alloc_large(memoryPool, total_size, neighbours))) {
+                memoryPool_release_nodes(memoryPool, out, i);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    if (memoryPool->generations && memoryPoolGenerations_alloc_bulk(memoryPool->generations, count, total_size, neighbours, out))
+        return true;
+
+    memoryPool_lock(memoryPool);
+    size_t allocated = 0;
+    while (allocated < count) {
+        const size_t needed = (count - allocated) * (sizeof(MemoryPoolNode) + total_size) - sizeof(MemoryPoolNode);
+        MemoryPoolNode *rest = memoryPool_find_free_node(memoryPool, needed < MemoryPoolNode_MaxMemoryPerNode ? needed : MemoryPoolNode_MaxMemoryPerNode);
+        if (!rest)
+            rest = memoryPool_find_largest_free_node(memoryPool);
+
+        if ((!rest || memoryPoolNode_get_free_space(rest) < total_size) && memoryPool_sweep_lazily(memoryPool, total_size))
+            continue;
+
+        if ((!rest || memoryPoolNode_get_free_space(rest) < total_size) && memoryPool_grow(memoryPool, needed < MemoryPoolNode_MaxMemoryPerNode ? needed : MemoryPoolNode_MaxMemoryPerNode))
+            continue;
+
+        if (!rest || memoryPoolNode_get_free_space(rest) < total_size)
+            break;
+
+        memoryPool_remove_free_node(memoryPool, rest);
+        MemoryPoolNode *node;
+        while (allocated < count && (node = memoryPool_carve(&rest, total_size)))
+            out[allocated++] = memoryNode_new(memoryPoolNode_get_data(node), neighbours);
+
+        if (rest)
+            memoryPool_insert_free_node(memoryPool, rest);
+    }
+
+    if (allocated < count) {
+        for (size_t i = 0; i < allocated; ++i)
+            memoryPool_release_node(memoryPool, out[i]);
+    }
+
+    memoryPool_unlock(memoryPool);
+    return allocated == count;
+}
+
+bool memoryPool_alloc_bulk(MemoryPool *const memoryPool, const size_t count, const size_t data_size, const size_t neighbours, MemoryNode **const out) {
+    const size_t size = count * (sizeof(MemoryPoolNode) + memoryPool_total_size(data_size, neighbours));
+    memoryPool_auto_collect(memoryPool, size, false);
+    const bool success = memoryPool_alloc_bulk_white(memoryPool, count, data_size, neighbours, out)
+            || (memoryPool_auto_collect(memoryPool, size, true) && memoryPool_alloc_bulk_white(memoryPool, count, data_size, neighbours, out));
+    memoryPool_stats_allocated(memoryPool, count, success);
+    if (!success)
+        return false;
+
+    for (size_t i = 0; memoryPool->sampler && i < count; ++i)
+        memoryPool_sample_allocation(memoryPool, out[i], size / count, __builtin_return_address(0));
+
+    for (size_t i = 0; memoryPool->marking && i < count; ++i)
+        memoryNode_set_is_marked(out[i], true);
+
+    return true;
+}
+
+/*
+ * Every root is in the root set once, no matter how often it was added. The
+ * root index is an open addressing hash table with linear probing, twice as
+ * large as the root set, that maps each root to its position in the root set
+ * plus one, 0 marking an empty entry. rootCounts holds how often each root
+ * was added. The index has to be rebuilt whenever the roots are moved.
+ */
+static size_t memoryPool_root_index_capacity(MemoryPool const *const memoryPool) {
+    return memoryPool->rootSetCapacity * 2;
+}
+
+static size_t memoryPool_root_hash(MemoryPool const *const memoryPool, MemoryNode const *const memoryNode) {
+    return (size_t) (((uintptr_t) memoryNode >> 3) * 0x9E3779B97F4A7C15ULL) & (memoryPool_root_index_capacity(memoryPool) - 1);
+}
+
+/*
+ * Returns the entry of the root index that refers to `memoryNode`, or the empty
+ * entry where it would have to be inserted.
+ */
+static size_t *memoryPool_find_root(MemoryPool const *const memoryPool, MemoryNode const *const memoryNode) {
+    const size_t mask = memoryPool_root_index_capacity(memoryPool) - 1;
+    for (size_t i = memoryPool_root_hash(memoryPool, memoryNode);; i = (i + 1) & mask) {
+        size_t *const entry = &memoryPool->rootIndex[i];
+        if (!*entry || memoryPool->rootSet[*entry - 1] == memoryNode)
+            return entry;
+    }
+}
+
+static void memoryPool_rebuild_root_index(MemoryPool const *const memoryPool) {
+    memset(memoryPool->rootIndex, 0, memoryPool_root_index_capacity(memoryPool) * sizeof(size_t));
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        *memoryPool_find_root(memoryPool, memoryPool->rootSet[i]) = i + 1;
+}
+
+/*
+ * Empties an entry of the root index and moves the entries of the same probe
+ * sequence behind it forward, so that lookups never need tombstones.
+ */
+static void memoryPool_remove_root_entry(MemoryPool const *const memoryPool, size_t *const entry) {
+    const size_t mask = memoryPool_root_index_capacity(memoryPool) - 1;
+    size_t hole = (size_t) (entry - memoryPool->rootIndex);
+    memoryPool->rootIndex[hole] = 0;
+    for (size_t i = (hole + 1) & mask; memoryPool->rootIndex[i]; i = (i + 1) & mask) {
+        const size_t home = memoryPool_root_hash(memoryPool, memoryPool->rootSet[memoryPool->rootIndex[i] - 1]);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            memoryPool->rootIndex[hole] = memoryPool->rootIndex[i];
+            memoryPool->rootIndex[i] = 0;
+            hole = i;
+        }
+    }
+}
+
+static bool memoryPool_grow_root_set(MemoryPool *const memoryPool) {
+    const size_t capacity = memoryPool->rootSetCapacity;
+    MemoryNode **const newSet = REALLOC(memoryPool->rootSet, capacity * PTR_SIZE, capacity * PTR_SIZE * 2);
+    if (!newSet)
+        return false;
+
+    memoryPool->rootSet = newSet;
+    size_t *const newCounts = REALLOC(memoryPool->rootCounts, capacity * sizeof(size_t), capacity * sizeof(size_t) * 2);
+    if (!newCounts)
+        return false;
+
+    memoryPool->rootCounts = newCounts;
+    size_t *const newIndex = MALLOC(capacity * 4 * sizeof(size_t));
+    if (!newIndex)
+        return false;
+
+    FREE(memoryPool->rootIndex);
+    memoryPool->rootIndex = newIndex;
+    memoryPool->rootSetCapacity = capacity * 2;
+    memoryPool_rebuild_root_index(memoryPool);
+    return true;
+}
+
+bool memoryPool_add_root_node(MemoryPool *const memoryPool, MemoryNode *const memoryNode) {
+    memoryPool_lock(memoryPool);
+    size_t *entry = memoryPool_find_root(memoryPool, memoryNode);
+    if (*entry) {
+        ++memoryPool->rootCounts[*entry - 1];
+        memoryPool_unlock(memoryPool);
+        return true;
+    }
+
+    if (memoryPool->rootSetSize == memoryPool->rootSetCapacity) {
+        if (!memoryPool_grow_root_set(memoryPool)) {
+            memoryPool_unlock(memoryPool);
+            return false;
+        }
+
+        entry = memoryPool_find_root(memoryPool, memoryNode);
+    }
+
+    memoryPool->rootCounts[memoryPool->rootSetSize] = 1;
+    memoryPool->rootSet[memoryPool->rootSetSize++] = memoryNode;
+    *entry = memoryPool->rootSetSize;
+    memoryPool_unlock(memoryPool);
+    return true;
+}
+
+bool memoryPool_remove_root_node(MemoryPool *const memoryPool, MemoryNode const *const memoryNode) {
+    memoryPool_lock(memoryPool);
+    size_t *const entry = memoryPool_find_root(memoryPool, memoryNode);
+    if (!*entry) {
+        memoryPool_unlock(memoryPool);
+        return false;
+    }
+
+    const size_t slot = *entry - 1;
+    if (--memoryPool->rootCounts[slot] == 0) {
+        memoryPool_remove_root_entry(memoryPool, entry);
+        const size_t last = --memoryPool->rootSetSize;
+        if (slot != last) {
+            memoryPool->rootSet[slot] = memoryPool->rootSet[last];
+            memoryPool->rootCounts[slot] = memoryPool->rootCounts[last];
+            *memoryPool_find_root(memoryPool, memoryPool->rootSet[slot]) = slot + 1;
+        }
+    }
+
+    memoryPool_unlock(memoryPool);
+    return true;
+}
+
+/*
+ * An implementation of an iterative Depth-first Search algorithm that marks all
+ * nodes it encounters and applies to each node for_each function the first time
+ * the node is found.
+ *
+ * The search uses a technique called pointer reversal to reduce the amount of
+ * bookkeeping memory needed. The algorithm is complicated by the fact that the
+ * counter of MemoryNode is only available for Memory nodes that have two more
+ * neighbours. The BACK_OFF and FORWARD macros contain the code that is needed
+ * to work around this limitation: If a node has no neighbours no counter is
+ * needed because the search cannot continue past this node. If a node only has
+ * one neighbour, then we only need to know whether we already continued the
+ * search past that node. We can memorize this by always moving past nodes that
+ * have only one neighbour till we find a node which has more than one
+ * neighbour. If no such node exists, meaning if the search gets stuck in a node
+ * that has no neighbours at all, than we need to back off past the node with
+ * only one neighbour, from which the forward search originally started.
+ */
+void memoryPool_dfs(MemoryNode *current, void (*const for_each)(MemoryNode const *)) {
+
+#define BACK_OFF                                                                \
+    /*                                                                          \
+     * Move backwards till we find a node with more than one neighbour.         \
+     *  Invariant: We have visited all neighbours of the current node.          \
+     */                                                                         \
+    while (true) {                                                              \
+        next = current;                                                         \
+        current = previous;                                                     \
+        if (!current)                                                           \
+            break;                                                              \
+                                                                                \
+        const uint16_t preNeighbours = memoryNode_get_neighbour_count(current); \
+        if(preNeighbours >= 2) {                                                \
+            const uint16_t counter = memoryNode_get_counter(current);           \
+            previous = memoryNode_getNeighbour(current, counter);               \
+            memoryNode_set_neighbour_ptr(current, next, counter);               \
+            memoryNode_inc_counter(current);                                    \
+            break;                                                              \
+        }                                                                       \
+                                                                                \
+        previous = memoryNode_getNeighbour(current, 0);                         \
+        memoryNode_set_neighbour_ptr(current, next, 0);                         \
+    }
+
+#define FORWARD                                                                 \
+    /*                                                                          \
+     * Move forward till there is a node with more than one neighbour.          \
+     * If no such node is found, back off.                                      \
+     * Invariant: The current node refers to a node that has only one neighbour.\
+     */                                                                         \
+    while (true) {                                                              \
+        next = memoryNode_getNeighbour(current, 0);                             \
+        if (!next || memoryNode_is_marked(next)) {                              \
+            BACK_OFF                                                            \
+            break;                                                              \
+        }                                                                       \
+                                                                                \
+        memoryNode_set_is_marked(next, true);                                   \
+        if (for_each)                                                           \
+            for_each(next);                                                     \
+                                                                                \
+        const int neighbours = memoryNode_get_neighbour_count(next);            \
+        if (neighbours == 0) {                                                  \
+            BACK_OFF                                                            \
+            break;                                                              \
+        }                                                                       \
+                                                                                \
+        memoryNode_set_neighbour_ptr(current, previous, 0);                     \
+        previous = current;                                                     \
+        current = next;                                                         \
+        if (neighbours >= 2) {                                                  \
+            break;                                                              \
+        }                                                                       \
+    }
+
+    if (!current || memoryNode_is_marked(current))
+        return;
+
+    if (for_each)
+        for_each(current);
+
+    memoryNode_set_is_marked(current, true);
+
+    const uint16_t neighbours = memoryNode_get_neighbour_count(current);
+    if (neighbours == 0)
+        return;
+
+    MemoryNode *previous = NULL, *next = NULL;
+    if (neighbours == 1) {
+        FORWARD
+    }
+
+    /*
+     * Visits all neighbours of the current node in a depth-first search manner.
+     * Invariant: The current node has more than one neighbour. The first
+     * counter(current) neighbours of current have already been visited.
+     */
+    while (current != NULL) {
+        const uint16_t neighbours = memoryNode_get_neighbour_count(current);
+        assert(neighbours >= 2);
+
+        const uint16_t counter = memoryNode_get_counter(current);
+        if (counter == neighbours) {
+            memoryNode_reset_counter(current);
+            BACK_OFF
+            continue;
+        }
+
+        next = memoryNode_getNeighbour(current, counter);
+        if (!next || memoryNode_is_marked(next)) {
+            memoryNode_inc_counter(current);
+            continue;
+        }
+
+        memoryNode_set_is_marked(next, true);
+        if (for_each)
+            for_each(next);
+
+        const uint16_t next_neighbours = memoryNode_get_neighbour_count(next);
+        if (next_neighbours == 0) {
+            memoryNode_inc_counter(current);
+            continue;
+        }
+
+        memoryNode_set_neighbour_ptr(current, previous, counter);
+        previous = current;
+        current = next;
+
+        if (next_neighbours >= 2)
+            continue;
 
-    MemoryNode *previous = NULL, *next = NULL;
-    if (neighbours == 1) {
         FORWARD
     }
 
-    /*
-     * Visits all neighbours of the current node in a depth-first search manner.
-     * Invariant: The current node has more than one neighbour. The first
-     * counter(current) neighbours of current have already been visited.
-     */
-    while (current != NULL) {
-        const uint16_t neighbours = memoryNode_get_neighbour_count(current);
-        assert(neighbours >= 2);
+#undef FORWARD
+#undef BACK_OFF
+}
+
+static const size_t MemoryPool_MarkStackCapacity = 1ULL << 14;
+enum { MemoryPool_PrefetchDistance = 8 };
+
+/*
+ * Marks everything reachable from the roots with an explicit mark stack. A
+ * MemoryNode is only marked once it is popped, so pushing does not have to
+ * load it until the stack is half full. Popped MemoryNodes are prefetched and
+ * wait in a small ring buffer for MemoryPool_PrefetchDistance more pops before
+ * they are scanned, by which time their header and neighbours are in the
+ * cache. MemoryNodes that do not fit on the full stack are marked right away
+ * by memoryPool_dfs, which stops at every marked MemoryNode and therefore
+ * leaves the rest of the search to the stack. Returns false if the stack could
+ * not be allocated.
+ */
+static bool memoryPool_mark_with_stack(MemoryPool const *const memoryPool) {
+    MemoryNode **const stack = MALLOC(MemoryPool_MarkStackCapacity * PTR_SIZE);
+    if (!stack)
+        return false;
+
+    size_t size = 0;
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i) {
+        if (size < MemoryPool_MarkStackCapacity)
+            stack[size++] = memoryPool->rootSet[i];
+        else
+            memoryPool_dfs(memoryPool->rootSet[i], NULL);
+    }
+
+    MemoryNode *ring[MemoryPool_PrefetchDistance] = {NULL};
+    size_t slot = 0;
+    size_t pending = 0;
+    while (size || pending) {
+        MemoryNode *const popped = size ? stack[--size] : NULL;
+        if (popped) {
+            __builtin_prefetch(popped, 1);
+            ++pending;
+        }
+
+        MemoryNode *const current = ring[slot];
+        ring[slot] = popped;
+        slot = (slot + 1) % MemoryPool_PrefetchDistance;
+        if (!current)
+            continue;
+
+        --pending;
+        if (memoryNode_is_marked(current))
+            continue;
+
+        memoryNode_set_is_marked(current, true);
+        const uint16_t neighbours = memoryNode_get_neighbour_count(current);
+        for (uint16_t i = 0; i < neighbours; ++i) {
+            // Back edges and shared MemoryNodes would otherwise fill the
+            // stack with MemoryNodes that are already marked. Checking costs a
+            // cache miss, so it is only done once the stack is half full. A
+            // MemoryNode that is pushed twice before it is marked is skipped
+            // when it is popped again.
+            MemoryNode *const neighbour = memoryNode_getNeighbour(current, i);
+            if (!neighbour || (size >= MemoryPool_MarkStackCapacity / 2 && memoryNode_is_marked(neighbour)))
+                continue;
+
+            if (size < MemoryPool_MarkStackCapacity)
+                stack[size++] = neighbour;
+            else
+                memoryPool_dfs(neighbour, NULL);
+        }
+    }
+
+    FREE(stack);
+    return true;
+}
+
+static void memoryPool_gc_mark(MemoryPool *const memoryPool) {
+    if (memoryPool->markers)
+        return memoryPool_gc_mark_parallel(memoryPool);
+
+    if (memoryPool->tracer == MemoryPoolTracer_MarkStack && memoryPool_mark_with_stack(memoryPool))
+        return;
+
+    const size_t rootSetSize = memoryPool->rootSetSize;
+    for (int i = 0; i < rootSetSize; ++i)
+        memoryPool_dfs(memoryPool->rootSet[i], NULL);
+}
+
+
+/*
+ * Frees a MemoryPoolNode if it holds an unmarked MemoryNode and clears the mark
+ * otherwise. Returns the free run that continues behind it.
+ */
+static MemoryPoolNode *memoryPool_sweep_node(MemoryPool *const memoryPool, MemoryPoolNode *const run, MemoryPoolNode *const memoryPoolNode) {
+    if (memoryPool_sweep_is_free(memoryPool, memoryPoolNode))
+        return memoryPool_coalesce_free_node(memoryPool, run, memoryPoolNode);
+
+    return memoryPool_end_free_run(memoryPool, run);
+}
+
+/*
+ * Frees all unmarked MemoryNodes and rebuilds the free lists from scratch, so
+ * that the lists afterwards contain every free MemoryPoolNode in the pool.
+ * Physically adjacent free MemoryPoolNodes are coalesced on the way. In lazy
+ * mode only the large objects are swept right away.
+ */
+static void memoryPool_gc_sweep(MemoryPool *const memoryPool) {
+    memoryPool_retire_tlabs(memoryPool);
+    memoryPool_clear_free_lists(memoryPool);
+    memoryPool_reclaim_finalized(memoryPool, false);
+    memoryPool_sweep_large_objects(memoryPool);
+
+    if (memoryPool->lazySweep) {
+        memoryPool->sweepCursor = memoryPool->head;
+        memoryPool->sweepRun = NULL;
+        return;
+    }
+
+    MemoryPoolSweepers *const sweepers = memoryPool->sweepers;
+    if (sweepers && sweepers->regionCount > 0)
+        return memoryPool_sweep_parallel(memoryPool);
+
+    if (sweepers)
+        memoryPoolSweepers_begin_layout(memoryPool);
+
+    // With the marks in the bitmap and no FreeFn, the garbage in front of the
+    // next marked MemoryNode does not need to be looked at.
+    MemoryPoolMarkBitmap const *const bitmap = memoryPool->markBitmap;
+    const bool skip = bitmap && bitmap->active && !memoryPool->freeFn && !sweepers;
+
+    MemoryPoolNode *run = NULL;
+    for (MemoryPoolNode *current = memoryPool->head; current;) {
+        MemoryPoolNode *next = memoryPoolNode_get_next(current);
+        if (skip && !memoryPool_is_marked(memoryPool, memoryPoolNode_get_data(current))) {
+            MemoryPoolNode *const marked = memoryPool_next_marked_node(memoryPool, current);
+            if (marked && marked != next) {
+                run = memoryPool_sweep_range(memoryPool, run, current, marked);
+                current = marked;
+                continue;
+            }
+        }
+
+        if (sweepers)
+            run = memoryPoolSweepers_lay_out(memoryPool, run, current);
+
+        run = memoryPool_sweep_node(memoryPool, run, current);
+        current = next;
+    }
+
+    memoryPool_end_free_run(memoryPool, run);
+    memoryPool_end_mark_bitmap(memoryPool);
+    if (sweepers && sweepers->layoutFailed)
+        sweepers->regionCount = 0;
+}
+
+// ---------- Lazy Sweeping ----------
+/*
+ * After a collection in lazy mode the free lists start out empty, and a cursor
+ * walks the pool as allocations need free memory. Every MemoryPoolNode in
+ * front of the cursor has been swept, the ones from the cursor on still carry
+ * the marks of the collection. The run of free MemoryPoolNodes that ends right
+ * in front of the cursor is not yet in the free lists, so it can still grow
+ * across calls.
+ *
+ * Allocations only take memory from the free lists, and new segments are put
+ * in front of the list of all MemoryPoolNodes, so nothing behind the cursor
+ * changes while the sweep is outstanding. Whatever needs marks to be clear or
+ * walks the whole pool finishes the sweep first.
+ */
+void memoryPool_enable_lazy_sweep(MemoryPool *const memoryPool) {
+    assert(memoryPool->placement != MemoryPoolPlacement_NextFit);
+    memoryPool->lazySweep = true;
+}
+
+/*
+ * Sweeps from the cursor on till a free MemoryPoolNode of at least `size`
+ * bytes has been added to the free lists or till the end of the pool. Returns
+ * false if there was nothing left to sweep.
+ */
+static bool memoryPool_sweep_lazily(MemoryPool *const memoryPool, const size_t size) {
+    MemoryPoolNode *current = memoryPool->sweepCursor;
+    if (!current)
+        return false;
+
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    MemoryPoolNode *run = memoryPool->sweepRun;
+    while (current) {
+        MemoryPoolNode *const next = memoryPoolNode_get_next(current);
+        MemoryPoolNode *const previousRun = run;
+        run = memoryPool_sweep_node(memoryPool, run, current);
+        current = next;
+
+        // A run that is replaced has been added to the free lists.
+        if (previousRun && run != previousRun && memoryPoolNode_get_free_space(previousRun) >= size)
+            break;
+    }
+
+    memoryPool->sweepCursor = current;
+    memoryPool->sweepRun = current ? run : memoryPool_end_free_run(memoryPool, run);
+    if (!current)
+        memoryPool_end_mark_bitmap(memoryPool);
+
+    // The rests of TLABs are free, but not in the free lists.
+    if (!current && !memoryPool->threads)
+        memoryPool_release_empty_segments(memoryPool);
+
+    if (!current)
+        memoryPool_auto_gc_collected(memoryPool);
+
+    memoryPool_stats_reclaimed(memoryPool, used);
+    memoryPool_wake_finalizers(memoryPool);
+    return true;
+}
+
+static void memoryPool_finish_sweep(MemoryPool *const memoryPool) {
+    while (memoryPool_sweep_lazily(memoryPool, SIZE_MAX));
+}
+
+/*
+ * Returns the position of the space that holds `memory` in the list of all
+ * MemoryPoolNodes, which runs through the segments from the newest to the
+ * oldest and then through the initial space, each in address order.
+ */
+static size_t memoryPool_space_index(MemoryPool const *const memoryPool, void const *const memory) {
+    size_t index = 0;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next, ++index)
+        if (memoryPoolSegment_contains(segment, memory))
+            break;
+
+    return index;
+}
+
+static bool memoryPool_is_swept(MemoryPool const *const memoryPool, MemoryPoolNode const *const memoryPoolNode) {
+    MemoryPoolNode const *const cursor = memoryPool->sweepCursor;
+    if (!cursor)
+        return true;
+
+    const size_t index = memoryPool_space_index(memoryPool, memoryPoolNode);
+    const size_t cursorIndex = memoryPool_space_index(memoryPool, cursor);
+    return index < cursorIndex || (index == cursorIndex && memoryPoolNode < cursor);
+}
+
+// ---------- Automatic Collection ----------
+/*
+ * The default trigger collects once the bytes allocated since the last
+ * collection reach a threshold. After each collection the threshold is set to
+ * the bytes that survived it, scaled up by the moving average of the fraction
+ * of bytes that survived the recent collections: the less a collection frees,
+ * the longer the pool waits before the next one. The threshold never drops
+ * below MemoryPool_MinAutoGcThreshold. Survival is measured as the bytes in
+ * use after a collection relative to the bytes in use after the previous one
+ * plus the bytes allocated in between, both without large objects.
+ */
+struct MemoryPoolAutoGc {
+    MemoryPoolGcTrigger trigger;
+    void *context;
+    size_t allocated;
+    size_t threshold;
+    size_t live;
+    size_t survival;
+    bool collecting;
+};
+
+static const size_t MemoryPool_MinAutoGcThreshold = 1ULL << 16;
+static const size_t MemoryPool_SurvivalScale = 1000;
+
+bool memoryPool_enable_auto_gc(MemoryPool *const memoryPool) {
+    assert(!memoryPool->autoGc);
+    assert(!memoryPool->threads);
+
+    MemoryPoolAutoGc *const autoGc = CALLOC(1, sizeof(MemoryPoolAutoGc));
+    if (!autoGc)
+        return false;
+
+    autoGc->threshold = MemoryPool_MinAutoGcThreshold;
+    autoGc->live = memoryPool->size - memoryPool->freeBytes;
+    autoGc->survival = MemoryPool_SurvivalScale / 2;
+    memoryPool->autoGc = autoGc;
+    return true;
+}
+
+void memoryPool_set_gc_trigger(MemoryPool *const memoryPool, const MemoryPoolGcTrigger trigger, void *const context) {
+    assert(memoryPool->autoGc);
+    memoryPool->autoGc->trigger = trigger;
+    memoryPool->autoGc->context = context;
+}
+
+/*
+ * Updates the survival rate and the threshold once a collection, including its
+ * sweep, is complete.
+ */
+static void memoryPool_auto_gc_collected(MemoryPool const *const memoryPool) {
+    MemoryPoolAutoGc *const autoGc = memoryPool->autoGc;
+    if (!autoGc || memoryPool->sweepCursor)
+        return;
+
+    const size_t live = memoryPool->size - memoryPool->freeBytes;
+    const size_t before = autoGc->live + autoGc->allocated;
+    const size_t rate = before && live < before ? live * MemoryPool_SurvivalScale / before : MemoryPool_SurvivalScale;
+    autoGc->survival = (autoGc->survival + rate) / 2;
+    autoGc->live = live;
+    autoGc->allocated = 0;
+
+    const size_t threshold = live + live / MemoryPool_SurvivalScale * autoGc->survival;
+    autoGc->threshold = threshold > MemoryPool_MinAutoGcThreshold ? threshold : MemoryPool_MinAutoGcThreshold;
+}
+
+/*
+ * Called before an allocation of `size` bytes and, with `failed` set, after
+ * it did not fit. Collects if the trigger says so or if the allocation failed,
+ * unless the pool is being marked or the allocation comes from within an
+ * automatic collection, e.g. from a FreeFn. While a lazy sweep is pending the
+ * last collection is not complete yet, so it does not trigger a new one.
+ * Returns whether it collected.
+ */
+static bool memoryPool_auto_collect(MemoryPool *const memoryPool, const size_t size, const bool failed) {
+    MemoryPoolAutoGc *const autoGc = memoryPool->autoGc;
+    if (!autoGc || autoGc->collecting || memoryPool->marking)
+        return false;
+
+    if (!failed) {
+        autoGc->allocated += size;
+        if (memoryPool->sweepCursor)
+            return false;
+
+        const bool due = autoGc->trigger
+                ? autoGc->trigger(memoryPool, autoGc->allocated, autoGc->context)
+                : autoGc->allocated >= autoGc->threshold;
+        if (!due)
+            return false;
+    }
+
+    autoGc->collecting = true;
+    memoryPool_gc_mark_and_sweep(memoryPool);
+    autoGc->collecting = false;
+    return true;
+}
+
+// ---------- Generational Collection ----------
+/*
+ * A minor collection marks the young MemoryNodes that are reachable from the
+ * root set or the remembered set and copies them into the free lists of the
+ * pool. All neighbour pointers to them are updated through forwarding
+ * pointers, which are stored in the first neighbour pointer of the copied
+ * young MemoryNode. Afterwards the nursery is empty again.
+ *
+ * If the pool does not have enough free space for all survivors, the copies
+ * are rolled back and the nursery is collected in place instead. The young
+ * survivors then stay in the nursery till the next collection.
+ */
+static void memoryPool_finalize_node(MemoryPool const *const memoryPool, MemoryPoolNode *const memoryPoolNode) {
+    if (memoryPool->freeFn)
+        memoryPool->freeFn(memoryNode_get_data(memoryPoolNode_get_data(memoryPoolNode)));
+
+    memoryPoolNode_set_is_free(memoryPoolNode, true);
+}
+
+static bool memoryPoolGenerations_shade(MemoryPoolGenerations *const generations, MemoryNode *const memoryNode) {
+    if (!memoryNode || !memoryPoolGenerations_is_young(generations, memoryNode) || memoryNode_is_marked(memoryNode))
+        return true;
+
+    memoryNode_set_is_marked(memoryNode, true);
+    return memoryNodeStack_push(&generations->grey, memoryNode);
+}
+
+static bool memoryPoolGenerations_shade_neighbours(MemoryPoolGenerations *const generations, MemoryNode const *const memoryNode) {
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i)
+        if (!memoryPoolGenerations_shade(generations, memoryNode_getNeighbour(memoryNode, i)))
+            return false;
+
+    return true;
+}
+
+static bool memoryPool_mark_young(MemoryPool const *const memoryPool) {
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        if (!memoryPoolGenerations_shade(generations, memoryPool->rootSet[i]))
+            return false;
+
+    for (size_t i = 0; i < generations->remembered.size; ++i)
+        if (!memoryPoolGenerations_shade_neighbours(generations, generations->remembered.items[i]))
+            return false;
+
+    MemoryNode *memoryNode;
+    while ((memoryNode = memoryNodeStack_pop(&generations->grey)))
+        if (!memoryPoolGenerations_shade_neighbours(generations, memoryNode))
+            return false;
+
+    return true;
+}
+
+static MemoryNode *memoryPoolGenerations_forward(MemoryPoolGenerations const *const generations, MemoryNode *const memoryNode) {
+    if (!memoryNode || !memoryPoolGenerations_is_young(generations, memoryNode))
+        return memoryNode;
+
+    assert(memoryNode_is_marked(memoryNode));
+    return extract_ptr_bits(memoryNode->neighbours);
+}
+
+static void memoryPoolGenerations_forward_neighbours(MemoryPoolGenerations const *const generations, MemoryNode *const memoryNode) {
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i) {
+        MemoryNode *const neighbour = memoryNode_getNeighbour(memoryNode, i);
+        if (neighbour && memoryPoolGenerations_is_young(generations, neighbour))
+            memoryNode_set_neighbour_ptr(memoryNode, memoryPoolGenerations_forward(generations, neighbour), i);
+    }
+}
+
+/*
+ * Undoes the promotion of all young MemoryNodes in front of `end`.
+ */
+static void memoryPool_rollback_promotion(MemoryPool *const memoryPool, MemoryPoolNode const *const end) {
+    MemoryPoolGenerations const *const generations = memoryPool->generations;
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node != end; node = memoryPoolGenerations_next(generations, node)) {
+        MemoryNode *const young = memoryPoolNode_get_data(node);
+        if (memoryPoolNode_is_free(node) || !memoryNode_is_marked(young))
+            continue;
 
-        const uint16_t counter = memoryNode_get_counter(current);
-        if (counter == neighbours) {
-            memoryNode_reset_counter(current);
-            BACK_OFF
+        MemoryNode *const copy = memoryPoolGenerations_forward(generations, young);
+        young->neighbours = copy->neighbours;
+        memoryNode_set_is_marked(young, true);
+
+        MemoryPoolNode *const copyNode = memoryNode_get_memoryPoolNode(copy);
+        memoryPoolNode_set_is_free(copyNode, true);
+        memoryPool_insert_free_node(memoryPool, copyNode);
+    }
+}
+
+static bool memoryPool_promote_young(MemoryPool *const memoryPool) {
+    MemoryPoolGenerations const *const generations = memoryPool->generations;
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node)) {
+        MemoryNode *const young = memoryPoolNode_get_data(node);
+        if (memoryPoolNode_is_free(node) || !memoryNode_is_marked(young))
             continue;
+
+        const size_t size = memoryPoolNode_get_free_space(node);
+        MemoryPoolNode *const old = memoryPool_alloc_node(memoryPool, size);
+        if (!old) {
+            memoryPool_rollback_promotion(memoryPool, node);
+            return false;
         }
 
-        next = memoryNode_getNeighbour(current, counter);
-        if (!next || memoryNode_is_marked(next)) {
-            memoryNode_inc_counter(current);
+        MemoryNode *const copy = memoryPoolNode_get_data(old);
+        memcpy(copy, young, size);
+        memoryNode_set_is_marked(copy, false);
+        young->neighbours = set_lowest_bit(copy, true);
+    }
+
+    return true;
+}
+
+static MemoryNode *memoryPool_keep_if_marked_young(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    if (!memoryPoolGenerations_is_young(memoryPool->generations, memoryNode))
+        return memoryNode;
+
+    return memoryPool_keep_if_marked(memoryPool, memoryNode);
+}
+
+static MemoryNode *memoryPool_forward_if_marked_young(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    MemoryNode *const kept = memoryPool_keep_if_marked_young(memoryPool, memoryNode);
+    return memoryPoolGenerations_forward(memoryPool->generations, kept);
+}
+
+static void memoryPool_clear_remembered_set(MemoryPoolGenerations *const generations) {
+    for (size_t i = 0; i < generations->remembered.size; ++i)
+        memoryNode_set_is_remembered(generations->remembered.items[i], false);
+
+    generations->remembered.size = 0;
+}
+
+/*
+ * Finalizes the unmarked young MemoryNodes and clears the marks of the others.
+ * The nursery shrinks to the end of the last surviving MemoryNode.
+ */
+static void memoryPool_sweep_young(MemoryPool const *const memoryPool) {
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    char *top = generations->nursery;
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node)) {
+        if (memoryPoolNode_is_free(node))
+            continue;
+
+        MemoryNode *const young = memoryPoolNode_get_data(node);
+        if (!memoryNode_is_marked(young)) {
+            memoryPool_finalize_node(memoryPool, node);
             continue;
         }
 
-        memoryNode_set_is_marked(next, true);
-        if (for_each)
-            for_each(next);
+        memoryNode_set_is_marked(young, false);
+        top = (char *) memoryPoolNode_get_data(node) + memoryPoolNode_get_free_space(node);
+    }
 
-        const uint16_t next_neighbours = memoryNode_get_neighbour_count(next);
-        if (next_neighbours == 0) {
-            memoryNode_inc_counter(current);
-            continue;
+    generations->nurseryTop = top;
+}
+
+static void memoryPoolGenerations_remember_if_old_to_young(MemoryPoolGenerations *const generations, MemoryNode *const memoryNode) {
+    memoryNode_set_is_remembered(memoryNode, false);
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i) {
+        if (memoryPoolGenerations_is_young(generations, memoryNode_getNeighbour(memoryNode, i))) {
+            memoryPoolGenerations_remember(generations, memoryNode);
+            return;
         }
+    }
+}
 
-        memoryNode_setNeighbour(current, previous, counter);
-        previous = current;
-        current = next;
+/*
+ * Rebuilds the remembered set from scratch after the barrier failed to record
+ * an old MemoryNode.
+ */
+static bool memoryPool_rebuild_remembered_set(MemoryPool const *const memoryPool) {
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    generations->remembered.size = 0;
+    generations->rememberedOverflow = false;
 
-        if (next_neighbours >= 2)
+    for (MemoryPoolNode *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+        if (!memoryPoolNode_is_free(node))
+            memoryPoolGenerations_remember_if_old_to_young(generations, memoryPoolNode_get_data(node));
+
+    for (MemoryPoolLargeObject *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        memoryPoolGenerations_remember_if_old_to_young(generations, memoryPoolLargeObject_get_node(largeObject));
+
+    return !generations->rememberedOverflow;
+}
+
+void memoryPool_gc_minor(MemoryPool *const memoryPool) {
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    assert(generations);
+    assert(!memoryPool->marking);
+
+    // Rebuilding the remembered set must not pick up garbage that is not
+    // swept yet.
+    if (generations->rememberedOverflow)
+        memoryPool_finish_sweep(memoryPool);
+
+    if (generations->rememberedOverflow && !memoryPool_rebuild_remembered_set(memoryPool))
+        return;
+
+    if (!memoryPool_mark_young(memoryPool)) {
+        generations->grey.size = 0;
+        for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node))
+            if (!memoryPoolNode_is_free(node))
+                memoryNode_set_is_marked(memoryPoolNode_get_data(node), false);
+
+        return;
+    }
+
+    if (!memoryPool_promote_young(memoryPool)) {
+        memoryPool_update_handles(memoryPool, memoryPool_keep_if_marked_young);
+        memoryPool_sweep_young(memoryPool);
+        return;
+    }
+
+    memoryPool_update_handles(memoryPool, memoryPool_forward_if_marked_young);
+
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        memoryPool->rootSet[i] = memoryPoolGenerations_forward(generations, memoryPool->rootSet[i]);
+
+    memoryPool_rebuild_root_index(memoryPool);
+
+    for (size_t i = 0; i < generations->remembered.size; ++i)
+        memoryPoolGenerations_forward_neighbours(generations, generations->remembered.items[i]);
+
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node)) {
+        MemoryNode *const young = memoryPoolNode_get_data(node);
+        if (memoryPoolNode_is_free(node))
             continue;
 
-        FORWARD
+        if (memoryNode_is_marked(young))
+            memoryPoolGenerations_forward_neighbours(generations, memoryPoolGenerations_forward(generations, young));
+        else
+            memoryPool_finalize_node(memoryPool, node);
     }
 
-#undef FORWARD
-#undef BACK_OFF
+    memoryPool_clear_remembered_set(generations);
+    generations->nurseryTop = generations->nursery;
 }
 
-static void memoryPool_gc_mark(MemoryPool *const memoryPool) {
-    const size_t rootSetSize = memoryPool->rootSetSize;
-    for (int i = 0; i < rootSetSize; ++i)
-        memoryPool_dfs(memoryPool->rootSet[i], NULL);
+/*
+ * Called by a major collection after all reachable MemoryNodes have been
+ * marked and before the old MemoryNodes are swept.
+ */
+static void memoryPool_gc_sweep_generations(MemoryPool const *const memoryPool) {
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    if (generations->rememberedOverflow)
+        return memoryPool_sweep_young(memoryPool);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < generations->remembered.size; ++i) {
+        MemoryNode *const memoryNode = generations->remembered.items[i];
+        if (memoryPool_is_marked(memoryPool, memoryNode))
+            generations->remembered.items[kept++] = memoryNode;
+    }
+
+    generations->remembered.size = kept;
+    memoryPool_sweep_young(memoryPool);
 }
 
+void memoryPool_gc_mark_and_sweep(MemoryPool *const memoryPool) {
+    assert(!memoryPool->marking);
+    const uint64_t start = memoryPool_stats_now(memoryPool);
+    memoryPool_finish_sweep(memoryPool);
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    if (memoryPool->generations)
+        memoryPool_gc_minor(memoryPool);
 
-static void memoryPool_gc_sweep(MemoryPool *const memoryPool) {
+    memoryPool_begin_mark_bitmap(memoryPool);
+    memoryPool_gc_mark(memoryPool);
+    memoryPool_update_handles(memoryPool, memoryPool_keep_if_marked);
+    const uint64_t marked = memoryPool_stats_now(memoryPool);
+    if (memoryPool->generations)
+        memoryPool_gc_sweep_generations(memoryPool);
+
+    memoryPool_gc_sweep(memoryPool);
+    memoryPool_release_empty_segments(memoryPool);
+    memoryPool_stats_collected(memoryPool, start, marked, used);
+    memoryPool_wake_finalizers(memoryPool);
+    memoryPool_auto_gc_collected(memoryPool);
+}
+
+void memoryPool_gc_finish(MemoryPool *const memoryPool) {
+    assert(memoryPool->marking);
+
+    const uint64_t start = memoryPool_stats_now(memoryPool);
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    memoryPool_finish_marking(memoryPool);
+    memoryPool_update_handles(memoryPool, memoryPool_keep_if_marked);
+    const uint64_t marked = memoryPool_stats_now(memoryPool);
+    memoryPool_gc_sweep(memoryPool);
+    memoryPool_release_empty_segments(memoryPool);
+    memoryPool_stats_collected(memoryPool, start, marked, used);
+    memoryPool_wake_finalizers(memoryPool);
+    memoryPool_auto_gc_collected(memoryPool);
+}
+
+void memoryPool_defragment(MemoryPool *const memoryPool) {
+    memoryPool_finish_sweep(memoryPool);
+    memoryPool_retire_tlabs(memoryPool);
+    memoryPool_clear_free_lists(memoryPool);
+
+    MemoryPoolNode *run = NULL;
     MemoryPoolNode *current = memoryPool->head;
-    FreeFn f = memoryPool->freeFn;
     while (current) {
+        MemoryPoolNode *const next = memoryPoolNode_get_next(current);
         if (memoryPoolNode_is_free(current))
-            goto next;
+            run = memoryPool_coalesce_free_node(memoryPool, run, current);
+        else
+            run = memoryPool_end_free_run(memoryPool, run);
 
-        MemoryNode *memoryNode = memoryPoolNode_get_data(current);
-        const bool is_marked = memoryNode_is_marked(memoryNode);
-        if (is_marked) {
-            memoryNode_set_is_marked(memoryNode, false);
-            goto next;
+        current = next;
+    }
+
+    memoryPool_end_free_run(memoryPool, run);
+}
+
+void memoryPool_set_placement(MemoryPool *const memoryPool, const MemoryPoolPlacement placement) {
+    assert(placement != MemoryPoolPlacement_NextFit || (!memoryPool->threads && !memoryPool->lazySweep));
+
+    // Rebuilding the free lists puts every free MemoryPoolNode where the new
+    // policy expects it.
+    memoryPool->placement = placement;
+    memoryPool_defragment(memoryPool);
+}
+
+// ---------- Compaction ----------
+/*
+ * A sliding compaction in the style of the Lisp 2 algorithm, which keeps the
+ * order of the MemoryNodes:
+ * 1. After marking, the unmarked MemoryNodes are finalized and the size of the
+ *    live MemoryNodes of every segment is summed up.
+ * 2. The new location of every live MemoryPoolNode is computed and stored in
+ *    its next pointer, which is not needed till the list is relinked.
+ * 3. Every pointer to a MemoryNode of the pool is replaced by the new
+ *    location, leaving the packed bits of the neighbour pointers alone.
+ * 4. The MemoryPoolNodes are moved and relinked, the free rest of each segment
+ *    becomes new free MemoryPoolNodes.
+ *
+ * A free rest that is too small for a MemoryPoolNode is added to the first
+ * live MemoryPoolNode that can take it. If there is none, the segment is left
+ * as it is.
+ */
+typedef struct {
+    MemoryPoolNode *start;
+    char *end;
+    MemoryPoolNode *chainNext;
+    size_t live;
+    MemoryPoolNode *absorber;
+    size_t slack;
+    bool compacted;
+} MemoryPoolCompactedSegment;
+
+static size_t memoryPool_collect_segments(MemoryPool const *const memoryPool, MemoryPoolCompactedSegment *const segments) {
+    size_t count = 0;
+    MemoryPoolNode *node = memoryPool->head;
+    while (node) {
+        MemoryPoolCompactedSegment *const segment = &segments[count++];
+        segment->start = node;
+        segment->live = 0;
+
+        MemoryPoolNode *next;
+        for (;; node = next) {
+            next = memoryPoolNode_get_next(node);
+            if (!memoryPoolNode_is_free(node)) {
+                if (memoryNode_is_marked(memoryPoolNode_get_data(node)))
+                    segment->live += sizeof(MemoryPoolNode) + memoryPoolNode_get_free_space(node);
+                else
+                    memoryPool_finalize_node(memoryPool, node);
+            }
+
+            if (next != memoryPoolNode_physical_next(node))
+                break;
         }
 
-        void *data = memoryNode_get_data(memoryNode);
-        if (f) f(data);
-        memoryPoolNode_set_is_free(current, true);
-        goto next;
+        segment->end = (char *) memoryPoolNode_physical_next(node);
+        segment->chainNext = next;
+        node = next;
+    }
+
+    return count;
+}
+
+static void memoryPool_compute_locations(MemoryPoolCompactedSegment *const segment) {
+    const size_t free = segment->end - (char *) segment->start - segment->live;
+    segment->slack = free < sizeof(MemoryPoolNode) + MemoryPoolNode_MinMemoryPerNode ? free : 0;
+    segment->absorber = NULL;
+
+    char *location = (char *) segment->start;
+    for (MemoryPoolNode *node = segment->start; (char *) node < segment->end; node = memoryPoolNode_physical_next(node)) {
+        if (memoryPoolNode_is_free(node))
+            continue;
 
-    next:
-        current = memoryPoolNode_get_next(current);
+        size_t size = memoryPoolNode_get_free_space(node);
+        if (segment->slack && !segment->absorber && size + segment->slack <= MemoryPoolNode_MaxMemoryPerNode) {
+            segment->absorber = node;
+            size += segment->slack;
+        }
+
+        memoryPoolNode_set_next(node, (MemoryPoolNode *) location);
+        location += sizeof(MemoryPoolNode) + size;
     }
+
+    segment->compacted = !segment->slack || segment->absorber;
+    if (segment->compacted)
+        return;
+
+    for (MemoryPoolNode *node = segment->start; (char *) node < segment->end; node = memoryPoolNode_physical_next(node))
+        if (!memoryPoolNode_is_free(node))
+            memoryPoolNode_set_next(node, node);
 }
 
-void memoryPool_gc_mark_and_sweep(MemoryPool *const memoryPool) {
+static MemoryNode *memoryPool_forward_compacted(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    if (!memoryNode || memoryNode_is_large(memoryNode))
+        return memoryNode;
+
+    if (memoryPool->generations && memoryPoolGenerations_is_young(memoryPool->generations, memoryNode))
+        return memoryNode;
+
+    return memoryPoolNode_get_data(memoryPoolNode_get_next(memoryNode_get_memoryPoolNode(memoryNode)));
+}
+
+static void memoryPool_forward_neighbours(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i) {
+        MemoryNode *const neighbour = memoryNode_getNeighbour(memoryNode, i);
+        if (neighbour)
+            memoryNode_set_neighbour_ptr(memoryNode, memoryPool_forward_compacted(memoryPool, neighbour), i);
+    }
+}
+
+static void memoryPool_update_pointers(MemoryPool *const memoryPool, MemoryPoolCompactedSegment const *const segments, const size_t count) {
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        memoryPool->rootSet[i] = memoryPool_forward_compacted(memoryPool, memoryPool->rootSet[i]);
+
+    memoryPool_rebuild_root_index(memoryPool);
+
+    memoryPool_update_handles(memoryPool, memoryPool_forward_compacted);
+
+    for (size_t i = 0; i < count; ++i)
+        for (MemoryPoolNode *node = segments[i].start; (char *) node < segments[i].end; node = memoryPoolNode_physical_next(node))
+            if (!memoryPoolNode_is_free(node))
+                memoryPool_forward_neighbours(memoryPool, memoryPoolNode_get_data(node));
+
+    for (MemoryPoolLargeObject *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        memoryPool_forward_neighbours(memoryPool, memoryPoolLargeObject_get_node(largeObject));
+
+    MemoryPoolGenerations *const generations = memoryPool->generations;
+    if (!generations)
+        return;
+
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node))
+        if (!memoryPoolNode_is_free(node))
+            memoryPool_forward_neighbours(memoryPool, memoryPoolNode_get_data(node));
+
+    // An overflowed remembered set is rebuilt by the next minor collection.
+    if (!generations->rememberedOverflow)
+        for (size_t i = 0; i < generations->remembered.size; ++i)
+            generations->remembered.items[i] = memoryPool_forward_compacted(memoryPool, generations->remembered.items[i]);
+}
+
+static void memoryPool_move_nodes(MemoryPool *const memoryPool, MemoryPoolCompactedSegment const *const segment) {
+    MemoryPoolNode *last = NULL;
+    char *top = (char *) segment->start;
+    MemoryPoolNode *node = segment->start;
+    while ((char *) node < segment->end) {
+        const size_t size = memoryPoolNode_get_free_space(node);
+        MemoryPoolNode *const next = memoryPoolNode_physical_next(node);
+        MemoryPoolNode *kept = NULL;
+        if (!memoryPoolNode_is_free(node)) {
+            kept = memoryPoolNode_get_next(node);
+            memmove(kept, node, sizeof(MemoryPoolNode) + size);
+            memoryPoolNode_new(kept, NULL, node == segment->absorber ? size + segment->slack : size, false);
+            memoryNode_set_is_marked(memoryPoolNode_get_data(kept), false);
+            top = (char *) memoryPoolNode_physical_next(kept);
+        } else if (!segment->compacted) {
+            kept = node;
+        }
+
+        if (kept) {
+            if (last)
+                memoryPoolNode_set_next(last, kept);
+            last = kept;
+        }
+
+        node = next;
+    }
+
+    if (segment->compacted && top < segment->end) {
+        MemoryPoolNode *rest;
+        MemoryPoolNode *const first = memoryPool_add_space(memoryPool, top, segment->end - top, &rest);
+        if (last)
+            memoryPoolNode_set_next(last, first);
+        last = rest;
+    }
+
+    memoryPoolNode_set_next(last, segment->chainNext);
+}
+
+void memoryPool_gc_mark_compact(MemoryPool *const memoryPool) {
+    assert(!memoryPool->marking);
+    memoryPool_finish_sweep(memoryPool);
+    memoryPool_settle_finalizers(memoryPool);
+    memoryPool_invalidate_regions(memoryPool);
+
+    size_t segmentCount = 1;
+    for (MemoryPoolSegment const *segment = memoryPool->growth ? memoryPool->growth->segments : NULL; segment; segment = segment->next)
+        ++segmentCount;
+
+    MemoryPoolCompactedSegment *const segments = MALLOC(segmentCount * sizeof(MemoryPoolCompactedSegment));
+    if (!segments)
+        return memoryPool_gc_mark_and_sweep(memoryPool);
+
+    const uint64_t start = memoryPool_stats_now(memoryPool);
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    if (memoryPool->generations)
+        memoryPool_gc_minor(memoryPool);
+
     memoryPool_gc_mark(memoryPool);
-    memoryPool_gc_sweep(memoryPool);
+    memoryPool_update_handles(memoryPool, memoryPool_keep_if_marked);
+    const uint64_t marked = memoryPool_stats_now(memoryPool);
+    if (memoryPool->generations)
+        memoryPool_gc_sweep_generations(memoryPool);
+
+    memoryPool_retire_tlabs(memoryPool);
+    memoryPool_clear_free_lists(memoryPool);
+    memoryPool_sweep_large_objects(memoryPool);
+
+    const size_t count = memoryPool_collect_segments(memoryPool, segments);
+    assert(count == segmentCount);
+    for (size_t i = 0; i < count; ++i)
+        memoryPool_compute_locations(&segments[i]);
+
+    memoryPool_update_pointers(memoryPool, segments, count);
+    for (size_t i = 0; i < count; ++i)
+        memoryPool_move_nodes(memoryPool, &segments[i]);
+
+    FREE(segments);
+    memoryPool_defragment(memoryPool);
+    memoryPool_release_empty_segments(memoryPool);
+    memoryPool_stats_collected(memoryPool, start, marked, used);
+    memoryPool_auto_gc_collected(memoryPool);
+}
+
+// ---------- Copying Collection ----------
+/*
+ * A semispace collection evacuates every reachable MemoryNode of the pool into
+ * a new space of the same size and drops all old spaces afterwards. An
+ * evacuated MemoryNode is marked and its first neighbour pointer holds the
+ * location of its copy, like a promoted young MemoryNode.
+ *
+ * In breadth first order the copies are scanned in the order they were made,
+ * in the style of Cheney's algorithm. In depth first order the stack holds the
+ * neighbour pointers that still need to be evacuated, so every MemoryNode is
+ * copied right after the MemoryNode it was first reached from.
+ *
+ * Large objects and young MemoryNodes are not copied. They are only marked and
+ * their neighbours are scanned. If the stack cannot grow, every copy and every
+ * marked MemoryNode that is not copied is scanned once more.
+ */
+typedef struct {
+    char *space;
+    char *top;
+    char *end;
+    char *scan;
+    MemoryPoolNode *last;
+    MemoryNodeStack grey;
+    MemoryPoolTraversal order;
+    bool rescan;
+    bool overflow;
+} MemoryPoolToSpace;
+
+static bool memoryPoolToSpace_contains(MemoryPoolToSpace const *const toSpace, void const *const memory) {
+    return (char const *) memory >= toSpace->space && (char const *) memory < toSpace->end;
+}
+
+static bool memoryPool_is_pinned(MemoryPool const *const memoryPool, MemoryNode const *const memoryNode) {
+    return memoryNode_is_large(memoryNode) || (memoryPool->generations && memoryPoolGenerations_is_young(memoryPool->generations, memoryNode));
+}
+
+static void memoryPoolToSpace_push(MemoryPoolToSpace *const toSpace, MemoryNode *const item) {
+    if (!memoryNodeStack_push(&toSpace->grey, item))
+        toSpace->overflow = true;
+}
+
+/*
+ * Puts a MemoryNode that was just copied or marked on the stack, if the order
+ * of the collection requires it.
+ */
+static void memoryPoolToSpace_schedule(MemoryPoolToSpace *const toSpace, MemoryNode *const memoryNode, const bool pinned) {
+    if (toSpace->order == MemoryPoolTraversal_BreadthFirst) {
+        if (pinned)
+            memoryPoolToSpace_push(toSpace, memoryNode);
+
+        return;
+    }
+
+    for (uint16_t i = memoryNode_get_neighbour_count(memoryNode); i > 0; --i)
+        memoryPoolToSpace_push(toSpace, (MemoryNode *) memoryNode_ptr_to_neighbour_ptr(memoryNode, i - 1));
+}
+
+static MemoryNode *memoryPool_evacuate(MemoryPool const *const memoryPool, MemoryPoolToSpace *const toSpace, MemoryNode *const memoryNode) {
+    if (!memoryNode || memoryPoolToSpace_contains(toSpace, memoryNode))
+        return memoryNode;
+
+    const bool pinned = memoryPool_is_pinned(memoryPool, memoryNode);
+    if (memoryNode_is_marked(memoryNode))
+        return pinned ? memoryNode : extract_ptr_bits(memoryNode->neighbours);
+
+    if (pinned) {
+        memoryNode_set_is_marked(memoryNode, true);
+        memoryPoolToSpace_schedule(toSpace, memoryNode, true);
+        return memoryNode;
+    }
+
+    const uint16_t size = memoryPoolNode_get_free_space(memoryNode_get_memoryPoolNode(memoryNode));
+    MemoryPoolNode *const node = memoryPoolNode_new(toSpace->top, NULL, size, false);
+    if (toSpace->last)
+        memoryPoolNode_set_next(toSpace->last, node);
+
+    toSpace->last = node;
+    toSpace->top += sizeof(MemoryPoolNode) + size;
+
+    MemoryNode *const copy = memoryPoolNode_get_data(node);
+    memcpy(copy, memoryNode, size);
+    memoryNode->neighbours = set_lowest_bit(copy, true);
+    memoryPoolToSpace_schedule(toSpace, copy, false);
+    return copy;
+}
+
+static void memoryPool_evacuate_neighbours(MemoryPool const *const memoryPool, MemoryPoolToSpace *const toSpace, MemoryNode *const memoryNode) {
+    const uint16_t count = memoryNode_get_neighbour_count(memoryNode);
+    for (uint16_t i = 0; i < count; ++i) {
+        MemoryNode *const neighbour = memoryNode_getNeighbour(memoryNode, i);
+        if (neighbour)
+            memoryNode_set_neighbour_ptr(memoryNode, memoryPool_evacuate(memoryPool, toSpace, neighbour), i);
+    }
+}
+
+static void memoryPool_rescan_pinned(MemoryPool const *const memoryPool, MemoryPoolToSpace *const toSpace) {
+    for (MemoryPoolLargeObject *largeObject = memoryPool->largeObjects; largeObject; largeObject = largeObject->next)
+        if (memoryNode_is_marked(memoryPoolLargeObject_get_node(largeObject)))
+            memoryPool_evacuate_neighbours(memoryPool, toSpace, memoryPoolLargeObject_get_node(largeObject));
+
+    MemoryPoolGenerations const *const generations = memoryPool->generations;
+    if (!generations)
+        return;
+
+    for (MemoryPoolNode *node = memoryPoolGenerations_first(generations); node; node = memoryPoolGenerations_next(generations, node))
+        if (!memoryPoolNode_is_free(node) && memoryNode_is_marked(memoryPoolNode_get_data(node)))
+            memoryPool_evacuate_neighbours(memoryPool, toSpace, memoryPoolNode_get_data(node));
+}
+
+static void memoryPool_evacuate_reachable(MemoryPool *const memoryPool, MemoryPoolToSpace *const toSpace) {
+    for (size_t i = 0; i < memoryPool->rootSetSize; ++i)
+        memoryPool->rootSet[i] = memoryPool_evacuate(memoryPool, toSpace, memoryPool->rootSet[i]);
+
+    memoryPool_rebuild_root_index(memoryPool);
+
+    for (;;) {
+        MemoryNode *const item = memoryNodeStack_pop(&toSpace->grey);
+        if (item && toSpace->order == MemoryPoolTraversal_BreadthFirst) {
+            memoryPool_evacuate_neighbours(memoryPool, toSpace, item);
+        } else if (item) {
+            MemoryNode **const slot = (MemoryNode **) item;
+            *slot = replace_ptr_bits(*slot, memoryPool_evacuate(memoryPool, toSpace, extract_ptr_bits(*slot)));
+        } else if ((toSpace->rescan || toSpace->order == MemoryPoolTraversal_BreadthFirst) && toSpace->scan < toSpace->top) {
+            MemoryPoolNode *const node = (MemoryPoolNode *) toSpace->scan;
+            toSpace->scan = (char *) memoryPoolNode_physical_next(node);
+            memoryPool_evacuate_neighbours(memoryPool, toSpace, memoryPoolNode_get_data(node));
+        } else if (toSpace->overflow) {
+            toSpace->overflow = false;
+            toSpace->rescan = true;
+            toSpace->scan = toSpace->space;
+            memoryPool_rescan_pinned(memoryPool, toSpace);
+        } else {
+            return;
+        }
+    }
+}
+
+static MemoryNode *memoryPool_forward_copied(MemoryPool const *const memoryPool, MemoryNode *const memoryNode) {
+    if (!memoryNode_is_marked(memoryNode))
+        return NULL;
+
+    return memoryPool_is_pinned(memoryPool, memoryNode) ? memoryNode : extract_ptr_bits(memoryNode->neighbours);
+}
+
+/*
+ * Calls the FreeFn for every MemoryNode of the old spaces that was not
+ * evacuated and releases the old spaces.
+ */
+static void memoryPool_drop_from_space(MemoryPool *const memoryPool) {
+    if (memoryPool->freeFn)
+        for (MemoryPoolNode *node = memoryPool->head; node; node = memoryPoolNode_get_next(node))
+            if (!memoryPoolNode_is_free(node) && !memoryNode_is_marked(memoryPoolNode_get_data(node)))
+                memoryPool->freeFn(memoryNode_get_data(memoryPoolNode_get_data(node)));
+
+    void *const initialSpace = memoryPool->growth ? memoryPool->growth->initialHead : memoryPool->head;
+    if (memoryPool->growth)
+        memoryPool_release_segments(memoryPool);
+
+    memoryPool_arena_free(memoryPool->arena, initialSpace, memoryPool->size);
+}
+
+void memoryPool_gc_copy(MemoryPool *const memoryPool, const MemoryPoolTraversal order) {
+    assert(!memoryPool->marking);
+    memoryPool_finish_sweep(memoryPool);
+    memoryPool_settle_finalizers(memoryPool);
+    memoryPool_invalidate_regions(memoryPool);
+
+    const size_t size = memoryPool->size;
+    char *const space = memoryPool_arena_alloc(memoryPool->arena, size);
+    if (!space)
+        return memoryPool_gc_mark_and_sweep(memoryPool);
+
+    const uint64_t start = memoryPool_stats_now(memoryPool);
+    const size_t used = memoryPool_stats_used_bytes(memoryPool);
+    if (memoryPool->generations)
+        memoryPool_gc_minor(memoryPool);
+
+    memoryPool_retire_tlabs(memoryPool);
+
+    MemoryPoolToSpace toSpace;
+    memset(&toSpace, 0, sizeof(MemoryPoolToSpace));
+    toSpace.space = space;
+    toSpace.top = space;
+    toSpace.end = space + size;
+    toSpace.scan = space;
+    toSpace.order = order;
+    memoryPool_evacuate_reachable(memoryPool, &toSpace);
+    memoryNodeStack_free(&toSpace.grey);
+    const uint64_t marked = memoryPool_stats_now(memoryPool);
+
+    memoryPool_update_handles(memoryPool, memoryPool_forward_copied);
+    if (memoryPool->generations) {
+        // The remembered set still refers to the old spaces, so the next minor
+        // collection rebuilds it.
+        memoryPool->generations->rememberedOverflow = true;
+        memoryPool_gc_sweep_generations(memoryPool);
+    }
+
+    memoryPool_sweep_large_objects(memoryPool);
+    memoryPool_drop_from_space(memoryPool);
+
+    memoryPool_clear_free_lists(memoryPool);
+    MemoryPoolNode *rest = NULL;
+    MemoryPoolNode *const first = memoryPool_add_space(memoryPool, toSpace.top, toSpace.end - toSpace.top, &rest);
+    if (toSpace.last)
+        memoryPoolNode_set_next(toSpace.last, first);
+
+    memoryPool->head = toSpace.last ? (MemoryPoolNode *) space : first;
+    memoryPool->size = size;
+    if (memoryPool->growth)
+        memoryPool->growth->initialHead = memoryPool->head;
+
+    memoryPool_stats_collected(memoryPool, start, marked, used);
+    memoryPool_auto_gc_collected(memoryPool);
 }
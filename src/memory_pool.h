@@ -38,32 +38,610 @@ typedef struct MemoryPoolNode {
  */
 typedef void (*FreeFn)(void *);
 
+/*
+ * The state of the generational mode of a MemoryPool.
+ */
+typedef struct MemoryPoolGenerations MemoryPoolGenerations;
+
+/*
+ * The state of the thread safe mode of a MemoryPool.
+ */
+typedef struct MemoryPoolThreads MemoryPoolThreads;
+
+/*
+ * The state of the growth of a MemoryPool beyond its initial size.
+ */
+typedef struct MemoryPoolGrowth MemoryPoolGrowth;
+
+/*
+ * A MemoryNode that is too large for a MemoryPoolNode and therefore lives in
+ * its own mapping.
+ */
+typedef struct MemoryPoolLargeObject MemoryPoolLargeObject;
+
+/*
+ * The table of handles of a MemoryPool.
+ */
+typedef struct MemoryPoolHandles MemoryPoolHandles;
+
+/*
+ * The state of the parallel mark phase of a MemoryPool.
+ */
+typedef struct MemoryPoolMarkers MemoryPoolMarkers;
+
+/*
+ * The state of the parallel sweep of a MemoryPool.
+ */
+typedef struct MemoryPoolSweepers MemoryPoolSweepers;
+
+/*
+ * The queues and threads that run the FreeFn of dead MemoryNodes after a sweep.
+ */
+typedef struct MemoryPoolFinalizers MemoryPoolFinalizers;
+
+/*
+ * The state of the automatic garbage collection of a MemoryPool.
+ */
+typedef struct MemoryPoolAutoGc MemoryPoolAutoGc;
+
+/*
+ * The counters a MemoryPool keeps for memoryPool_get_stats.
+ */
+typedef struct MemoryPoolStatsCounters MemoryPoolStatsCounters;
+
+/*
+ * The state of the allocation sampling of a MemoryPool.
+ */
+typedef struct MemoryPoolSampler MemoryPoolSampler;
+
+/*
+ * The side table that holds the marks of a MemoryPool.
+ */
+typedef struct MemoryPoolMarkBitmap MemoryPoolMarkBitmap;
+
+/*
+ * The state of a collection that marks the pool while the mutators keep
+ * running.
+ */
+typedef struct MemoryPoolMarking MemoryPoolMarking;
+
+/*
+ * Where the memory of a MemoryPool comes from.
+ *
+ * MemoryPoolArena_Malloc takes the memory from MALLOC.
+ * MemoryPoolArena_Mapped maps the memory directly, so pages are only
+ * committed once they are used. After every sweep the whole pages of large
+ * free MemoryPoolNodes are returned to the operating system.
+ * MemoryPoolArena_HugePages maps the memory backed by transparent huge pages,
+ * which need fewer TLB entries when the pool is traversed.
+ * MemoryPoolArena_HugeTlb uses reserved huge pages and falls back to
+ * transparent huge pages if there are not enough of them.
+ * Free pages are never returned from huge pages, as that would split them.
+ */
+typedef enum {
+    MemoryPoolArena_Malloc,
+    MemoryPoolArena_Mapped,
+    MemoryPoolArena_HugePages,
+    MemoryPoolArena_HugeTlb,
+} MemoryPoolArena;
+
+/*
+ * How the MemoryPool picks the free memory a new MemoryNode is placed in.
+ *
+ * MemoryPoolPlacement_SegregatedFit takes the first free MemoryPoolNode of the
+ * smallest size class that fits.
+ * MemoryPoolPlacement_NextFit keeps a roving cursor and places each MemoryNode
+ * in the first fitting free MemoryPoolNode after the previous one, wrapping
+ * around at the end of the pool.
+ * MemoryPoolPlacement_BestFit takes the smallest free MemoryPoolNode that
+ * fits, using an index of the free MemoryPoolNodes that is ordered by size.
+ */
+typedef enum {
+    MemoryPoolPlacement_SegregatedFit,
+    MemoryPoolPlacement_NextFit,
+    MemoryPoolPlacement_BestFit,
+} MemoryPoolPlacement;
+
+/*
+ * The order in which a copying collection lays out the surviving MemoryNodes.
+ *
+ * MemoryPoolTraversal_BreadthFirst places the neighbours of a MemoryNode next
+ * to each other. MemoryPoolTraversal_DepthFirst places every MemoryNode right
+ * behind the MemoryNode it was first reached from, which suits traversals that
+ * follow long paths.
+ */
+typedef enum {
+    MemoryPoolTraversal_BreadthFirst,
+    MemoryPoolTraversal_DepthFirst,
+} MemoryPoolTraversal;
+
+/*
+ * How a serial garbage collection finds the reachable MemoryNodes.
+ *
+ * MemoryPoolTracer_PointerReversal runs memoryPool_dfs, which needs no
+ * bookkeeping memory, but writes to every MemoryNode it visits and has to wait
+ * for every MemoryNode to be loaded before it can move on.
+ * MemoryPoolTracer_MarkStack keeps the MemoryNodes that still need to be
+ * scanned on a mark stack of bounded size and prefetches them a few steps
+ * before they are scanned, so that the loads overlap. It only writes the
+ * marks. Should the mark stack overflow, the MemoryNodes that do not fit are
+ * marked with memoryPool_dfs instead.
+ */
+typedef enum {
+    MemoryPoolTracer_PointerReversal,
+    MemoryPoolTracer_MarkStack,
+} MemoryPoolTracer;
+
+/*
+ * The number of size classes the free MemoryPoolNodes are segregated into.
+ */
+enum { MemoryPool_SizeClassCount = 62 };
+
+/*
+ * Where a block of a MemoryPool lies: in the pool itself, in the nursery of
+ * the generational mode or in a mapping of its own as a large object.
+ */
+typedef enum {
+    MemoryPoolHeapSpace_Pool,
+    MemoryPoolHeapSpace_Nursery,
+    MemoryPoolHeapSpace_Large,
+} MemoryPoolHeapSpace;
+
+/*
+ * A block of memory of a MemoryPool, as seen by memoryPool_walk_heap. The size
+ * includes the header. A free block has no MemoryNode and no neighbours.
+ */
+typedef struct {
+    void const *address;
+    size_t size;
+    MemoryPoolHeapSpace space;
+    bool free;
+    bool marked;
+    uint16_t neighbourCount;
+    MemoryNode *memoryNode;
+} MemoryPoolHeapBlock;
+
+/*
+ * Visits a block of a heap walk. Returning false stops the walk.
+ */
+typedef bool (*MemoryPoolHeapVisitor)(MemoryPoolHeapBlock const *block, void *context);
+
+/*
+ * The number of return addresses an allocation site keeps of a backtrace.
+ */
+enum { MemoryPoolAllocationSite_MaxFrames = 8 };
+
+/*
+ * What the allocation sampling knows about an allocation site, identified by
+ * its tag or, without a tag, by the backtrace of the allocation. Byte counts
+ * are estimates of all allocations of the site, derived from the sampled
+ * ones. Lifetimes are measured in bytes the pool allocated between the
+ * allocation and the collection that found the MemoryNode dead.
+ */
+typedef struct {
+    char const *tag;
+    void *frames[MemoryPoolAllocationSite_MaxFrames];
+    size_t frameCount;
+    size_t samples;
+    size_t allocatedBytes;
+    size_t survivingBytes;
+    size_t deaths;
+    uint64_t averageLifetime;
+} MemoryPoolAllocationSite;
+
+/*
+ * Visits an allocation site of a report. Returning false stops the report.
+ */
+typedef bool (*MemoryPoolSiteVisitor)(MemoryPoolAllocationSite const *site, void *context);
+
+/*
+ * The number of buckets of the pause time histogram of MemoryPoolStats.
+ */
+enum { MemoryPoolStats_PauseBuckets = 24 };
+
+/*
+ * A snapshot of the statistics of a MemoryPool, see memoryPool_get_stats.
+ * Durations are in nanoseconds. Bucket i of the pause histogram counts the
+ * pauses of at least 2^i and less than 2^(i + 1) microseconds, the first
+ * bucket also counts the shorter pauses and the last one the longer pauses.
+ */
+typedef struct {
+    size_t collections;
+    uint64_t markTime;
+    uint64_t sweepTime;
+    uint64_t pauseTime;
+    uint64_t lastPause;
+    uint64_t maxPause;
+    size_t pauseHistogram[MemoryPoolStats_PauseBuckets];
+    size_t reclaimedBytes;
+    size_t allocations;
+    size_t failedAllocations;
+    size_t liveNodes;
+    size_t liveBytes;
+    size_t freeBytes;
+    size_t freeBlocks;
+    size_t largestFreeBlock;
+    size_t rootSetSize;
+} MemoryPoolStats;
+
 /*
  * The MemoryPool holds a certain amount of memory from which MemoryNodes can be
  * allocated. The pool is garbage collected.
  *
  * A MemoryNode is considered garbage, if it is not a root node and if it can
  * not be (transitively) reached by from any root node.
+ *
+ * Free memory is tracked in segregated free lists, so allocating a MemoryNode
+ * takes about the same time regardless of how many MemoryNodes are alive.
  */
 typedef struct {
     MemoryPoolNode *head;
     MemoryNode **rootSet;
     size_t rootSetSize;
     size_t rootSetCapacity;
+    size_t *rootCounts;
+    size_t *rootIndex;
     FreeFn freeFn;
+    MemoryPoolNode *freeLists[MemoryPool_SizeClassCount];
+    uint64_t freeListMask;
+    MemoryPoolGenerations *generations;
+    MemoryPoolThreads *threads;
+    MemoryPoolLargeObject *largeObjects;
+    MemoryPoolGrowth *growth;
+    size_t size;
+    MemoryPoolArena arena;
+    MemoryPoolPlacement placement;
+    MemoryPoolNode *rover;
+    MemoryPoolNode *freeTree;
+    MemoryPoolHandles *handles;
+    MemoryPoolMarkers *markers;
+    MemoryPoolMarking *marking;
+    bool lazySweep;
+    MemoryPoolNode *sweepCursor;
+    MemoryPoolNode *sweepRun;
+    MemoryPoolSweepers *sweepers;
+    MemoryPoolMarkBitmap *markBitmap;
+    MemoryPoolTracer tracer;
+    MemoryPoolFinalizers *finalizers;
+    MemoryPoolAutoGc *autoGc;
+    size_t freeBytes;
+    MemoryPoolStatsCounters *stats;
+    MemoryPoolSampler *sampler;
 } MemoryPool;
 
 
 MemoryPool memory_pool_new(size_t pool_size, FreeFn freeFn);
+
+/*
+ * Like memory_pool_new, but takes the memory of the pool and of all segments
+ * it grows by from `arena`. The size of mapped pools is rounded up to whole
+ * pages.
+ */
+MemoryPool memory_pool_new_arena(size_t pool_size, FreeFn freeFn, MemoryPoolArena arena);
+
+/*
+ * Like memory_pool_new_arena, but lets serial garbage collections find the
+ * reachable MemoryNodes with `tracer`. The other constructors use
+ * MemoryPoolTracer_PointerReversal.
+ */
+MemoryPool memory_pool_new_tracer(size_t pool_size, FreeFn freeFn, MemoryPoolArena arena, MemoryPoolTracer tracer);
 void memoryPool_free(MemoryPool *memoryPool);
 
 /*
- * Requires that  `data size + sizeof(void*) * neighbours < 1ULL << 16`.
+ * Requires that `neighbours < 1ULL << 16`.
+ * MemoryNodes with `data size + sizeof(void*) * neighbours` of 64 KiB or more
+ * do not fit into a MemoryPoolNode. They are placed in the large object space
+ * instead, where each of them gets its own mapping that is released as soon
+ * as the MemoryNode is collected.
  */
 MemoryNode *memoryPool_alloc(MemoryPool *memoryPool, size_t data_size, size_t neighbours);
+
+/*
+ * Allocates `count` MemoryNodes of the same size at once and stores them in
+ * `out`. The MemoryNodes are carved out of contiguous free memory in a single
+ * pass, so they are placed next to each other where possible.
+ * Either all MemoryNodes are allocated or none is.
+ */
+bool memoryPool_alloc_bulk(MemoryPool *memoryPool, size_t count, size_t data_size, size_t neighbours, MemoryNode **out);
+
+/*
+ * Returns MemoryNodes to the pool right away, without calling the FreeFn.
+ * Only intended for MemoryNodes that were just allocated and that are not
+ * referenced by any other MemoryNode or the root set. While a collection
+ * started by memoryPool_gc_start or memoryPool_gc_start_concurrent is marking,
+ * the MemoryNodes are only returned once it has finished.
+ */
+void memoryPool_release_nodes(MemoryPool *memoryPool, MemoryNode *const *memoryNodes, size_t count);
+
+/*
+ * Adds a MemoryNode to the root set. A MemoryNode that already is a root is
+ * not added again, it only has to be removed once more before it stops being
+ * a root.
+ */
 bool memoryPool_add_root_node(MemoryPool *memoryPool, MemoryNode *memoryNode);
+
+/*
+ * Undoes one memoryPool_add_root_node of the MemoryNode in constant time.
+ * Returns false if the MemoryNode is not a root.
+ */
+bool memoryPool_remove_root_node(MemoryPool *memoryPool, MemoryNode const *memoryNode);
 void memoryPool_gc_mark_and_sweep(MemoryPool *memoryPool);
 
+/*
+ * Compacts the pool: Marks all reachable MemoryNodes like
+ * memoryPool_gc_mark_and_sweep, but then slides the surviving MemoryNodes
+ * towards the start of their segment instead of leaving holes behind. The free
+ * memory of each segment afterwards is one contiguous block at its end, split
+ * into MemoryPoolNodes of at most 64 KiB.
+ *
+ * All MemoryNodes of the pool may move. Pointers to them are updated in the
+ * root set, in the neighbours of other MemoryNodes and in handles, any other
+ * pointer to a MemoryNode is invalid afterwards. Large objects and young
+ * MemoryNodes do not move. The data of a MemoryNode is moved with memmove, so
+ * it must not point into itself.
+ */
+void memoryPool_gc_mark_compact(MemoryPool *memoryPool);
+
+/*
+ * Collects the pool by copying: All MemoryNodes that are reachable from the
+ * root set are evacuated into a new space in the given `order`, then the old
+ * memory of the pool is released as a whole. The FreeFn is only called for
+ * MemoryNodes that were not evacuated, so the cost is proportional to the live
+ * MemoryNodes if the pool has no FreeFn. The pool needs twice its size for the
+ * duration of the collection and falls back to memoryPool_gc_mark_and_sweep if
+ * the new space cannot be allocated.
+ *
+ * Afterwards the pool consists of a single space. MemoryNodes move in the same
+ * way as with memoryPool_gc_mark_compact.
+ */
+void memoryPool_gc_copy(MemoryPool *memoryPool, MemoryPoolTraversal order);
+
+/*
+ * A handle is a pointer to a MemoryNode that is owned by the pool and updated
+ * whenever the MemoryNode moves. Handles do not keep a MemoryNode alive, they
+ * are set to NULL once the MemoryNode is collected.
+ * Returns NULL if the handle could not be allocated.
+ */
+MemoryNode **memoryPool_new_handle(MemoryPool *memoryPool, MemoryNode *memoryNode);
+void memoryPool_free_handle(MemoryPool *memoryPool, MemoryNode **handle);
+
+/*
+ * Starts a collection that marks the pool on a background thread. Meanwhile
+ * the pool can be used as usual, from multiple threads if the thread safe mode
+ * is enabled. MemoryNodes that are reachable when the collection starts or
+ * that are allocated before it finishes are not collected.
+ * memoryPool_gc_finish ends the collection with a short pause, in which no
+ * other call on the pool may run. If the thread cannot be started, all marking
+ * happens in that pause. The same holds for the start of the collection,
+ * which also must not overlap with memoryNode_setNeighbour on MemoryNodes of
+ * the pool. The other threads have to synchronise with the thread that starts
+ * the collection before they use the pool again, for example by waiting on a
+ * lock or a barrier, so that they see the collection.
+ *
+ * Cannot be combined with the generational mode. No other collection may be
+ * started before the collection has finished. Returns false if the
+ * collection could not be started.
+ */
+bool memoryPool_gc_start_concurrent(MemoryPool *memoryPool);
+
+/*
+ * Starts a collection that is marked incrementally by memoryPool_gc_step,
+ * so that a single threaded program can spread the marking over many short
+ * pauses. The same guarantees and restrictions as for
+ * memoryPool_gc_start_concurrent apply. Returns false if the collection could
+ * not be started.
+ */
+bool memoryPool_gc_start(MemoryPool *memoryPool);
+
+/*
+ * Scans the neighbours of up to `budget` MemoryNodes of a collection started
+ * by memoryPool_gc_start. Returns whether marking work is left. Once it returns
+ * false, memoryPool_gc_finish only has little work left to do.
+ */
+bool memoryPool_gc_step(MemoryPool *memoryPool, size_t budget);
+
+/*
+ * Finishes the marking of a collection that has been started before and
+ * sweeps the pool.
+ */
+void memoryPool_gc_finish(MemoryPool *memoryPool);
+
+/*
+ * Enables the generational mode. New MemoryNodes are then bump allocated in a
+ * nursery of `nursery_size` bytes and only promoted into the pool if they
+ * survive a collection. Once the nursery is full, new MemoryNodes are
+ * allocated in the pool directly.
+ *
+ * Young MemoryNodes move when they are promoted. Pointers to them are only
+ * updated in the root set, in the neighbours of other MemoryNodes and in
+ * handles, so any other pointer to a young MemoryNode is invalid after a
+ * collection.
+ */
+bool memoryPool_enable_generational(MemoryPool *memoryPool, size_t nursery_size);
+
+/*
+ * Collects only the nursery. The cost is proportional to the amount of young
+ * MemoryNodes that survive, instead of to the size of the pool.
+ * `memoryPool_gc_mark_and_sweep` collects the nursery as well as the pool.
+ */
+void memoryPool_gc_minor(MemoryPool *memoryPool);
+
+/*
+ * Enables the thread safe mode, in which multiple threads may allocate
+ * MemoryNodes and add root nodes at the same time. Each thread allocates from
+ * its own thread local allocation buffer of `tlab_size` bytes, or of a default
+ * size if `tlab_size` is 0, and only synchronises with other threads to claim
+ * a new buffer.
+ *
+ * Garbage collection must not run concurrently with any other call on the
+ * pool. The thread safe mode cannot be combined with the generational mode.
+ */
+bool memoryPool_enable_thread_safe_alloc(MemoryPool *memoryPool, size_t tlab_size);
+
+/*
+ * Lets every garbage collection mark the reachable MemoryNodes with `workers`
+ * threads, the collecting thread included. The workers balance their load by
+ * stealing MemoryNodes that still need to be scanned from each other.
+ * Without parallel marking the pool is marked by the MemoryPoolTracer it was
+ * created with, which cannot be split up between threads.
+ */
+bool memoryPool_enable_parallel_mark(MemoryPool *memoryPool, size_t workers);
+
+/*
+ * Calls `visitor` with `context` for every block of the pool in the order of
+ * the list of all MemoryPoolNodes, then for the young MemoryNodes and then for
+ * the large objects. Returns false if the visitor stopped the walk. The
+ * visitor must not allocate from or collect the pool. Garbage that a lazy
+ * sweep has not reached yet shows up as in use, and outside of a collection
+ * MemoryNodes are only marked while an incremental or concurrent marking is in
+ * progress or a lazy sweep has not reached them yet.
+ */
+bool memoryPool_walk_heap(MemoryPool const *memoryPool, MemoryPoolHeapVisitor visitor, void *context);
+
+/*
+ * Lets the pool count its collections and allocations for
+ * memoryPool_get_stats: the number of collections, the time spent marking and
+ * sweeping, the pause times, the reclaimed bytes and the number of successful
+ * and failed allocations. Every full collection counts, including compactions
+ * and copying collections, whose time after marking counts as sweep time.
+ * Returns false if the counters could not be allocated.
+ */
+bool memoryPool_enable_stats(MemoryPool *memoryPool);
+
+/*
+ * Fills in `stats`. The counters are zero unless memoryPool_enable_stats was
+ * called. The rest describes the heap as it is now and is computed by walking
+ * all MemoryNodes: the MemoryNodes in use, including young MemoryNodes and
+ * large objects, and their bytes including headers, the free bytes of the
+ * pool, the number of free blocks and the largest allocation a single free
+ * block can hold, and the size of the root set. Garbage that a lazy sweep has
+ * not reached yet counts as in use. Like garbage collection, this requires
+ * that no other thread uses the pool.
+ */
+void memoryPool_get_stats(MemoryPool const *memoryPool, MemoryPoolStats *stats);
+
+/*
+ * Samples the allocations of memoryPool_alloc and memoryPool_alloc_bulk, about
+ * one per `interval` allocated bytes at random distances, and attributes them
+ * to the current allocation site. Every sampled MemoryNode is followed till a
+ * collection finds it dead. Without sampling an allocation pays one branch,
+ * and with it a sampled allocation takes a handle and, without a tag, a
+ * backtrace. Sampling cannot be combined with the thread safe mode. Returns
+ * false if the state could not be allocated.
+ */
+bool memoryPool_enable_sampling(MemoryPool *memoryPool, size_t interval);
+
+/*
+ * Attributes the following allocations to `tag`, which must stay valid as
+ * long as the pool. Tags are compared as strings. NULL attributes them to
+ * their backtraces instead, which is the default.
+ */
+void memoryPool_set_allocation_site(MemoryPool *memoryPool, char const *tag);
+
+/*
+ * Calls `visitor` with `context` for every allocation site sampled so far, in
+ * the order they were first sampled.
+ */
+void memoryPool_report_allocation_sites(MemoryPool const *memoryPool, MemoryPoolSiteVisitor visitor, void *context);
+
+/*
+ * Lets memoryPool_alloc and memoryPool_alloc_bulk collect garbage on their
+ * own: when an allocation does not fit, the pool is collected and the
+ * allocation retried, and before that a collection is triggered once enough
+ * bytes have been allocated since the last one. The amount adapts to how much
+ * of the pool survived the recent collections. Every allocation may therefore
+ * collect MemoryNodes that are not reachable from the root set, and move young
+ * MemoryNodes in generational mode. The automatic collection cannot be combined
+ * with the thread safe mode. Returns false if the state could not be
+ * allocated.
+ */
+bool memoryPool_enable_auto_gc(MemoryPool *memoryPool);
+
+/*
+ * Decides whether an allocation should collect first, given the bytes that
+ * have been allocated since the last collection, including the allocation.
+ */
+typedef bool (*MemoryPoolGcTrigger)(MemoryPool const *memoryPool, size_t allocated, void *context);
+
+/*
+ * Replaces the heuristic of memoryPool_enable_auto_gc with `trigger`, which is
+ * called with `context` before every allocation. Allocations that do not fit
+ * still collect and retry. NULL restores the heuristic.
+ */
+void memoryPool_set_gc_trigger(MemoryPool *memoryPool, MemoryPoolGcTrigger trigger, void *context);
+
+/*
+ * Lets sweeps queue dead MemoryNodes instead of calling the FreeFn on them, so
+ * that the FreeFn runs outside of the pause: on `workers` background threads,
+ * or, with 0 workers, in memoryPool_run_finalizers. The FreeFn must then be
+ * thread safe. The memory of a MemoryNode is only reused once its FreeFn has
+ * returned. Large objects and young MemoryNodes are still finalized during the
+ * collection. Returns false if the state or the threads could not be created.
+ */
+bool memoryPool_enable_background_finalizers(MemoryPool *memoryPool, size_t workers);
+
+/*
+ * Calls the FreeFn of up to `budget` queued MemoryNodes on the calling thread
+ * and returns the memory of all finalized MemoryNodes to the pool. Returns
+ * whether MemoryNodes are still waiting to be finalized.
+ */
+bool memoryPool_run_finalizers(MemoryPool *memoryPool, size_t budget);
+
+/*
+ * Lets memoryPool_gc_mark_and_sweep keep the marks in a bitmap beside the pool,
+ * with one bit per 8 bytes, instead of in the MemoryNodes. Marking then only
+ * reads the MemoryNodes, the sweep reads the marks from the bitmap and clears
+ * them all at once, and without a FreeFn it skips over garbage without
+ * looking at it. Marking into the bitmap uses the marker of the parallel mode,
+ * with a single worker unless memoryPool_enable_parallel_mark has been called
+ * before. Returns false if the state could not be allocated.
+ */
+bool memoryPool_enable_mark_bitmap(MemoryPool *memoryPool);
+
+/*
+ * Lets every collection sweep the pool with `workers` threads, one of which is
+ * the collecting thread. The pool is split into regions at the first sweep,
+ * which still runs serially, and the regions are swept in parallel from then
+ * on. The FreeFn is called from all of these threads at the same time, so it
+ * must be thread safe. Lazy sweeping takes precedence over this mode.
+ * Returns false if the state could not be allocated.
+ */
+bool memoryPool_enable_parallel_sweep(MemoryPool *memoryPool, size_t workers);
+
+/*
+ * Lets the pool grow once an allocation does not fit into its free memory.
+ * The pool then allocates a new segment that is as large as the pool already
+ * is, so the size of the pool doubles, but never exceeds `max_pool_size`
+ * bytes. `max_pool_size` 0 means that the pool may grow without limit.
+ *
+ * Segments that are entirely free after a collection are released again,
+ * starting with the most recently added one.
+ */
+bool memoryPool_enable_growth(MemoryPool *memoryPool, size_t max_pool_size);
+
+/*
+ * Enables lazy sweeping. A collection then only marks the pool, and
+ * memoryPool_alloc sweeps just as many MemoryPoolNodes as it needs to find a
+ * fit, calling the FreeFn on the way. What is left to sweep is swept before
+ * the next collection starts. This removes the sweep from the pause, but a
+ * MemoryNode is only finalized once the sweep reaches it. Cannot be combined
+ * with the next fit policy.
+ */
+void memoryPool_enable_lazy_sweep(MemoryPool *memoryPool);
+
+/*
+ * Switches the placement policy of the pool. The default is
+ * MemoryPoolPlacement_SegregatedFit. The next fit policy cannot be combined
+ * with the thread safe mode or lazy sweeping.
+ */
+void memoryPool_set_placement(MemoryPool *memoryPool, MemoryPoolPlacement placement);
+
+/*
+ * Merges physically adjacent free memory into larger MemoryPoolNodes without
+ * collecting garbage. The sweep phase of a garbage collection does the same.
+ */
+void memoryPool_defragment(MemoryPool *memoryPool);
+
 // Only intended to be used for testing!
 void memoryPool_dfs(MemoryNode *current, void (*for_each)(MemoryNode const *));
 
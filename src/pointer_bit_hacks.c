@@ -29,6 +29,25 @@ void* set_lowest_bit(void const * const ptr, const bool lowest_bit) {
     return (void*) ((uintptr_t) masked | (uintptr_t) bit);
 }
 
+void* mask_low_bits(void const * const ptr) {
+    const uintptr_t mask = ~7ULL;
+    return (void*) ((uintptr_t) ptr & mask);
+}
+
+bool extract_low_bit(void const * const ptr, const uint8_t index) {
+    return (bool) ((uintptr_t) ptr >> index & 1ULL);
+}
+
+void* set_low_bit(void const * const ptr, const uint8_t index, const bool bit) {
+    const uintptr_t masked = (uintptr_t) ptr & ~(1ULL << index);
+    return (void*) (masked | (uintptr_t) (bit ? 1 : 0) << index);
+}
+
 void* extract_ptr_bits(void const * const ptr) {
-    return mask_lowest_bit(mask_top_bits(ptr));
+    return mask_low_bits(mask_top_bits(ptr));
+}
+
+void* replace_ptr_bits(void const * const tagged, void const * const ptr) {
+    const uintptr_t tags = (uintptr_t) tagged - (uintptr_t) extract_ptr_bits(tagged);
+    return (void*) ((uintptr_t) extract_ptr_bits(ptr) | tags);
 }
\ No newline at end of file
@@ -10,5 +10,9 @@ void* set_top_bits(void const * ptr, uint16_t top_bits);
 void* mask_lowest_bit(void const * ptr);
 bool extract_lowest_bit(void const * ptr);
 void* set_lowest_bit(void const * ptr, bool lowest_bit);
+void* mask_low_bits(void const * ptr);
+bool extract_low_bit(void const * ptr, uint8_t index);
+void* set_low_bit(void const * ptr, uint8_t index, bool bit);
 void* extract_ptr_bits(void const * ptr);
+void* replace_ptr_bits(void const * tagged, void const * ptr);
 #endif
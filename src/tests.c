@@ -1,7 +1,11 @@
 #include "tests.h"
 #include "assert.h"
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
 #include "memory.h"
 #include "memory_pool.h"
+#include "heap_dump.h"
 
 static const size_t DEFAULT_POOL_SIZE = 1ULL << 10;
 
@@ -347,6 +351,1612 @@ static void test_many_root_nodes() {
     free_out();
 }
 
+static void test_alloc_after_pool_is_full() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+
+    int count = 0;
+    while (memoryPool_alloc(&pool, sizeof(uint64_t), 0)) ++count;
+    assert(count > 0);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    for (int i = 0; i < count; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+        assert(node);
+    }
+
+    memoryPool_free(&pool);
+}
+
+static void test_alloc_searches_size_class() {
+    // Exactly four nodes fit into the pool, so no free space is left over.
+    MemoryPool pool = memory_pool_new(4 * sizeof(void *) + 312 + 16 + 264 + 16, NULL);
+    MemoryNode *const large = memoryPool_alloc(&pool, 304, 0);
+    MemoryNode *const root1 = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+    MemoryNode *const small = memoryPool_alloc(&pool, 256, 0);
+    MemoryNode *const root2 = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+    assert(large && root1 && small && root2);
+    MemoryNode *const overflow = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+    assert(!overflow);
+
+    memoryPool_add_root_node(&pool, root1);
+    memoryPool_add_root_node(&pool, root2);
+    memoryPool_gc_mark_and_sweep(&pool);
+
+    // Both freed nodes share a size class, but only the first one is large enough.
+    MemoryNode *const reusedLarge = memoryPool_alloc(&pool, 296, 0);
+    MemoryNode *const reusedSmall = memoryPool_alloc(&pool, 256, 0);
+    assert(reusedLarge == large);
+    assert(reusedSmall == small);
+    memoryPool_free(&pool);
+}
+
+static void test_sweep_coalesces_free_nodes() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+    const size_t whole_pool = DEFAULT_POOL_SIZE - 2 * sizeof(void *);
+
+    while (memoryPool_alloc(&pool, sizeof(uint64_t), 0));
+    MemoryNode *node = memoryPool_alloc(&pool, whole_pool, 0);
+    assert(!node);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    node = memoryPool_alloc(&pool, whole_pool, 0);
+    assert(node);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    memoryPool_defragment(&pool);
+    node = memoryPool_alloc(&pool, whole_pool, 0);
+    assert(node);
+    memoryPool_free(&pool);
+}
+
+static void churn_does_not_fragment(const MemoryPoolPlacement placement) {
+    MemoryPool pool = memory_pool_new(1ULL << 20, NULL);
+    memoryPool_set_placement(&pool, placement);
+    MemoryNode *const anchor = memoryPool_alloc(&pool, 0, 1);
+    memoryPool_add_root_node(&pool, anchor);
+
+    int first_count = 0;
+    for (int cycle = 0; cycle < 50; ++cycle) {
+        int count = 0;
+        MemoryNode *previous = NULL;
+        for (size_t size = 0;; size = (size + 24) % 200) {
+            MemoryNode *const node = memoryPool_alloc(&pool, size, 1 + count % 3);
+            if (!node)
+                break;
+
+            // Every tenth node of this cycle survives until the next cycle.
+            if (count++ % 10 == 0) {
+                memoryNode_setNeighbour(node, previous, 0);
+                previous = node;
+            }
+        }
+
+        if (cycle == 0)
+            first_count = count;
+
+        assert(count >= first_count * 8 / 10);
+        memoryNode_setNeighbour(anchor, previous, 0);
+        memoryPool_gc_mark_and_sweep(&pool);
+    }
+
+    memoryNode_setNeighbour(anchor, NULL, 0);
+    memoryPool_gc_mark_and_sweep(&pool);
+    MemoryNode *const large = memoryPool_alloc(&pool, 60000, 0);
+    assert(large);
+    memoryPool_free(&pool);
+}
+
+static void test_churn_does_not_fragment() {
+    churn_does_not_fragment(MemoryPoolPlacement_SegregatedFit);
+    churn_does_not_fragment(MemoryPoolPlacement_NextFit);
+    churn_does_not_fragment(MemoryPoolPlacement_BestFit);
+}
+
+static void test_best_fit_takes_smallest_fitting_node() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+    memoryPool_set_placement(&pool, MemoryPoolPlacement_BestFit);
+
+    // Two free nodes of the same size class, the larger one at the end.
+    MemoryNode *const smaller = memoryPool_alloc(&pool, 296, 1);
+    memoryPool_add_root_node(&pool, memoryPool_alloc(&pool, 0, 1));
+    MemoryNode *const larger = memoryPool_alloc(&pool, 304, 1);
+    memoryPool_add_root_node(&pool, memoryPool_alloc(&pool, 0, 1));
+    assert(smaller && larger);
+    memoryPool_gc_mark_and_sweep(&pool);
+
+    MemoryNode *const first = memoryPool_alloc(&pool, 288, 1);
+    MemoryNode *const second = memoryPool_alloc(&pool, 288, 1);
+    assert(first == smaller);
+    assert(second == larger);
+    memoryPool_free(&pool);
+}
+
+static void test_next_fit_resumes_after_last_allocation() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+    memoryPool_set_placement(&pool, MemoryPoolPlacement_NextFit);
+
+    MemoryNode *nodes[8];
+    for (int i = 0; i < 8; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+        if (i != 2 && i != 5)
+            memoryPool_add_root_node(&pool, nodes[i]);
+    }
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    MemoryNode *const first = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    MemoryNode *const second = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    assert(first == nodes[2]);
+    assert(second == nodes[5]);
+
+    // A larger node only fits behind the last node and the cursor stays there.
+    MemoryNode *const large = memoryPool_alloc(&pool, 128, 1);
+    MemoryNode *const small = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    assert((char *) large > (char *) nodes[7]);
+    assert((char *) small > (char *) large);
+    memoryPool_free(&pool);
+}
+
+static void test_generational_minor_promotes_survivors() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    const bool enabled = memoryPool_enable_generational(&pool, DEFAULT_POOL_SIZE);
+    assert(enabled);
+    init_out(3);
+
+    MemoryNode *const garbage = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    *(uint64_t **) memoryNode_get_data(garbage) = &data[0];
+
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    *(uint64_t **) memoryNode_get_data(root) = &data[1];
+    MemoryNode *const child = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    *(uint64_t **) memoryNode_get_data(child) = &data[2];
+    memoryNode_setNeighbour(root, child, 0);
+    memoryNode_setNeighbour(child, root, 0);
+    memoryPool_add_root_node(&pool, root);
+
+    memoryPool_gc_minor(&pool);
+    assert(data[0] == 1 && data[1] == 0 && data[2] == 0);
+
+    MemoryNode *const promoted = pool.rootSet[0];
+    assert(promoted != root);
+    assert(*(uint64_t **) memoryNode_get_data(promoted) == &data[1]);
+
+    MemoryNode *const promotedChild = memoryNode_getNeighbour(promoted, 0);
+    assert(promotedChild != child);
+    assert(*(uint64_t **) memoryNode_get_data(promotedChild) == &data[2]);
+    assert(memoryNode_getNeighbour(promotedChild, 0) == promoted);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(data[1] == 0 && data[2] == 0);
+    memoryPool_free(&pool);
+    assert(all_same(1));
+    free_out();
+}
+
+static void test_generational_write_barrier() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(3);
+
+    // Allocated before the nursery exists, so it is old from the start.
+    MemoryNode *const old = memoryPool_alloc(&pool, sizeof(uint64_t *), 2);
+    *(uint64_t **) memoryNode_get_data(old) = &data[0];
+    memoryPool_add_root_node(&pool, old);
+    const bool enabled = memoryPool_enable_generational(&pool, DEFAULT_POOL_SIZE);
+    assert(enabled);
+
+    MemoryNode *const young = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+    *(uint64_t **) memoryNode_get_data(young) = &data[1];
+    MemoryNode *const overwritten = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+    *(uint64_t **) memoryNode_get_data(overwritten) = &data[2];
+    memoryNode_setNeighbour(old, overwritten, 0);
+    memoryNode_setNeighbour(old, young, 1);
+    memoryNode_setNeighbour(old, NULL, 0);
+
+    memoryPool_gc_minor(&pool);
+    assert(data[0] == 0 && data[1] == 0 && data[2] == 1);
+    assert(pool.rootSet[0] == old);
+    MemoryNode *const promoted = memoryNode_getNeighbour(old, 1);
+    assert(promoted != young);
+    assert(*(uint64_t **) memoryNode_get_data(promoted) == &data[1]);
+    assert(memoryNode_get_neighbour_count(old) == 2);
+
+    memoryPool_gc_minor(&pool);
+    assert(memoryNode_getNeighbour(old, 1) == promoted);
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_generational_nursery_full() {
+    MemoryPool pool = memory_pool_new(1ULL << 16, free_fn);
+    const bool enabled = memoryPool_enable_generational(&pool, 256);
+    assert(enabled);
+    init_out(32);
+
+    MemoryNode *previous = NULL;
+    for (int i = 0; i < 32; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        assert(node);
+        *(uint64_t **) memoryNode_get_data(node) = &data[i];
+        memoryNode_setNeighbour(node, previous, 0);
+        previous = node;
+    }
+
+    memoryPool_add_root_node(&pool, previous);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(all_same(0));
+
+    MemoryNode *node = pool.rootSet[0];
+    for (int i = 31; i >= 0; --i) {
+        assert(*(uint64_t **) memoryNode_get_data(node) == &data[i]);
+        node = memoryNode_getNeighbour(node, 0);
+    }
+
+    assert(!node);
+    memoryPool_free(&pool);
+    assert(all_same(1));
+    free_out();
+}
+
+static void test_generational_promotion_failure() {
+    // The pool is too small to hold all young survivors.
+    MemoryPool pool = memory_pool_new(64, free_fn);
+    const bool enabled = memoryPool_enable_generational(&pool, DEFAULT_POOL_SIZE);
+    assert(enabled);
+    init_out(8);
+
+    MemoryNode *nodes[8];
+    for (int i = 0; i < 8; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+        if (i % 2 == 0)
+            memoryPool_add_root_node(&pool, nodes[i]);
+    }
+
+    memoryPool_gc_minor(&pool);
+    for (int i = 0; i < 8; ++i)
+        assert(data[i] == (uint64_t) (i % 2));
+
+    // The survivors stayed in place.
+    for (int i = 0; i < 4; ++i)
+        assert(pool.rootSet[i] == nodes[2 * i]);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    for (int i = 0; i < 8; ++i)
+        assert(data[i] == (uint64_t) (i % 2));
+
+    memoryPool_free(&pool);
+    assert(all_same(1));
+    free_out();
+}
+
+static int generational_thread(void *const arg) {
+    const uint64_t first = *(uint64_t const *) arg;
+    for (uint64_t i = 0; i < 200; ++i) {
+        MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+        MemoryNode *const old = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+        memoryPool_add_root_node(&pool, old);
+        const bool enabled = memoryPool_enable_generational(&pool, DEFAULT_POOL_SIZE);
+        assert(enabled);
+
+        MemoryNode *const young = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+        *(uint64_t *) memoryNode_get_data(young) = first + i;
+        memoryNode_setNeighbour(old, young, 0);
+        memoryPool_gc_minor(&pool);
+        assert(*(uint64_t *) memoryNode_get_data(memoryNode_getNeighbour(old, 0)) == first + i);
+        memoryPool_free(&pool);
+    }
+
+    return 0;
+}
+
+static void test_generational_pools_on_many_threads() {
+    // Each thread enables and frees generational pools while the others go
+    // through the write barrier.
+    uint64_t firsts[4];
+    thrd_t ids[4];
+    for (int t = 0; t < 4; ++t) {
+        firsts[t] = (uint64_t) t * 1000;
+        const int created = thrd_create(&ids[t], generational_thread, &firsts[t]);
+        assert(created == thrd_success);
+    }
+
+    for (int t = 0; t < 4; ++t)
+        thrd_join(ids[t], NULL);
+}
+
+enum { THREAD_COUNT = 4, NODES_PER_THREAD = 2000 };
+
+typedef struct {
+    MemoryPool *pool;
+    uint64_t first;
+    MemoryNode *nodes[NODES_PER_THREAD];
+} AllocThread;
+
+static int alloc_thread(void *const arg) {
+    AllocThread *const thread = arg;
+    for (uint64_t i = 0; i < NODES_PER_THREAD; ++i) {
+        MemoryNode *const node = memoryPool_alloc(thread->pool, sizeof(uint64_t), i % 3);
+        assert(node);
+        *(uint64_t *) memoryNode_get_data(node) = thread->first + i;
+        thread->nodes[i] = node;
+        if (i % 100 == 0)
+            memoryPool_add_root_node(thread->pool, node);
+    }
+
+    return 0;
+}
+
+static void test_thread_safe_alloc() {
+    MemoryPool pool = memory_pool_new(1ULL << 20, NULL);
+    const bool enabled = memoryPool_enable_thread_safe_alloc(&pool, 1024);
+    assert(enabled);
+
+    for (size_t round = 0; round < 2; ++round) {
+        static AllocThread threads[THREAD_COUNT];
+        thrd_t ids[THREAD_COUNT];
+        for (int t = 0; t < THREAD_COUNT; ++t) {
+            threads[t].pool = &pool;
+            threads[t].first = t * NODES_PER_THREAD;
+            const int created = thrd_create(&ids[t], alloc_thread, &threads[t]);
+            assert(created == thrd_success);
+        }
+
+        for (int t = 0; t < THREAD_COUNT; ++t)
+            thrd_join(ids[t], NULL);
+
+        for (int t = 0; t < THREAD_COUNT; ++t)
+            for (uint64_t i = 0; i < NODES_PER_THREAD; ++i)
+                assert(*(uint64_t *) memoryNode_get_data(threads[t].nodes[i]) == threads[t].first + i);
+
+        assert(pool.rootSetSize == (round + 1) * THREAD_COUNT * NODES_PER_THREAD / 100);
+        memoryPool_gc_mark_and_sweep(&pool);
+    }
+
+    memoryPool_free(&pool);
+}
+
+enum { HANDLES_PER_THREAD = 600 };
+
+static int handle_thread(void *const arg) {
+    AllocThread *const thread = arg;
+    MemoryNode **handles[HANDLES_PER_THREAD];
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < HANDLES_PER_THREAD; ++i) {
+            handles[i] = memoryPool_new_handle(thread->pool, thread->nodes[i % NODES_PER_THREAD]);
+            assert(handles[i]);
+        }
+
+        // No other thread may have been handed the same slot.
+        for (int i = 0; i < HANDLES_PER_THREAD; ++i) {
+            assert(*handles[i] == thread->nodes[i % NODES_PER_THREAD]);
+            memoryPool_free_handle(thread->pool, handles[i]);
+        }
+    }
+
+    return 0;
+}
+
+static void test_thread_safe_handles() {
+    MemoryPool pool = memory_pool_new(1ULL << 20, NULL);
+    const bool enabled = memoryPool_enable_thread_safe_alloc(&pool, 1024);
+    assert(enabled);
+
+    static AllocThread threads[THREAD_COUNT];
+    thrd_t ids[THREAD_COUNT];
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads[t].pool = &pool;
+        for (int i = 0; i < NODES_PER_THREAD; ++i) {
+            threads[t].nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t), 0);
+            assert(threads[t].nodes[i]);
+        }
+    }
+
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        const int created = thrd_create(&ids[t], handle_thread, &threads[t]);
+        assert(created == thrd_success);
+    }
+
+    for (int t = 0; t < THREAD_COUNT; ++t)
+        thrd_join(ids[t], NULL);
+
+    memoryPool_free(&pool);
+}
+
+static void test_thread_safe_pools_share_thread() {
+    // Pools whose ids are TLAB_CACHE_SIZE apart used to evict each other's
+    // TLAB on every allocation, losing its rest until the next collection.
+    MemoryPool pools[5];
+    for (int i = 0; i < 5; ++i) {
+        pools[i] = memory_pool_new(8 * 1024, NULL);
+        const bool enabled = memoryPool_enable_thread_safe_alloc(&pools[i], 1024);
+        assert(enabled);
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        MemoryNode *const first = memoryPool_alloc(&pools[0], sizeof(uint64_t), 0);
+        MemoryNode *const second = memoryPool_alloc(&pools[4], sizeof(uint64_t), 0);
+        assert(first && second);
+    }
+
+    for (int i = 0; i < 5; ++i)
+        memoryPool_free(&pools[i]);
+}
+
+static void test_alloc_bulk_contiguous() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(16);
+
+    MemoryNode *nodes[16];
+    const bool allocated = memoryPool_alloc_bulk(&pool, 16, sizeof(uint64_t *), 1, nodes);
+    assert(allocated);
+    for (int i = 0; i < 16; ++i) {
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+        if (i > 0)
+            assert((char *) nodes[i] - (char *) nodes[i - 1] == 24);
+    }
+
+    memoryPool_add_root_node(&pool, nodes[0]);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(data[0] == 0);
+    for (int i = 1; i < 16; ++i)
+        assert(data[i] == 1);
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_alloc_bulk_all_or_nothing() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+
+    MemoryNode *nodes[64];
+    const bool tooMany = memoryPool_alloc_bulk(&pool, 64, sizeof(uint64_t), 1, nodes);
+    assert(!tooMany);
+    const bool allocated = memoryPool_alloc_bulk(&pool, DEFAULT_POOL_SIZE / 24 - 1, sizeof(uint64_t), 1, nodes);
+    assert(allocated);
+    memoryPool_release_nodes(&pool, nodes, DEFAULT_POOL_SIZE / 24 - 1);
+
+    // The released nodes are merged again by the next sweep.
+    memoryPool_gc_mark_and_sweep(&pool);
+    MemoryNode *const whole = memoryPool_alloc(&pool, DEFAULT_POOL_SIZE - 2 * sizeof(uint64_t), 0);
+    assert(whole);
+
+    memoryPool_free(&pool);
+}
+
+static void test_large_objects() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(5);
+
+    // A buffer as well as a MemoryNode with many neighbours exceed 64 KiB.
+    const size_t buffer_size = 1ULL << 20;
+    MemoryNode *const buffer = memoryPool_alloc(&pool, buffer_size, 1);
+    MemoryNode *const wide = memoryPool_alloc(&pool, sizeof(uint64_t *), 10000);
+    MemoryNode *const small = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    MemoryNode *const garbage = memoryPool_alloc(&pool, buffer_size, 0);
+    assert(buffer && wide && small && garbage);
+
+    char *const bytes = memoryNode_get_data(buffer);
+    memset(bytes, 0xAB, buffer_size);
+    *(uint64_t **) bytes = &data[0];
+    *(uint64_t **) memoryNode_get_data(wide) = &data[1];
+    *(uint64_t **) memoryNode_get_data(small) = &data[2];
+    *(uint64_t **) memoryNode_get_data(garbage) = &data[3];
+
+    memoryNode_setNeighbour(small, wide, 0);
+    memoryNode_setNeighbour(wide, buffer, 9999);
+    memoryNode_setNeighbour(buffer, small, 0);
+    memoryPool_add_root_node(&pool, small);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1);
+    assert(memoryNode_get_neighbour_count(wide) == 10000);
+    assert(memoryNode_getNeighbour(wide, 9999) == buffer);
+    assert((unsigned char) bytes[buffer_size - 1] == 0xAB);
+
+    // The small MemoryNodes of the pool are not affected.
+    MemoryNode *const half = memoryPool_alloc(&pool, DEFAULT_POOL_SIZE / 2, 0);
+    assert(half);
+    *(uint64_t **) memoryNode_get_data(half) = &data[4];
+
+    memoryNode_setNeighbour(small, NULL, 0);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(data[0] == 1 && data[1] == 1 && data[2] == 0);
+    assert(!pool.largeObjects);
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_growth() {
+    const size_t max_size = 64 * DEFAULT_POOL_SIZE;
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+    const bool enabled = memoryPool_enable_growth(&pool, max_size);
+    assert(enabled);
+
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    memoryPool_add_root_node(&pool, root);
+
+    uint64_t count = 0;
+    MemoryNode *previous = root;
+    MemoryNode *node;
+    while ((node = memoryPool_alloc(&pool, sizeof(uint64_t), 1))) {
+        *(uint64_t *) memoryNode_get_data(node) = count++;
+        memoryNode_setNeighbour(previous, node, 0);
+        previous = node;
+    }
+
+    // Nearly all of the maximum size is used, not only the initial size.
+    assert(pool.size > max_size / 2 && pool.size <= max_size);
+    assert(count > (max_size / 2) / 24);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    node = memoryNode_getNeighbour(root, 0);
+    for (uint64_t i = 0; i < count; ++i, node = memoryNode_getNeighbour(node, 0))
+        assert(*(uint64_t *) memoryNode_get_data(node) == i);
+
+    // Once the nodes are garbage, all segments but the initial one are freed.
+    memoryNode_setNeighbour(root, NULL, 0);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(pool.size == DEFAULT_POOL_SIZE);
+    MemoryNode *const large = memoryPool_alloc(&pool, 2 * DEFAULT_POOL_SIZE, 0);
+    assert(large);
+    assert(pool.size > DEFAULT_POOL_SIZE);
+
+    memoryPool_free(&pool);
+}
+
+static void test_growth_keeps_segments_apart() {
+    // A new mapping is usually placed right below the initial space, but no
+    // free MemoryPoolNode may span both.
+    const size_t initial_size = (1ULL << 20) + 4096;
+    MemoryPool pool = memory_pool_new_arena(initial_size, NULL, MemoryPoolArena_Mapped);
+    const bool enabled = memoryPool_enable_growth(&pool, 0);
+    assert(enabled);
+
+    MemoryPoolStats before;
+    memoryPool_get_stats(&pool, &before);
+    while (pool.size == initial_size) {
+        MemoryNode *const node = memoryPool_alloc(&pool, 1024, 0);
+        assert(node);
+    }
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    memoryPool_gc_mark_compact(&pool);
+    memoryPool_gc_mark_and_sweep(&pool);
+    MemoryPoolStats after;
+    memoryPool_get_stats(&pool, &after);
+    assert(pool.size == initial_size);
+    assert(after.freeBytes == before.freeBytes);
+    memoryPool_free(&pool);
+}
+
+static void test_mapped_arena_releases_free_pages() {
+    MemoryPool pool = memory_pool_new_arena(1ULL << 20, NULL, MemoryPoolArena_Mapped);
+    assert(pool.head);
+
+    const size_t size = 60000;
+    MemoryNode *const garbage = memoryPool_alloc(&pool, size, 0);
+    unsigned char *const bytes = memoryNode_get_data(garbage);
+    memset(bytes, 0xAB, size);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    // Only whole pages in the middle are released, the pool still owns them.
+    for (size_t i = size / 4; i < size / 2; ++i)
+        assert(bytes[i] == 0);
+
+    MemoryNode *const node = memoryPool_alloc(&pool, size, 0);
+    memset(memoryNode_get_data(node), 0xCD, size);
+    memoryPool_add_root_node(&pool, node);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(((unsigned char *) memoryNode_get_data(node))[size / 2] == 0xCD);
+
+    memoryPool_free(&pool);
+}
+
+static void test_huge_page_arenas() {
+    const MemoryPoolArena arenas[] = {MemoryPoolArena_HugePages, MemoryPoolArena_HugeTlb};
+    for (int a = 0; a < 2; ++a) {
+        MemoryPool pool = memory_pool_new_arena(DEFAULT_POOL_SIZE, NULL, arenas[a]);
+        assert(pool.head);
+        assert(((uintptr_t) pool.head & ((2ULL << 20) - 1)) == 0);
+
+        // The pool is rounded up to a whole huge page.
+        assert(pool.size == 2ULL << 20);
+        const bool enabled = memoryPool_enable_growth(&pool, 0);
+        assert(enabled);
+        for (int i = 0; i < 100000; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+            assert(node);
+        }
+
+        assert(pool.size == 4ULL << 20);
+        memoryPool_gc_mark_and_sweep(&pool);
+        assert(pool.size == 2ULL << 20);
+        memoryPool_free(&pool);
+    }
+}
+
+static void test_mark_compact_slides_live_nodes() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(6);
+
+    MemoryNode *nodes[6];
+    for (int i = 0; i < 6; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 2);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+    }
+
+    memoryNode_setNeighbour(nodes[5], nodes[3], 0);
+    memoryNode_setNeighbour(nodes[3], nodes[1], 1);
+    memoryNode_setNeighbour(nodes[1], nodes[5], 0);
+    memoryPool_add_root_node(&pool, nodes[5]);
+    MemoryNode **const live = memoryPool_new_handle(&pool, nodes[3]);
+    MemoryNode **const dead = memoryPool_new_handle(&pool, nodes[4]);
+
+    // The holes left by the garbage are too small for this node.
+    const size_t rest = DEFAULT_POOL_SIZE - 3 * (sizeof(MemoryPoolNode) + 3 * sizeof(void *)) - sizeof(MemoryPoolNode);
+    MemoryNode *const tooLarge = memoryPool_alloc(&pool, rest - sizeof(void *), 1);
+    assert(!tooLarge);
+    memoryPool_gc_mark_compact(&pool);
+    assert(data[0] == 1 && data[2] == 1 && data[4] == 1);
+    assert(data[1] == 0 && data[3] == 0 && data[5] == 0);
+
+    MemoryNode *const root = pool.rootSet[0];
+    MemoryNode *const middle = memoryNode_getNeighbour(root, 0);
+    MemoryNode *const first = memoryNode_getNeighbour(middle, 1);
+    assert((char *) first == (char *) pool.head + sizeof(MemoryPoolNode));
+    assert((char *) middle == (char *) first + sizeof(MemoryPoolNode) + 3 * sizeof(void *));
+    assert((char *) root == (char *) middle + sizeof(MemoryPoolNode) + 3 * sizeof(void *));
+    assert(memoryNode_get_neighbour_count(root) == 2 && memoryNode_getNeighbour(root, 1) == NULL);
+    assert(memoryNode_getNeighbour(first, 0) == root);
+    assert(*(uint64_t **) memoryNode_get_data(root) == &data[5]);
+    assert(*(uint64_t **) memoryNode_get_data(middle) == &data[3]);
+    assert(*(uint64_t **) memoryNode_get_data(first) == &data[1]);
+    assert(*live == middle && *dead == NULL);
+
+    // All free memory is in one piece at the end.
+    MemoryNode *const large = memoryPool_alloc(&pool, rest - sizeof(void *), 1);
+    assert(large);
+    *(uint64_t **) memoryNode_get_data(large) = &data[0];
+    memoryPool_free_handle(&pool, live);
+    memoryPool_free_handle(&pool, dead);
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_mark_compact_generational() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, NULL);
+    const bool enabled = memoryPool_enable_generational(&pool, DEFAULT_POOL_SIZE);
+    assert(enabled);
+
+    MemoryNode *const garbage = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    MemoryNode *const young = memoryPool_alloc(&pool, sizeof(uint64_t), 1);
+    *(uint64_t *) memoryNode_get_data(young) = 42;
+    memoryPool_add_root_node(&pool, young);
+    MemoryNode **const handle = memoryPool_new_handle(&pool, young);
+    assert(garbage && young && handle);
+
+    // The young survivor is promoted and then slid to the start of the pool.
+    memoryPool_gc_mark_compact(&pool);
+    assert(*handle == pool.rootSet[0]);
+    assert((char *) *handle == (char *) pool.head + sizeof(MemoryPoolNode));
+    assert(*(uint64_t *) memoryNode_get_data(*handle) == 42);
+    memoryPool_free_handle(&pool, handle);
+    memoryPool_free(&pool);
+}
+
+static void copy_lays_out_in_order(const MemoryPoolTraversal order, const int *const expected) {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(6);
+
+    // Allocated in reverse, so that any layout in traversal order differs from
+    // the allocation order. Node 5 is garbage.
+    MemoryNode *nodes[6];
+    for (int i = 5; i >= 0; --i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 2);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+    }
+
+    memoryNode_setNeighbour(nodes[0], nodes[1], 0);
+    memoryNode_setNeighbour(nodes[0], nodes[2], 1);
+    memoryNode_setNeighbour(nodes[1], nodes[3], 0);
+    memoryNode_setNeighbour(nodes[2], nodes[4], 0);
+    memoryNode_setNeighbour(nodes[4], nodes[0], 1);
+    memoryPool_add_root_node(&pool, nodes[0]);
+
+    memoryPool_gc_copy(&pool, order);
+    assert(data[5] == 1);
+    data[5] = 0;
+    assert(all_same(0));
+
+    const size_t stride = sizeof(MemoryPoolNode) + 3 * sizeof(void *);
+    char *const start = (char *) pool.head + sizeof(MemoryPoolNode);
+    MemoryNode *const root = pool.rootSet[0];
+    MemoryNode *const copies[5] = {
+        root,
+        memoryNode_getNeighbour(root, 0),
+        memoryNode_getNeighbour(root, 1),
+        memoryNode_getNeighbour(memoryNode_getNeighbour(root, 0), 0),
+        memoryNode_getNeighbour(memoryNode_getNeighbour(root, 1), 0),
+    };
+
+    for (int i = 0; i < 5; ++i) {
+        assert((char *) copies[expected[i]] == start + i * stride);
+        assert(*(uint64_t **) memoryNode_get_data(copies[expected[i]]) == &data[expected[i]]);
+    }
+
+    assert(memoryNode_getNeighbour(copies[4], 1) == root);
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_copy_lays_out_in_traversal_order() {
+    const int breadthFirst[5] = {0, 1, 2, 3, 4};
+    const int depthFirst[5] = {0, 1, 3, 2, 4};
+    copy_lays_out_in_order(MemoryPoolTraversal_BreadthFirst, breadthFirst);
+    copy_lays_out_in_order(MemoryPoolTraversal_DepthFirst, depthFirst);
+}
+
+static void test_parallel_mark() {
+    enum { NODES = 30000, FAN_OUT = 4 };
+    MemoryPool pool = memory_pool_new(NODES * 64, free_fn);
+    const bool enabled = memoryPool_enable_parallel_mark(&pool, 4);
+    assert(enabled);
+    init_out(NODES);
+
+    // Every third MemoryNode is garbage, the others form a random tree. The
+    // garbage points into the tree, too.
+    MemoryNode *nodes[NODES];
+    size_t children[NODES] = {0};
+    size_t seed = 1;
+    for (size_t i = 0; i < NODES; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), FAN_OUT);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+        if (i == 0)
+            continue;
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t parent = (seed >> 33) % i;
+        while ((parent % 3 == 0 && parent != 0) || children[parent] == FAN_OUT)
+            parent = (parent + 1) % i;
+
+        if (i % 3 == 0)
+            memoryNode_setNeighbour(nodes[i], nodes[parent], 0);
+        else
+            memoryNode_setNeighbour(nodes[parent], nodes[i], children[parent]++);
+    }
+
+    memoryPool_add_root_node(&pool, nodes[0]);
+    for (int gc = 0; gc < 2; ++gc) {
+        memoryPool_gc_mark_and_sweep(&pool);
+        for (size_t i = 1; i < NODES; ++i)
+            assert(data[i] == (i % 3 == 0));
+    }
+
+    memset(data, 0, NODES * sizeof(uint64_t));
+    memoryPool_free(&pool);
+    assert(data[0] == 1);
+    free_out();
+}
+
+static void test_concurrent_mark_keeps_snapshot() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(4);
+
+    MemoryNode *nodes[4];
+    for (int i = 0; i < 3; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+    }
+
+    // 0 -> 1 is the graph at the start, 2 is garbage.
+    memoryNode_setNeighbour(nodes[0], nodes[1], 0);
+    memoryPool_add_root_node(&pool, nodes[0]);
+    const bool started = memoryPool_gc_start_concurrent(&pool);
+    assert(started);
+
+    // 1 was reachable at the start and 3 is new, so both survive.
+    nodes[3] = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    *(uint64_t **) memoryNode_get_data(nodes[3]) = &data[3];
+    memoryNode_setNeighbour(nodes[0], nodes[3], 0);
+    memoryPool_gc_finish(&pool);
+    assert(data[0] == 0 && data[1] == 0 && data[2] == 1 && data[3] == 0);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(data[1] == 1 && data[3] == 0);
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_concurrent_mark_with_mutations() {
+    enum { HOLDERS = 16, SLOTS = 128, NODES = HOLDERS * SLOTS, SWAPS = 200000 };
+    MemoryPool pool = memory_pool_new(NODES * 64 + HOLDERS * SLOTS * 16, free_fn);
+    init_out(NODES);
+
+    // Swapping two slots of the holders keeps every MemoryNode reachable, but
+    // between the two writes one of them is only known to the mutator.
+    uint64_t sink = 0;
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), HOLDERS);
+    *(uint64_t **) memoryNode_get_data(root) = &sink;
+    memoryPool_add_root_node(&pool, root);
+    MemoryNode *holders[HOLDERS];
+    for (uint16_t h = 0; h < HOLDERS; ++h) {
+        holders[h] = memoryPool_alloc(&pool, sizeof(uint64_t *), SLOTS);
+        *(uint64_t **) memoryNode_get_data(holders[h]) = &sink;
+        memoryNode_setNeighbour(root, holders[h], h);
+        for (uint16_t i = 0; i < SLOTS; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+            *(uint64_t **) memoryNode_get_data(node) = &data[h * SLOTS + i];
+            memoryNode_setNeighbour(holders[h], node, i);
+        }
+    }
+
+    size_t seed = 3;
+    const bool started = memoryPool_gc_start_concurrent(&pool);
+    assert(started);
+    for (size_t i = 0; i < SWAPS; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        MemoryNode *const first = holders[(seed >> 60) % HOLDERS];
+        MemoryNode *const second = holders[(seed >> 56) % HOLDERS];
+        const uint16_t firstSlot = (seed >> 33) % SLOTS;
+        const uint16_t secondSlot = (seed >> 17) % SLOTS;
+
+        MemoryNode *const moved = memoryNode_getNeighbour(first, firstSlot);
+        memoryNode_setNeighbour(first, memoryNode_getNeighbour(second, secondSlot), firstSlot);
+        memoryNode_setNeighbour(second, moved, secondSlot);
+    }
+
+    memoryPool_gc_finish(&pool);
+    assert(all_same(0));
+    memoryPool_free(&pool);
+    free_out();
+}
+
+enum { MARKING_SLOTS = 64 };
+
+static int marking_thread(void *const arg) {
+    (void) arg;
+    uint64_t freed[MARKING_SLOTS] = {0};
+    MemoryPool pool = memory_pool_new(MARKING_SLOTS * 64, free_fn);
+    MemoryNode *const holder = memoryPool_alloc(&pool, sizeof(uint64_t *), MARKING_SLOTS);
+    *(uint64_t **) memoryNode_get_data(holder) = &freed[0];
+    memoryPool_add_root_node(&pool, holder);
+    for (uint16_t i = 0; i < MARKING_SLOTS; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+        *(uint64_t **) memoryNode_get_data(node) = &freed[i];
+        memoryNode_setNeighbour(holder, node, i);
+    }
+
+    for (size_t round = 0; round < 200; ++round) {
+        const bool started = memoryPool_gc_start(&pool);
+        assert(started);
+        for (uint16_t i = 0; i + 1 < MARKING_SLOTS; i += 2) {
+            MemoryNode *const moved = memoryNode_getNeighbour(holder, i);
+            memoryNode_setNeighbour(holder, memoryNode_getNeighbour(holder, i + 1), i);
+            memoryNode_setNeighbour(holder, moved, i + 1);
+        }
+
+        memoryPool_gc_finish(&pool);
+    }
+
+    for (size_t i = 0; i < MARKING_SLOTS; ++i)
+        assert(freed[i] == 0);
+
+    memoryPool_free(&pool);
+    return 0;
+}
+
+static void test_marking_pools_on_many_threads() {
+    // Each thread starts and finishes collections of its own pool while the
+    // others go through the snapshot barrier.
+    thrd_t ids[4];
+    for (int t = 0; t < 4; ++t) {
+        const int created = thrd_create(&ids[t], marking_thread, NULL);
+        assert(created == thrd_success);
+    }
+
+    for (int t = 0; t < 4; ++t)
+        thrd_join(ids[t], NULL);
+}
+
+static void test_incremental_mark() {
+    enum { NODES = 10 };
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(2 * NODES);
+
+    // A list of NODES MemoryNodes, each followed by a garbage MemoryNode.
+    MemoryNode *nodes[NODES];
+    for (size_t i = 0; i < NODES; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+        if (i > 0)
+            memoryNode_setNeighbour(nodes[i - 1], nodes[i], 0);
+
+        MemoryNode *const garbage = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+        *(uint64_t **) memoryNode_get_data(garbage) = &data[NODES + i];
+    }
+
+    memoryPool_add_root_node(&pool, nodes[0]);
+    const bool started = memoryPool_gc_start(&pool);
+    assert(started);
+    const bool workLeft = memoryPool_gc_step(&pool, 1);
+    assert(workLeft);
+
+    // Moving the tail of the list behind the marked head must not lose it.
+    memoryNode_setNeighbour(nodes[1], NULL, 0);
+    memoryNode_setNeighbour(nodes[0], nodes[2], 0);
+
+    size_t steps = 1;
+    do
+        ++steps;
+    while (memoryPool_gc_step(&pool, 1));
+
+    assert(steps == NODES);
+    memoryPool_gc_finish(&pool);
+    for (size_t i = 0; i < NODES; ++i)
+        assert(data[i] == 0 && data[NODES + i] == 1);
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_release_during_marking() {
+    MemoryPool pool = memory_pool_new(DEFAULT_POOL_SIZE, free_fn);
+    init_out(2);
+
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    assert(root);
+    *(uint64_t **) memoryNode_get_data(root) = &data[0];
+    memoryPool_add_root_node(&pool, root);
+    MemoryNode *const released = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+    assert(released);
+    *(uint64_t **) memoryNode_get_data(released) = &data[1];
+    memoryNode_setNeighbour(root, released, 0);
+
+    // The write barrier records the released MemoryNode, so the marker still
+    // visits it after it has been released.
+    const bool started = memoryPool_gc_start(&pool);
+    assert(started);
+    memoryNode_setNeighbour(root, NULL, 0);
+    memoryPool_release_nodes(&pool, &released, 1);
+    while (memoryPool_gc_step(&pool, 1));
+
+    uint64_t sink = 0;
+    MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+    assert(node && node != released);
+    *(uint64_t **) memoryNode_get_data(node) = &sink;
+    memoryPool_gc_finish(&pool);
+    assert(all_same(0));
+
+    // Once the marking has finished, the released MemoryNode is free again.
+    bool reused = false;
+    MemoryNode *allocated;
+    while (!reused && (allocated = memoryPool_alloc(&pool, sizeof(uint64_t *), 0))) {
+        *(uint64_t **) memoryNode_get_data(allocated) = &sink;
+        reused = allocated == released;
+    }
+
+    assert(reused);
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_lazy_sweep() {
+    enum { NODES = 100 };
+    MemoryPool pool = memory_pool_new(NODES * 32, free_fn);
+    memoryPool_enable_lazy_sweep(&pool);
+    init_out(NODES);
+
+    // Every other MemoryNode is part of the list hanging off the root.
+    MemoryNode *previous = NULL;
+    for (size_t i = 0; i < NODES; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        assert(node);
+        *(uint64_t **) memoryNode_get_data(node) = &data[i];
+        if (i % 2 == 0) {
+            memoryNode_setNeighbour(node, previous, 0);
+            previous = node;
+        }
+    }
+
+    memoryPool_add_root_node(&pool, previous);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(all_same(0));
+
+    // A single allocation only sweeps up to the first garbage MemoryNode.
+    uint64_t sink = 0;
+    MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    assert(node);
+    *(uint64_t **) memoryNode_get_data(node) = &sink;
+    size_t freed = 0;
+    for (size_t i = 0; i < NODES; ++i)
+        freed += data[i];
+    assert(freed > 0 && freed < NODES / 2);
+
+    // The next collection finishes the sweep first.
+    memoryPool_gc_mark_and_sweep(&pool);
+    for (size_t i = 0; i < NODES; ++i)
+        assert(data[i] == i % 2);
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_release_during_lazy_sweep() {
+    enum { NODES = 16 };
+    MemoryPool pool = memory_pool_new(NODES * 64, free_fn);
+    memoryPool_enable_lazy_sweep(&pool);
+    init_out(NODES + 1);
+
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), NODES);
+    assert(root);
+    *(uint64_t **) memoryNode_get_data(root) = &data[NODES];
+    memoryPool_add_root_node(&pool, root);
+    for (size_t i = 0; i < NODES; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+        assert(node);
+        *(uint64_t **) memoryNode_get_data(node) = &data[i];
+        memoryNode_setNeighbour(root, node, i);
+    }
+
+    // The sweep has not passed any MemoryNode yet, so the released one must
+    // not be handed out before the sweep reaches it.
+    memoryPool_gc_mark_and_sweep(&pool);
+    MemoryNode *const released = memoryNode_getNeighbour(root, NODES / 2);
+    memoryNode_setNeighbour(root, NULL, NODES / 2);
+    memoryPool_release_nodes(&pool, &released, 1);
+
+    uint64_t sink = 0;
+    MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+    assert(node);
+    *(uint64_t **) memoryNode_get_data(node) = &sink;
+    memoryNode_setNeighbour(root, node, NODES / 2);
+
+    memoryPool_gc_mark_and_sweep(&pool);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(sink == 0);
+    assert(all_same(0));
+    assert(*(uint64_t **) memoryNode_get_data(memoryNode_getNeighbour(root, NODES / 2)) == &sink);
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_parallel_sweep() {
+    enum { NODES = 40000 };
+    MemoryPool pool = memory_pool_new(NODES * 40, free_fn);
+    const bool enabled = memoryPool_enable_parallel_sweep(&pool, 4);
+    assert(enabled);
+    init_out(NODES);
+
+    uint64_t sink = 0;
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+    *(uint64_t **) memoryNode_get_data(root) = &sink;
+    memoryPool_add_root_node(&pool, root);
+
+    // The first collection lays out the regions, the later ones sweep them in
+    // parallel. Every round one in three of the remaining MemoryNodes becomes
+    // garbage.
+    MemoryNode *previous = root;
+    for (size_t i = 0; i < NODES; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        assert(node);
+        *(uint64_t **) memoryNode_get_data(node) = &data[i];
+        memoryNode_setNeighbour(previous, node, 0);
+        previous = node;
+    }
+
+    for (int round = 0; round < 3; ++round) {
+        size_t alive = 0;
+        MemoryNode *keep = root;
+        for (MemoryNode *node = memoryNode_getNeighbour(root, 0); node; node = memoryNode_getNeighbour(node, 0)) {
+            if (alive++ % 3 != 0) {
+                memoryNode_setNeighbour(keep, node, 0);
+                keep = node;
+            }
+        }
+
+        memoryNode_setNeighbour(keep, NULL, 0);
+        memoryPool_gc_mark_and_sweep(&pool);
+        for (MemoryNode *node = memoryNode_getNeighbour(root, 0); node; node = memoryNode_getNeighbour(node, 0))
+            assert(**(uint64_t **) memoryNode_get_data(node) == 0);
+    }
+
+    size_t freed = 0;
+    for (size_t i = 0; i < NODES; ++i)
+        freed += data[i];
+
+    // The free memory is coalesced well enough to hold the collected nodes again.
+    for (size_t i = 0; i < freed; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        assert(node);
+        *(uint64_t **) memoryNode_get_data(node) = &sink;
+    }
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_mark_bitmap() {
+    enum { NODES = 20000 };
+    for (int withFreeFn = 0; withFreeFn < 2; ++withFreeFn) {
+        MemoryPool pool = memory_pool_new(NODES * 40, withFreeFn ? free_fn : NULL);
+        const bool enabled = memoryPool_enable_mark_bitmap(&pool);
+        assert(enabled);
+        init_out(NODES);
+
+        uint64_t sink = 0;
+        MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        *(uint64_t **) memoryNode_get_data(root) = &sink;
+        memoryPool_add_root_node(&pool, root);
+
+        // Runs of garbage of every length, up to several MemoryPoolNodes of the
+        // maximum size, lie between the surviving MemoryNodes.
+        MemoryNode *previous = root;
+        size_t garbage = 0;
+        for (size_t i = 0, gap = 0, alive = 0; i < NODES; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+            assert(node);
+            *(uint64_t **) memoryNode_get_data(node) = &data[i];
+            if (gap == 0) {
+                memoryNode_setNeighbour(previous, node, 0);
+                previous = node;
+                gap = ++alive % 64 == 0 ? 4000 : alive % 8;
+            } else {
+                --gap;
+                ++garbage;
+            }
+        }
+
+        for (int round = 0; round < 2; ++round) {
+            memoryPool_gc_mark_and_sweep(&pool);
+            for (MemoryNode *node = memoryNode_getNeighbour(root, 0); node; node = memoryNode_getNeighbour(node, 0))
+                assert(**(uint64_t **) memoryNode_get_data(node) == 0);
+        }
+
+        if (withFreeFn) {
+            size_t freed = 0;
+            for (size_t i = 0; i < NODES; ++i)
+                freed += data[i];
+
+            assert(freed == garbage);
+        }
+
+        // The garbage is free memory again, the survivors are untouched.
+        for (size_t i = 0; i < garbage; ++i) {
+            MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+            assert(node);
+            *(uint64_t **) memoryNode_get_data(node) = &sink;
+        }
+
+        for (MemoryNode *node = memoryNode_getNeighbour(root, 0); node; node = memoryNode_getNeighbour(node, 0))
+            assert(**(uint64_t **) memoryNode_get_data(node) == 0);
+
+        memoryPool_free(&pool);
+        free_out();
+    }
+}
+
+static void test_mark_stack() {
+    enum { WIDE = 20000 };
+    MemoryPool pool = memory_pool_new_tracer(WIDE * 3 * 48, free_fn, MemoryPoolArena_Malloc, MemoryPoolTracer_MarkStack);
+    init_out(WIDE * 3);
+
+    // The root has more neighbours than fit on the mark stack, so the search
+    // falls back to pointer reversal for some of them. Each neighbour has a
+    // leaf and links to the next neighbour, the garbage is not reachable.
+    uint64_t sink = 0;
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), WIDE);
+    assert(root);
+    *(uint64_t **) memoryNode_get_data(root) = &sink;
+    memoryPool_add_root_node(&pool, root);
+
+    MemoryNode *previous = NULL;
+    for (size_t i = 0; i < WIDE; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 2);
+        MemoryNode *const leaf = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+        MemoryNode *const garbage = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        assert(node && leaf && garbage);
+        *(uint64_t **) memoryNode_get_data(node) = &data[3 * i];
+        *(uint64_t **) memoryNode_get_data(leaf) = &data[3 * i + 1];
+        *(uint64_t **) memoryNode_get_data(garbage) = &data[3 * i + 2];
+        memoryNode_setNeighbour(root, node, i);
+        memoryNode_setNeighbour(node, leaf, 0);
+        memoryNode_setNeighbour(garbage, node, 0);
+        if (previous)
+            memoryNode_setNeighbour(previous, node, 1);
+
+        previous = node;
+    }
+
+    memoryNode_setNeighbour(previous, root, 1);
+    for (int round = 0; round < 2; ++round) {
+        memoryPool_gc_mark_and_sweep(&pool);
+        for (size_t i = 0; i < WIDE * 3; ++i)
+            assert(data[i] == (i % 3 == 2));
+    }
+
+    // Pointer reversal left every neighbour as it was.
+    for (size_t i = 0; i < WIDE; ++i) {
+        MemoryNode *const node = memoryNode_getNeighbour(root, i);
+        assert(*(uint64_t **) memoryNode_get_data(node) == &data[3 * i]);
+        assert(memoryNode_getNeighbour(node, 1) == (i + 1 < WIDE ? memoryNode_getNeighbour(root, i + 1) : root));
+    }
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_remove_root_node() {
+    enum { ROOTS = 1000 };
+    MemoryPool pool = memory_pool_new(ROOTS * 48, free_fn);
+    init_out(ROOTS);
+
+    MemoryNode *nodes[ROOTS];
+    for (size_t i = 0; i < ROOTS; ++i) {
+        nodes[i] = memoryPool_alloc(&pool, sizeof(uint64_t *), 0);
+        *(uint64_t **) memoryNode_get_data(nodes[i]) = &data[i];
+        const bool added = memoryPool_add_root_node(&pool, nodes[i]);
+        assert(added);
+    }
+
+    // Adding a root again only counts, so it has to be removed twice.
+    for (size_t i = 0; i < ROOTS; i += 2) {
+        const bool added = memoryPool_add_root_node(&pool, nodes[i]);
+        assert(added);
+    }
+
+    assert(pool.rootSetSize == ROOTS);
+    for (size_t i = 0; i < ROOTS; ++i) {
+        const bool removed = memoryPool_remove_root_node(&pool, nodes[i]);
+        assert(removed);
+    }
+
+    assert(pool.rootSetSize == ROOTS / 2);
+    memoryPool_gc_mark_and_sweep(&pool);
+    for (size_t i = 0; i < ROOTS; ++i)
+        assert(data[i] == i % 2);
+
+    // The roots are still found after the compaction moved them.
+    memoryPool_gc_mark_compact(&pool);
+    for (size_t i = 0; i < ROOTS / 2; ++i) {
+        const bool removed = memoryPool_remove_root_node(&pool, pool.rootSet[pool.rootSetSize - 1]);
+        assert(removed);
+    }
+
+    assert(pool.rootSetSize == 0);
+    const bool removed = memoryPool_remove_root_node(&pool, nodes[0]);
+    assert(!removed);
+    memoryPool_gc_mark_and_sweep(&pool);
+    assert(all_same(1));
+
+    memoryPool_free(&pool);
+    free_out();
+}
+
+static void test_background_finalizers() {
+    enum { NODES = 2000 };
+    for (size_t workers = 0; workers <= 2; workers += 2) {
+        MemoryPool pool = memory_pool_new(NODES * 24, free_fn);
+        const bool enabled = memoryPool_enable_background_finalizers(&pool, workers);
+        assert(enabled);
+        init_out(NODES);
+
+        uint64_t sink = 0;
+        MemoryNode *const root = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+        *(uint64_t **) memoryNode_get_data(root) = &sink;
+        memoryPool_add_root_node(&pool, root);
+
+        MemoryNode *previous = root;
+        size_t allocated = 0;
+        MemoryNode *node;
+        while (allocated < NODES && (node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1))) {
+            *(uint64_t **) memoryNode_get_data(node) = &data[allocated];
+            if (allocated++ % 2 == 0) {
+                memoryNode_setNeighbour(previous, node, 0);
+                previous = node;
+            }
+        }
+
+        memoryPool_gc_mark_and_sweep(&pool);
+        if (workers == 0) {
+            // Nothing is finalized during the collection, and the memory of
+            // the garbage is not handed out before it is.
+            assert(all_same(0));
+            MemoryNode *const node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+            assert(!node);
+            const bool pending = memoryPool_run_finalizers(&pool, 10);
+            assert(pending);
+
+            size_t finalized = 0;
+            for (size_t i = 0; i < allocated; ++i)
+                finalized += data[i];
+
+            assert(finalized == 10);
+        }
+
+        while (memoryPool_run_finalizers(&pool, workers ? 0 : SIZE_MAX))
+            thrd_yield();
+
+        for (size_t i = 0; i < allocated; ++i)
+            assert(data[i] == i % 2);
+
+        for (size_t i = 0; i < allocated / 2; ++i) {
+            node = memoryPool_alloc(&pool, sizeof(uint64_t *), 1);
+            assert(node);
+            *(uint64_t **) memoryNode_get_data(node) = &sink;
+        }
+
+        memoryPool_free(&pool);
+        free_out();
+    }
+}
+
+static bool count_trigger(MemoryPool const *const memoryPool, const size_t allocated, void *const context) {
+    (void) memoryPool;
+    size_t *const calls = context;
+    ++*calls;
+    return allocated >= 4096;
+}
+
+static bool never_trigger(MemoryPool const *const memoryPool, const size_t allocated, void *const context) {
+    (void) memoryPool;
+    (void) allocated;
+    (void) context;
+    return false;
+}
+
+static void test_auto_gc() {
+    enum { ROUNDS = 100000, KEPT = 100 };
+    MemoryPool pool = memory_pool_new(1 << 14, NULL);
+    const bool enabled = memoryPool_enable_auto_gc(&pool);
+    assert(enabled);
+
+    // Garbage is collected by the allocations themselves, while the MemoryNodes
+    // reachable from the root stay intact.
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(size_t), 1);
+    *(size_t *) memoryNode_get_data(root) = KEPT;
+    memoryPool_add_root_node(&pool, root);
+    for (size_t i = 0; i < ROUNDS; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(size_t), 1);
+        assert(node);
+        *(size_t *) memoryNode_get_data(node) = i;
+        if (i % (ROUNDS / KEPT) == 0) {
+            memoryNode_setNeighbour(node, memoryNode_getNeighbour(root, 0), 0);
+            memoryNode_setNeighbour(root, node, 0);
+        }
+    }
+
+    size_t kept = 0;
+    for (MemoryNode *node = memoryNode_getNeighbour(root, 0); node; node = memoryNode_getNeighbour(node, 0))
+        assert(*(size_t *) memoryNode_get_data(node) == ROUNDS - ROUNDS / KEPT * ++kept);
+
+    assert(kept == KEPT);
+
+    // A custom trigger is asked before every allocation.
+    size_t calls = 0;
+    memoryPool_set_gc_trigger(&pool, count_trigger, &calls);
+    for (size_t i = 0; i < 1000; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(size_t), 0);
+        assert(node);
+    }
+
+    assert(calls == 1000);
+
+    // An allocation that does not fit still collects and retries.
+    memoryPool_set_gc_trigger(&pool, never_trigger, NULL);
+    for (size_t i = 0; i < ROUNDS; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(size_t), 0);
+        assert(node);
+    }
+
+    MemoryNode *nodes[64];
+    for (size_t i = 0; i < ROUNDS / 64; ++i) {
+        const bool allocated = memoryPool_alloc_bulk(&pool, 64, sizeof(size_t), 0, nodes);
+        assert(allocated);
+    }
+
+    memoryPool_set_gc_trigger(&pool, NULL, NULL);
+    memoryPool_free(&pool);
+}
+
+static void test_stats() {
+    MemoryPool pool = memory_pool_new(1 << 14, NULL);
+
+    // Without counters only the heap is described.
+    MemoryPoolStats stats;
+    memoryPool_get_stats(&pool, &stats);
+    assert(stats.collections == 0 && stats.allocations == 0);
+    assert(stats.liveNodes == 0 && stats.freeBlocks == 1);
+    assert(stats.freeBytes == pool.size && stats.largestFreeBlock < pool.size);
+
+    const bool enabled = memoryPool_enable_stats(&pool);
+
+    assert(enabled);
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(size_t), 1);
+    memoryPool_add_root_node(&pool, root);
+    MemoryNode *previous = root;
+    size_t allocated = 1;
+    MemoryNode *node;
+    while ((node = memoryPool_alloc(&pool, sizeof(size_t), 1))) {
+        if (allocated++ % 2 == 1) {
+            memoryNode_setNeighbour(previous, node, 0);
+            previous = node;
+        }
+    }
+
+    memoryPool_get_stats(&pool, &stats);
+    assert(stats.allocations == allocated && stats.failedAllocations == 1);
+    assert(stats.liveNodes == allocated && stats.liveBytes + stats.freeBytes == pool.size);
+    assert(stats.rootSetSize == 1);
+
+    const size_t liveBytes = stats.liveBytes;
+    memoryPool_gc_mark_and_sweep(&pool);
+    memoryPool_gc_mark_compact(&pool);
+    memoryPool_get_stats(&pool, &stats);
+    assert(stats.collections == 2);
+    assert(stats.pauseTime == stats.markTime + stats.sweepTime);
+    assert(stats.lastPause <= stats.maxPause && stats.maxPause <= stats.pauseTime);
+
+    size_t pauses = 0;
+    for (size_t i = 0; i < MemoryPoolStats_PauseBuckets; ++i)
+        pauses += stats.pauseHistogram[i];
+
+    assert(pauses == 2);
+    assert(stats.liveNodes == allocated / 2 + 1);
+    assert(stats.reclaimedBytes == liveBytes - stats.liveBytes);
+
+    // A compacted pool has one free block that holds all of its free memory.
+    assert(stats.freeBlocks == 1);
+    assert(stats.largestFreeBlock + sizeof(MemoryPoolNode) == stats.freeBytes);
+    memoryPool_free(&pool);
+}
+
+typedef struct {
+    size_t limit;
+    size_t blocks;
+    size_t nodes;
+    size_t neighbours;
+    size_t bytes;
+} HeapWalk;
+
+static bool count_blocks(MemoryPoolHeapBlock const *const block, void *const context) {
+    HeapWalk *const walk = context;
+    ++walk->blocks;
+    walk->bytes += block->size;
+    if (!block->free) {
+        ++walk->nodes;
+        walk->neighbours += block->neighbourCount;
+        assert(block->memoryNode && memoryNode_get_neighbour_count(block->memoryNode) == block->neighbourCount);
+    }
+
+    return walk->blocks < walk->limit;
+}
+
+static void test_heap_dump() {
+    MemoryPool pool = memory_pool_new(1 << 14, NULL);
+    MemoryNode *const root = memoryPool_alloc(&pool, sizeof(size_t), 2);
+    memoryPool_add_root_node(&pool, root);
+    for (size_t i = 0; i < 100; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, sizeof(size_t), 1);
+        if (i % 4 == 0)
+            memoryNode_setNeighbour(root, node, i % 8 == 0);
+    }
+
+    MemoryNode *const large = memoryPool_alloc(&pool, 1 << 17, 0);
+    memoryNode_setNeighbour(memoryNode_getNeighbour(root, 0), large, 0);
+    memoryPool_gc_mark_and_sweep(&pool);
+
+    // The walk covers the pool and the large objects and can be stopped.
+    HeapWalk walk = {SIZE_MAX, 0, 0, 0, 0};
+    const bool completed = memoryPool_walk_heap(&pool, count_blocks, &walk);
+    assert(completed);
+    assert(walk.nodes == 4 && walk.neighbours == 4);
+    assert(walk.bytes > pool.size + (1 << 17));
+
+    HeapWalk stopped = {2, 0, 0, 0, 0};
+    const bool stoppedCompleted = memoryPool_walk_heap(&pool, count_blocks, &stopped);
+    assert(!stoppedCompleted);
+    assert(stopped.blocks == 2);
+
+    MemoryPoolStats stats;
+    memoryPool_get_stats(&pool, &stats);
+    assert(stats.liveNodes == walk.nodes && stats.liveBytes + stats.freeBytes == walk.bytes);
+
+    MemoryPoolHeapDump *const dump = memoryPool_capture_heap_dump(&pool);
+    assert(dump);
+
+    FILE *const file = tmpfile();
+    assert(file);
+    const bool written = memoryPoolHeapDump_write(dump, file);
+    assert(written);
+    assert((size_t) ftell(file) == memoryPoolHeapDump_size(dump));
+
+    rewind(file);
+    char magic[4];
+    uint32_t version;
+    uint64_t header[3];
+    const size_t magicRead = fread(magic, 1, 4, file);
+    const size_t versionRead = fread(&version, sizeof(version), 1, file);
+    const size_t headerRead = fread(header, sizeof(header), 1, file);
+    assert(magicRead == 4 && memcmp(magic, "MPHD", 4) == 0);
+    assert(versionRead == 1 && version == MemoryPoolHeapDump_Version);
+    assert(headerRead == 1);
+    assert(header[0] == pool.size);
+    assert(header[1] == stats.liveNodes + stats.freeBlocks);
+    assert(header[2] == stats.liveNodes);
+
+    fclose(file);
+    memoryPoolHeapDump_free(dump);
+    memoryPool_free(&pool);
+}
+
+typedef struct {
+    MemoryPoolAllocationSite sites[4];
+    size_t count;
+} SiteReport;
+
+static bool collect_site(MemoryPoolAllocationSite const *const site, void *const context) {
+    SiteReport *const report = context;
+    assert(report->count < 4);
+    report->sites[report->count++] = *site;
+    return true;
+}
+
+static MemoryNode *alloc_untagged(MemoryPool *const pool) {
+    return memoryPool_alloc(pool, 64, 1);
+}
+
+static void test_allocation_sampling() {
+    enum { NODES = 20000, FOOTPRINT = 80 };
+    MemoryPool pool = memory_pool_new(1 << 22, NULL);
+    const bool enabled = memoryPool_enable_sampling(&pool, 4096);
+    assert(enabled);
+
+    memoryPool_set_allocation_site(&pool, "kept");
+    MemoryNode *const root = memoryPool_alloc(&pool, 64, 1);
+    memoryPool_add_root_node(&pool, root);
+    for (size_t i = 0; i < NODES; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, 64, 1);
+        memoryNode_setNeighbour(node, memoryNode_getNeighbour(root, 0), 0);
+        memoryNode_setNeighbour(root, node, 0);
+    }
+
+    memoryPool_set_allocation_site(&pool, "garbage");
+    for (size_t i = 0; i < NODES; ++i) {
+        MemoryNode *const node = memoryPool_alloc(&pool, 64, 1);
+        assert(node);
+    }
+
+    memoryPool_set_allocation_site(&pool, NULL);
+    for (size_t i = 0; i < NODES / 10; ++i) {
+        MemoryNode *const node = alloc_untagged(&pool);
+        assert(node);
+    }
+
+    memoryPool_gc_mark_and_sweep(&pool);
+
+    SiteReport report = {0};
+    memoryPool_report_allocation_sites(&pool, collect_site, &report);
+    assert(report.count == 3);
+
+    MemoryPoolAllocationSite const *const kept = &report.sites[0];
+    assert(strcmp(kept->tag, "kept") == 0);
+    assert(kept->allocatedBytes > NODES * FOOTPRINT * 85 / 100 && kept->allocatedBytes < NODES * FOOTPRINT * 115 / 100);
+    assert(kept->deaths == 0 && kept->survivingBytes == kept->allocatedBytes);
+
+    MemoryPoolAllocationSite const *const garbage = &report.sites[1];
+    assert(strcmp(garbage->tag, "garbage") == 0);
+    assert(garbage->allocatedBytes > NODES * FOOTPRINT * 85 / 100 && garbage->allocatedBytes < NODES * FOOTPRINT * 115 / 100);
+    assert(garbage->deaths == garbage->samples && garbage->survivingBytes == 0);
+    assert(garbage->averageLifetime > NODES * FOOTPRINT / 4 && garbage->averageLifetime < NODES * FOOTPRINT * 2);
+
+    MemoryPoolAllocationSite const *const untagged = &report.sites[2];
+    assert(!untagged->tag && untagged->frameCount > 0);
+    assert(untagged->samples > 0 && untagged->deaths == untagged->samples);
+
+    memoryPool_free(&pool);
+}
+
 void run_tests() {
     test_alloc_pool();
     test_alloc_pool_2();
@@ -366,4 +1976,45 @@ void run_tests() {
     test_create_large_memory_pool();
     test_alloc_odd_size_data();
     test_many_root_nodes();
+    test_alloc_after_pool_is_full();
+    test_alloc_searches_size_class();
+    test_sweep_coalesces_free_nodes();
+    test_churn_does_not_fragment();
+    test_best_fit_takes_smallest_fitting_node();
+    test_next_fit_resumes_after_last_allocation();
+    test_generational_minor_promotes_survivors();
+    test_generational_write_barrier();
+    test_generational_nursery_full();
+    test_generational_promotion_failure();
+    test_generational_pools_on_many_threads();
+    test_thread_safe_alloc();
+    test_thread_safe_handles();
+    test_thread_safe_pools_share_thread();
+    test_alloc_bulk_contiguous();
+    test_alloc_bulk_all_or_nothing();
+    test_large_objects();
+    test_growth();
+    test_growth_keeps_segments_apart();
+    test_mapped_arena_releases_free_pages();
+    test_huge_page_arenas();
+    test_mark_compact_slides_live_nodes();
+    test_mark_compact_generational();
+    test_copy_lays_out_in_traversal_order();
+    test_parallel_mark();
+    test_concurrent_mark_keeps_snapshot();
+    test_concurrent_mark_with_mutations();
+    test_marking_pools_on_many_threads();
+    test_incremental_mark();
+    test_release_during_marking();
+    test_lazy_sweep();
+    test_release_during_lazy_sweep();
+    test_parallel_sweep();
+    test_mark_bitmap();
+    test_mark_stack();
+    test_remove_root_node();
+    test_background_finalizers();
+    test_auto_gc();
+    test_stats();
+    test_heap_dump();
+    test_allocation_sampling();
 }
@@ -1,4 +1,6 @@
 #include <gmock/gmock.h>
+#include <array>
+#include <thread>
 
 #include "CMemoryPool.h"
 
@@ -131,3 +133,221 @@ TEST_P(ParameterizedDestructionTest, cicleIsCollected) {
 INSTANTIATE_TEST_SUITE_P(range1To5,
                          ParameterizedDestructionTest,
                          Combine(Range(1, 5), Bool()));
+
+TEST(ThreadSafeTest, concurrentAllocations) {
+    constexpr int threadCount = 4;
+    constexpr int nodesPerThread = 1000;
+    MemoryPool<std::uint64_t> pool{1ULL << 20, MemoryPoolThreading::ThreadSafe};
+    std::vector<std::vector<MemoryNode<std::uint64_t>>> nodes(threadCount);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+        threads.emplace_back([&pool, &nodes, t]() {
+            for (int i = 0; i < nodesPerThread; ++i)
+                nodes[t].push_back(pool.alloc(0, std::uint64_t(t * nodesPerThread + i)));
+        });
+
+    for (auto &thread: threads) thread.join();
+
+    for (int t = 0; t < threadCount; ++t)
+        for (int i = 0; i < nodesPerThread; ++i)
+            EXPECT_EQ(nodes[t][i].get_data(), t * nodesPerThread + i);
+}
+
+TEST(BulkAllocationTest, allocManyCopiesValue) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    const auto nodes = pool.alloc_many(10, 1, std::uint64_t{42});
+
+    ASSERT_EQ(nodes.size(), 10);
+    for (const auto &node: nodes)
+        EXPECT_EQ(node.get_data(), 42);
+}
+
+TEST(BulkAllocationTest, allocRangeKeepsOrder) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    const std::vector<std::uint64_t> values{1, 2, 3, 4, 5};
+    const auto nodes = pool.alloc_range(0, values.begin(), values.end());
+
+    ASSERT_EQ(nodes.size(), values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+        EXPECT_EQ(nodes[i].get_data(), values[i]);
+}
+
+TEST(BulkAllocationTest, throwsIfPoolIsTooSmall) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    EXPECT_THROW(pool.alloc_many(1000, 0, std::uint64_t{0}), std::bad_alloc);
+    EXPECT_NO_THROW(pool.alloc_many(10, 0, std::uint64_t{0}));
+}
+
+TEST(LargeObjectTest, largerThanPool) {
+    using Buffer = std::array<std::uint64_t, 1ULL << 14>;
+    MemoryPool<Buffer> pool{DEFAULT_POOL_SIZE};
+    Buffer buffer{};
+    buffer.back() = 42;
+    auto node = pool.alloc(0, std::move(buffer));
+
+    EXPECT_EQ(node.get_data().back(), 42);
+}
+
+TEST(TrivialTest, overAlignedValues) {
+    struct alignas(32) Vector {
+        std::uint64_t lanes[4];
+    };
+    static_assert(std::is_trivially_destructible_v<Vector>);
+
+    MemoryPool<Vector> pool{DEFAULT_POOL_SIZE};
+    auto root = pool.alloc(1, Vector{{0, 1, 2, 3}});
+    pool.add_root_node(root);
+    for (std::uint64_t i = 0; i < 10 * DEFAULT_POOL_SIZE; ++i) {
+        auto node = pool.alloc(1, Vector{{i, i, i, i}});
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&node.get_data()) % alignof(Vector), 0);
+        if (i % 8 == 0)
+            pool.gc_mark_and_sweep();
+    }
+
+    EXPECT_EQ(root.get_data().lanes[3], 3);
+}
+
+TEST(SamplingTest, attributesAllocationsToSites) {
+    MemoryPool<std::uint64_t> pool{1ULL << 20};
+    pool.enable_sampling(256);
+
+    pool.set_allocation_site("kept");
+    auto root = pool.alloc(1, std::uint64_t{0});
+    pool.add_root_node(root);
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        auto node = pool.alloc(1, std::uint64_t{i});
+        node.set_neighbour(root.get_neighbour(0), 0);
+        root.set_neighbour(node, 0);
+    }
+
+    pool.set_allocation_site("garbage");
+    for (std::uint64_t i = 0; i < 1000; ++i)
+        pool.alloc(0, std::uint64_t{i});
+
+    pool.gc_mark_and_sweep();
+    const auto sites = pool.allocation_sites();
+    ASSERT_EQ(sites.size(), 2);
+    EXPECT_STREQ(sites[0].tag, "kept");
+    EXPECT_EQ(sites[0].deaths, 0);
+    EXPECT_EQ(sites[0].survivingBytes, sites[0].allocatedBytes);
+    EXPECT_STREQ(sites[1].tag, "garbage");
+    EXPECT_GT(sites[1].samples, 0);
+    EXPECT_EQ(sites[1].deaths, sites[1].samples);
+    EXPECT_EQ(sites[1].survivingBytes, 0);
+}
+
+TEST(GrowthTest, growsInsteadOfThrowing) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    pool.enable_growth();
+
+    std::vector<MemoryNode<std::uint64_t>> nodes;
+    for (std::uint64_t i = 0; i < 10 * DEFAULT_POOL_SIZE; ++i)
+        nodes.push_back(pool.alloc(0, std::uint64_t{i}));
+
+    for (std::uint64_t i = 0; i < nodes.size(); ++i)
+        EXPECT_EQ(nodes[i].get_data(), i);
+}
+
+TEST(CompactionTest, nodesSurviveRelocation) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    std::vector<MemoryNode<std::uint64_t>> survivors;
+    for (std::uint64_t i = 0; i < 16; ++i) {
+        auto node = pool.alloc(1, std::uint64_t{i});
+        if (i % 3 == 2) {
+            if (!survivors.empty())
+                node.set_neighbour(survivors.back(), 0);
+
+            pool.add_root_node(node);
+            survivors.push_back(std::move(node));
+        }
+    }
+
+    const auto before = &survivors.back().get_data();
+    pool.gc_mark_compact();
+    EXPECT_LT(&survivors.back().get_data(), before);
+
+    for (std::size_t i = 0; i < survivors.size(); ++i) {
+        EXPECT_EQ(survivors[i].get_data(), 3 * i + 2);
+        if (i > 0) {
+            EXPECT_EQ(survivors[i].get_neighbour(0).get_data(), 3 * i - 1);
+        }
+    }
+}
+
+TEST(EmptyNodeTest, copiesAndReadsEmptyNodes) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    auto node = pool.alloc(1, std::uint64_t{1});
+    pool.add_root_node(node);
+
+    const auto unset = node.get_neighbour(0);
+    EXPECT_TRUE(unset.empty());
+    EXPECT_THROW((void) unset.get_data(), std::logic_error);
+    node.set_neighbour(unset, 0);
+
+    auto moved = std::move(node);
+    const auto copy = node;
+    EXPECT_TRUE(copy.empty());
+    EXPECT_FALSE(pool.remove_root_node(copy));
+
+    const auto collected = pool.alloc(0, std::uint64_t{2});
+    pool.gc_mark_and_sweep();
+    const auto copyOfCollected = collected;
+    EXPECT_TRUE(copyOfCollected.empty());
+    EXPECT_THROW((void) copyOfCollected.get_data(), std::logic_error);
+    EXPECT_EQ(moved.get_data(), 1);
+}
+
+TEST(CopyingTest, nodesSurviveCopying) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE};
+    pool.alloc(0, std::uint64_t{0});
+    auto root = pool.alloc(1, std::uint64_t{1});
+    root.set_neighbour(pool.alloc(0, std::uint64_t{2}), 0);
+    pool.add_root_node(root);
+
+    pool.gc_copy(MemoryPoolTraversal::DepthFirst);
+    EXPECT_EQ(root.get_data(), 1);
+    EXPECT_EQ(root.get_neighbour(0).get_data(), 2);
+}
+
+TEST(IncrementalTest, collectsInSteps) {
+    MemoryPool<std::uint64_t> pool{DEFAULT_POOL_SIZE * 4};
+    auto root = pool.alloc(1, std::uint64_t{0});
+    pool.add_root_node(root);
+    auto previous = root;
+    for (std::uint64_t i = 1; i < 20; ++i) {
+        auto node = pool.alloc(1, std::uint64_t{i});
+        previous.set_neighbour(node, 0);
+        previous = std::move(node);
+        pool.alloc(0, std::uint64_t{0});
+    }
+
+    pool.gc_start();
+    std::size_t steps = 0;
+    while (pool.gc_step(2))
+        ++steps;
+    EXPECT_GT(steps, 5);
+
+    auto late = pool.alloc(0, std::uint64_t{100});
+    root.get_neighbour(0).set_neighbour(late, 0);
+    pool.gc_finish();
+    EXPECT_EQ(root.get_neighbour(0).get_neighbour(0).get_data(), 100);
+}
+
+TEST(RootTest, rootsUntilDestroyed) {
+    MemoryPool<Handle> pool{DEFAULT_POOL_SIZE};
+    auto node = pool.alloc(0, Handle{false});
+    auto detectDestructorCall = node.get_data().get();
+    {
+        Root<Handle> root{node};
+        Root<Handle> again{node};
+        Root<Handle> moved{std::move(again)};
+        pool.gc_mark_and_sweep();
+        Mock::VerifyAndClearExpectations(detectDestructorCall);
+    }
+
+    EXPECT_FALSE(pool.remove_root_node(node));
+    EXPECT_CALL(*detectDestructorCall, die()).Times(1);
+    pool.gc_mark_and_sweep();
+    Mock::VerifyAndClearExpectations(detectDestructorCall);
+}